@@ -444,6 +444,7 @@ QMenu * DkActionManager::createSortMenu(QWidget * parent) {
 	mSortMenu->addAction(mSortActions[menu_sort_filename]);
 	mSortMenu->addAction(mSortActions[menu_sort_date_created]);
 	mSortMenu->addAction(mSortActions[menu_sort_date_modified]);
+	mSortMenu->addAction(mSortActions[menu_sort_file_size]);
 	mSortMenu->addAction(mSortActions[menu_sort_random]);
 	mSortMenu->addSeparator();
 	mSortMenu->addAction(mSortActions[menu_sort_ascending]);
@@ -1085,6 +1086,12 @@ void DkActionManager::createActions(QWidget* parent) {
 	mSortActions[menu_sort_random]->setCheckable(true);
 	mSortActions[menu_sort_random]->setChecked(DkSettingsManager::param().global().sortMode == DkSettings::sort_random);
 
+	mSortActions[menu_sort_file_size] = new QAction(QObject::tr("by File &Size"), parent);
+	mSortActions[menu_sort_file_size]->setObjectName("menu_sort_file_size");
+	mSortActions[menu_sort_file_size]->setStatusTip(QObject::tr("Sort by File Size"));
+	mSortActions[menu_sort_file_size]->setCheckable(true);
+	mSortActions[menu_sort_file_size]->setChecked(DkSettingsManager::param().global().sortMode == DkSettings::sort_file_size);
+
 	mSortActions[menu_sort_ascending] = new QAction(QObject::tr("&Ascending"), parent);
 	mSortActions[menu_sort_ascending]->setObjectName("menu_sort_ascending");
 	mSortActions[menu_sort_ascending]->setStatusTip(QObject::tr("Sort in Ascending Order"));
@@ -273,6 +273,7 @@ void DkBaseViewPort::setImage(cv::Mat newImg) {
 void DkBaseViewPort::setImage(QImage newImg) {
 
 	mImgStorage.setImage(newImg);
+	setTiledImage(QSharedPointer<DkTiledImage>());
 	QRectF oldImgRect = mImgRect;
 	mImgRect = QRectF(QPoint(), getImageSize());
 	
@@ -286,6 +287,25 @@ void DkBaseViewPort::setImage(QImage newImg) {
 	emit newImageSignal(&newImg);
 }
 
+/**
+ * Sets the tiled representation of the current (preview) image.
+ * If set, the visible tiles are rendered on top of the preview when zooming in.
+ * @param tiledImage the tiled image or null.
+ **/
+void DkBaseViewPort::setTiledImage(QSharedPointer<DkTiledImage> tiledImage) {
+
+	if (mTiledImage == tiledImage)
+		return;
+
+	if (mTiledImage)
+		disconnect(mTiledImage.data(), SIGNAL(tileLoaded()), this, SLOT(update()));
+
+	mTiledImage = tiledImage;
+
+	if (mTiledImage)
+		connect(mTiledImage.data(), SIGNAL(tileLoaded()), this, SLOT(update()), Qt::QueuedConnection);
+}
+
 QImage DkBaseViewPort::getImage() const {
 	
 	if (mMovie && mMovie->isValid())
@@ -390,6 +410,12 @@ bool DkBaseViewPort::event(QEvent *event) {
 	if (event->type() == QEvent::Gesture)
 		return gestureEvent(static_cast<QGestureEvent*>(event));
 
+	// the pyramid of a visible viewport is needed for the next paint
+	if (event->type() == QEvent::Show)
+		mImgStorage.setPinned(true);
+	else if (event->type() == QEvent::Hide)
+		mImgStorage.setPinned(false);
+
 	return QGraphicsView::event(event);
 }
 
@@ -572,14 +598,62 @@ void DkBaseViewPort::draw(QPainter & painter, double opacity) {
 	}
 	else if (mMovie && mMovie->isValid())
 		painter.drawPixmap(mImgViewRect, mMovie->currentPixmap(), mMovie->frameRect());
-	else
+	else {
 		painter.drawImage(mImgViewRect, imgQt, imgQt.rect());
+		drawTiles(painter);
+	}
 
 	painter.setOpacity(oldOp);
 
 	//qDebug() << "view rect: " << imgStorage.getImage().size()*imgMatrix.m11()*worldMatrix.m11() << " img rect: " << imgQt.size();
 }
 
+/**
+ * Returns the scale from the displayed preview to the full resolution of gigapixel images.
+ * Zoom levels and image coordinates shown to the user refer to the full resolution.
+ * @return double the scale (1.0 if the image is not tiled).
+ **/
+double DkBaseViewPort::tileScale() const {
+
+	if (!mTiledImage || mImgRect.isEmpty())
+		return 1.0;
+
+	return mTiledImage->size().width()/mImgRect.width();
+}
+
+/**
+ * Renders the visible tiles of gigapixel images.
+ * The preview is sufficient unless we zoom in. Then only the tiles which
+ * are visible are requested at the pyramid level needed. Tiles that are
+ * not decoded yet are covered by the preview which is painted beneath.
+ * @param painter the painter (world matrix set).
+ **/
+void DkBaseViewPort::drawTiles(QPainter & painter) {
+
+	if (!mTiledImage || mImgRect.isEmpty())
+		return;
+
+	double zoom = mImgMatrix.m11()*mWorldMatrix.m11();
+
+	// the preview is sufficient
+	if (zoom <= 1.0)
+		return;
+
+	// preview -> full resolution
+	double fs = tileScale();
+	QTransform toFull;
+	toFull.scale(fs, fs);
+
+	QRectF visibleRect = (mImgMatrix*mWorldMatrix).inverted().mapRect(mViewportRect).intersected(mImgRect);
+	int level = mTiledImage->level(zoom/fs);
+
+	QVector<DkTile> tiles = mTiledImage->tiles(toFull.mapRect(visibleRect), level);
+	QTransform toView = toFull.inverted()*mImgMatrix;
+
+	for (const DkTile& t : tiles)
+		painter.drawImage(toView.mapRect(QRectF(t.rect)), t.image, t.image.rect());
+}
+
 bool DkBaseViewPort::imageInside() const {
 
 	return mWorldMatrix.m11() <= 1.0f || mViewportRect.contains(mWorldMatrix.mapRect(mImgViewRect));
@@ -132,6 +132,9 @@ public:
 		return &mImgStorage;
 	};
 
+	void setTiledImage(QSharedPointer<DkTiledImage> tiledImage);
+	double tileScale() const;
+
 	//virtual QImage getScaledImage(float factor);
 
 #ifdef WITH_OPENCV
@@ -191,6 +194,7 @@ protected:
 	Qt::KeyboardModifier mCtrlMod;
 
 	DkImageStorage mImgStorage;
+	QSharedPointer<DkTiledImage> mTiledImage;
 	QSharedPointer<QMovie> mMovie;
 	QSharedPointer<QSvgRenderer> mSvg;
 	QBrush mPattern;
@@ -217,6 +221,7 @@ protected:
 
 	// functions
 	virtual void draw(QPainter & painter, double opacity = 1.0);
+	void drawTiles(QPainter & painter);
 	virtual void updateImageMatrix();
 	virtual QTransform getScaledImageMatrix() const;
 	virtual QTransform getScaledImageMatrix(const QSize& size) const;
@@ -47,10 +47,23 @@
 #include <QPixmap>
 #include <QIcon>
 #include <QDebug>
+#include <QDir>
+#include <QMutex>
+#include <QTemporaryFile>
+#include <QSaveFile>
+#include <QtConcurrentRun>
+
+#if QT_VERSION >= 0x050400
+#include <QStorageInfo>
+#endif
 
 #include <qmath.h>
 #include <assert.h>
 
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>	// madvise
+#endif
+
 // quazip
 #ifdef WITH_QUAZIP
 #include <quazip/JlCompress.h>
@@ -106,26 +119,253 @@
 namespace nmc {
 
 // DkEditImage --------------------------------------------------------------------
+/**
+ * Shared data of DkEditImage.
+ * mutex guards the members, jobMutex serializes the background jobs.
+ **/
+class DkEditData {
+
+public:
+	QMutex mutex;
+	QMutex jobMutex;
+
+	QImage img;								// uncompressed image (might be null)
+	QByteArray data;						// zlib compressed pixels (empty if not compressed or spilled)
+	QSharedPointer<QTemporaryFile> file;	// spilled data
+
+	QImage::Format format = QImage::Format_Invalid;
+	QSize size;
+	int bytesPerLine = 0;
+	QVector<QRgb> colorTable;
+
+	bool cached = true;		// keep the uncompressed image in memory
+	bool spill = false;		// move the compressed data to disk
+};
+
 DkEditImage::DkEditImage(const QImage& img, const QString& editName) {
-	mImg = img;
+	mData = QSharedPointer<DkEditData>(new DkEditData());
+	mData->img = img;
 	mEditName = editName;
 }
 
 void DkEditImage::setImage(const QImage& img) {
-	mImg = img;
+
+	QMutexLocker jobLocker(&mData->jobMutex);
+	QMutexLocker locker(&mData->mutex);
+
+	mData->img = img;
+	mData->data.clear();
+	mData->file.clear();
+	mData->cached = true;
+	mData->spill = false;
 }
 
+/**
+ * Returns the image of this edit state.
+ * If the state is compressed, it is decompressed (and kept in memory
+ * until the state is compressed again). This blocks if the state
+ * was not decompressed in the background before.
+ **/
 QImage DkEditImage::image() const {
-	return mImg;
+
+	{
+		QMutexLocker locker(&mData->mutex);
+
+		if (!mData->img.isNull() || (mData->data.isEmpty() && !mData->file))
+			return mData->img;
+	}
+
+	// wait for the background jobs
+	QMutexLocker jobLocker(&mData->jobMutex);
+	QImage img = uncompress(mData);
+
+	QMutexLocker locker(&mData->mutex);
+	if (mData->img.isNull())
+		mData->img = img;
+
+	return mData->img;
 }
 
 QString DkEditImage::editName() const {
 	return mEditName;
 }
 
-int DkEditImage::size() const {
+/**
+ * Returns the memory that is currently used by this state in MB.
+ **/
+float DkEditImage::size() const {
 	
-	return qRound(DkImage::getBufferSizeFloat(mImg.size(), mImg.depth()));
+	QMutexLocker locker(&mData->mutex);
+
+	return DkImage::getBufferSizeFloat(mData->img.size(), mData->img.depth()) + mData->data.size()/(1024.0f*1024.0f);
+}
+
+/**
+ * Sets whether the state is needed soon.
+ * Cached states are decompressed in the background, the others are compressed.
+ * @param cached if true, the uncompressed image is kept in memory
+ **/
+void DkEditImage::setCached(bool cached) {
+
+	{
+		QMutexLocker locker(&mData->mutex);
+		mData->cached = cached;
+
+		bool hasData = !mData->data.isEmpty() || mData->file;
+
+		// nothing todo?
+		if (cached && (!mData->img.isNull() || !hasData))
+			return;
+		if (!cached && mData->img.isNull())
+			return;
+	}
+
+	QtConcurrent::run(&DkEditImage::update, mData);
+}
+
+/**
+ * Moves the compressed state to a temporary file (in the background).
+ **/
+void DkEditImage::spill() {
+
+	{
+		QMutexLocker locker(&mData->mutex);
+
+		if (mData->spill)
+			return;
+
+		mData->spill = true;
+		mData->cached = false;
+	}
+
+	QtConcurrent::run(&DkEditImage::update, mData);
+}
+
+/**
+ * Background job that brings the state in line with its flags.
+ * It compresses, spills, decompresses or releases the image.
+ **/
+void DkEditImage::update(QSharedPointer<DkEditData> d) {
+
+	QMutexLocker jobLocker(&d->jobMutex);
+
+	QImage img;
+	bool cached, spill, hasData;
+	{
+		QMutexLocker locker(&d->mutex);
+		img = d->img;
+		cached = d->cached;
+		spill = d->spill;
+		hasData = !d->data.isEmpty() || d->file;
+	}
+
+	// compress
+	if (!hasData && !img.isNull()) {
+
+		DkTimer dt;
+		QByteArray data = compress(img);
+
+		if (!data.isEmpty()) {
+			QMutexLocker locker(&d->mutex);
+			d->data = data;
+			d->format = img.format();
+			d->size = img.size();
+			d->bytesPerLine = img.bytesPerLine();
+			d->colorTable = img.colorTable();
+			hasData = true;
+
+			qDebug() << "[DkEditImage] state compressed to" << data.size()/(1024.0f*1024.0f) << "MB in" << dt;
+		}
+	}
+
+	// spill
+	if (spill && hasData) {
+
+		QByteArray data;
+		{
+			QMutexLocker locker(&d->mutex);
+			data = d->data;
+		}
+
+		if (!data.isEmpty()) {
+
+			QSharedPointer<QTemporaryFile> file(new QTemporaryFile(QDir::tempPath() + "/nomacs-history-XXXXXX"));
+
+			if (file->open() && file->write(data) == data.size() && file->flush()) {
+				QMutexLocker locker(&d->mutex);
+				d->file = file;
+				d->data.clear();
+			}
+			else
+				qWarning() << "[DkEditImage] could not spill the edit state to" << file->fileName();
+		}
+	}
+
+	// decompress states that are needed soon
+	if (cached && img.isNull() && hasData) {
+
+		QImage uImg = uncompress(d);
+
+		QMutexLocker locker(&d->mutex);
+		if (d->cached && d->img.isNull())
+			d->img = uImg;
+	}
+	// release the uncompressed image
+	else if (!cached && hasData) {
+
+		QMutexLocker locker(&d->mutex);
+		if (!d->cached)
+			d->img = QImage();
+	}
+}
+
+QByteArray DkEditImage::compress(const QImage& img) {
+
+	// fast compression - we do not want to wait for the history
+	if (img.byteCount() <= 0)
+		return QByteArray();
+
+	return qCompress(img.constBits(), img.byteCount(), 1);
+}
+
+/**
+ * Decompresses the state.
+ * Call this function with jobMutex locked.
+ **/
+QImage DkEditImage::uncompress(QSharedPointer<DkEditData> d) {
+
+	QByteArray data;
+	QSharedPointer<QTemporaryFile> file;
+	{
+		QMutexLocker locker(&d->mutex);
+
+		if (!d->img.isNull())
+			return d->img;
+
+		data = d->data;
+		file = d->file;
+	}
+
+	if (data.isEmpty() && file) {
+		file->seek(0);
+		data = file->readAll();
+	}
+
+	QByteArray raw = qUncompress(data);
+	QImage img(d->size, d->format);
+
+	if (img.isNull() || raw.size() != d->bytesPerLine*d->size.height()) {
+		qWarning() << "[DkEditImage] could not decompress the edit state";
+		return QImage();
+	}
+
+	int bpl = qMin(d->bytesPerLine, img.bytesPerLine());
+	for (int rIdx = 0; rIdx < img.height(); rIdx++)
+		memcpy(img.scanLine(rIdx), raw.constData() + rIdx*d->bytesPerLine, bpl);
+
+	img.setColorTable(d->colorTable);
+
+	return img;
 }
 
 // Basic loader and image edit class --------------------------------------------------------------------
@@ -222,6 +462,57 @@ bool DkBasicLoader::loadGeneral(const QString& filePath, QSharedPointer<QByteArr
 		}
 	}
 
+	// sniff the file signature - this is done once per file
+	if (!imgLoaded && mDetectedFile != mFile) {
+
+		QByteArray header;
+
+		if (ba && !ba->isEmpty())
+			header = QByteArray::fromRawData(ba->constData(), qMin(ba->size(), 4096));
+		else {
+			QFile file(mFile);
+			if (file.open(QIODevice::ReadOnly))
+				header = file.read(4096);
+		}
+
+		mDetectedLoader = detectLoader(header, suf, mDetectedFormat);
+		mDetectedFile = mFile;
+	}
+
+	bool qtFormat = qtFormats.contains(suf.toStdString().c_str()) || 
+		(mDetectedLoader == qt_loader && qtFormats.contains(mDetectedFormat));
+
+	// gigapixel images: just a preview is decoded here
+	if (!imgLoaded && mTiling && !fast && fInfo.exists() && qtFormat) {
+
+		imgLoaded = loadTiledFile(mFile, img, ba);
+		if (imgLoaded) mLoader = qt_loader;
+	}
+
+	// route the file directly to the decoder identified by its signature
+	if (!imgLoaded && mDetectedLoader == qt_loader && qtFormats.contains(mDetectedFormat)) {
+
+		if (!ba || ba->isEmpty())
+			imgLoaded = img.load(mFile, mDetectedFormat.constData());
+		else
+			imgLoaded = img.loadFromData(*ba.data(), mDetectedFormat.constData());
+
+		if (imgLoaded) mLoader = qt_loader;
+	}
+	else if (!imgLoaded && mDetectedLoader == psd_loader) {
+
+		imgLoaded = loadPSDFile(mFile, img, ba);
+		if (imgLoaded) mLoader = psd_loader;
+	}
+	else if (!imgLoaded && mDetectedLoader == raw_loader) {
+
+		imgLoaded = loadRawFile(mFile, img, ba, fast);
+		if (imgLoaded) mLoader = raw_loader;
+	}
+
+	if (!imgLoaded && mDetectedLoader != no_loader)
+		qInfo() << "could not load" << mFile << "with the" << loaderName(mDetectedLoader) << "loader detected - trying all loaders";
+
 	// default Qt loader
 	// here we just try those formats that are officially supported
 	if (!imgLoaded && qtFormats.contains(suf.toStdString().c_str())) {
@@ -265,9 +556,13 @@ bool DkBasicLoader::loadGeneral(const QString& filePath, QSharedPointer<QByteArr
 
 		// if we first load files to buffers, we can additionally load images with wrong extensions (rainer bugfix : )
 		// TODO: add warning here
-		QByteArray lba;
-		loadFileToBuffer(mFile, lba);
-		imgLoaded = img.loadFromData(lba);
+		if (ba && !ba->isEmpty())
+			imgLoaded = img.loadFromData(*ba.data());
+		else {
+			QByteArray lba;
+			loadFileToBuffer(mFile, lba);
+			imgLoaded = img.loadFromData(lba);
+		}
 		
 		if (imgLoaded) mLoader = qt_loader;
 	}  
@@ -317,11 +612,279 @@ bool DkBasicLoader::loadGeneral(const QString& filePath, QSharedPointer<QByteArr
 	if (imgLoaded)
 		setEditImage(img, tr("Original Image"));
 
-	qInfo() << filePath << "loaded in" << dt;
+	qInfo() << filePath << "loaded with the" << loaderName(mLoader) << "loader in" << dt;
 
 	return imgLoaded;
 }
 
+/**
+ * Detects the decoder from the file signature (magic bytes).
+ * Tiff based RAW formats (e.g. nef, cr2, dng) share the tiff signature,
+ * hence the suffix is used to distinguish them from tiffs.
+ * @param header the first bytes of the file (4 KB are sufficient).
+ * @param suffix the (lower case) file suffix.
+ * @param format the Qt format name (if qt_loader is returned).
+ * @return int the loader (see loaderID) or no_loader if the signature is unknown.
+ **/
+int DkBasicLoader::detectLoader(const QByteArray& header, const QString& suffix, QByteArray& format) {
+
+	format.clear();
+
+	if (header.size() < 12)
+		return no_loader;
+
+	const QByteArray& h = header;
+
+	// formats which are decoded by Qt
+	if (h.startsWith("\xFF\xD8\xFF"))
+		format = "jpeg";
+	else if (h.startsWith("\x89PNG\r\n\x1A\n"))
+		format = "png";
+	else if (h.startsWith("GIF87a") || h.startsWith("GIF89a"))
+		format = "gif";
+	else if (h.startsWith("RIFF") && h.mid(8, 4) == "WEBP")
+		format = "webp";
+	else if (h.startsWith("BM"))
+		format = "bmp";
+	else if (h.startsWith(QByteArray("\x00\x00\x01\x00", 4)))
+		format = "ico";
+	else if (h.startsWith(QByteArray("\x00\x00\x00\x0CjP  ", 8)) || h.startsWith(QByteArray("\xFF\x4F\xFF\x51", 4)))
+		format = "jp2";
+	else if (h.startsWith("icns"))
+		format = "icns";
+	else if (h.startsWith("DDS "))
+		format = "dds";
+	else if (h.startsWith("v/1\x01"))
+		format = "exr";
+	else if (h.size() > 2 && h[0] == 'P' && h[1] >= '1' && h[1] <= '6' && QChar(h[2]).isSpace())
+		format = (h[1] == '1' || h[1] == '4') ? "pbm" : (h[1] == '2' || h[1] == '5') ? "pgm" : "ppm";
+	else if (h.startsWith("<?xml") || h.startsWith("<svg"))
+		format = (h.contains("<svg")) ? "svg" : "";
+
+	if (!format.isEmpty())
+		return qt_loader;
+
+	// photoshop
+	if (h.startsWith("8BPS"))
+		return psd_loader;
+
+	// RAW formats with their own signature
+	if (h.startsWith(QByteArray("II\x1A\x00\x00\x00HEAPCCDR", 14)) ||		// crw
+		h.startsWith("FUJIFILMCCD-RAW") ||								// raf
+		h.startsWith(QByteArray("\x00MRM", 4)) ||						// mrw
+		h.startsWith("FOVb") ||											// x3f
+		h.startsWith("IIRO") || h.startsWith("IIRS") ||					// orf
+		h.startsWith(QByteArray("IIU\x00", 4)) ||						// rw2
+		(h.startsWith("II*") && h.mid(8, 2) == "CR"))					// cr2
+		return raw_loader;
+
+	// tiff & tiff based RAW formats
+	if (h.startsWith(QByteArray("II*\x00", 4)) || h.startsWith(QByteArray("MM\x00*", 4))) {
+
+		// tiff based RAW formats
+		if (suffix.contains(QRegExp("^(nef|nrw|cr2|arw|sr2|srf|dng|srw|3fr|mos|pef|iiq|erf|kdc|dcr)$", Qt::CaseInsensitive)))
+			return raw_loader;
+
+		format = "tiff";
+		return qt_loader;
+	}
+
+	return no_loader;
+}
+
+QString DkBasicLoader::loaderName(int loaderId) {
+
+	switch (loaderId) {
+	case qt_loader:		return "Qt";
+	case psd_loader:	return "PSD";
+	case webp_loader:	return "WebP";
+	case raw_loader:	return "RAW";
+	case roh_loader:	return "ROH";
+	case hdr_loader:	return "HDR";
+	}
+
+	return "unknown";
+}
+
+/**
+ * Loads a down-scaled version of the image.
+ * Jpgs are decoded using DCT scaling (1/2, 1/4 or 1/8) which is a fraction
+ * of the cost of a full decode. We use the smallest scale that still
+ * covers size (after applying the EXIF orientation).
+ * @param filePath the file to be loaded.
+ * @param ba the file buffer (might be empty).
+ * @param size the size that should be covered.
+ * @return bool true if the preview was loaded.
+ **/
+bool DkBasicLoader::loadPreview(const QString& filePath, const QSharedPointer<QByteArray> ba, const QSize& size) {
+
+	DkTimer dt;
+
+	if (size.isEmpty())
+		return false;
+
+	// embedded previews (e.g. of RAW files) are cheaper than any decoding
+	if (loadEmbeddedPreview(filePath, ba, size))
+		return true;
+
+	QBuffer buffer;
+	QImageReader reader;
+
+	if (ba && !ba->isEmpty()) {
+		buffer.setBuffer(ba.data());
+		buffer.open(QIODevice::ReadOnly);
+		reader.setDevice(&buffer);
+	}
+	else
+		reader.setFileName(filePath);
+
+	// only jpgs are down-scaled while decoding - gigapixel images have their own preview
+	if (reader.format() != "jpeg" || !reader.supportsOption(QImageIOHandler::ScaledSize) || DkTiledImage::isTileable(reader))
+		return false;
+
+	int orientation = 0;
+
+	// the metadata was read when looking for embedded previews
+	if (mMetaData && !DkSettingsManager::param().metaData().ignoreExifOrientation) {
+		try {
+			orientation = mMetaData->getOrientationDegree();
+		}
+		catch (...) {}	// ignore if we cannot read the metadata
+	}
+
+	QSize imgSize = reader.size();
+	QSize oSize = (qAbs(orientation) == 90) ? imgSize.transposed() : imgSize;
+
+	if (imgSize.isEmpty())
+		return false;
+
+	// find the smallest DCT scale that covers size
+	double scale = qMin((double)size.width()/oSize.width(), (double)size.height()/oSize.height());
+	int denom = 8;
+
+	while (denom > 1 && denom*scale > 1.0)
+		denom /= 2;
+
+	// the full image is needed anyway
+	if (denom == 1)
+		return false;
+
+	// libjpeg rounds up
+	reader.setScaledSize(QSize((imgSize.width() + denom - 1)/denom, (imgSize.height() + denom - 1)/denom));
+	QImage img = reader.read();
+
+	if (img.isNull())
+		return false;
+
+	if (orientation != 0 && orientation != -1)
+		img = rotate(img, orientation);
+
+	mFile = filePath;
+	mLoader = qt_loader;
+	setEditImage(img, tr("Original Image"));
+
+	qInfo() << "preview (1/" << denom << ") of" << filePath << "loaded in" << dt;
+
+	return true;
+}
+
+bool DkBasicLoader::loadEmbeddedPreview(const QString& filePath, const QSharedPointer<QByteArray> ba, const QSize& size, Qt::AspectRatioMode mode) {
+
+	DkTimer dt;
+
+	if (size.isEmpty() || !mMetaData)
+		return false;
+
+	QImage img;
+	QSize pixelSize;
+	int orientation = 0;
+
+	try {
+		mMetaData->readMetaData(filePath, ba);
+		img = mMetaData->getBestFitPreview(size, mode);
+		pixelSize = mMetaData->getPixelSize();
+		orientation = mMetaData->getOrientationDegree();
+	}
+	catch (...) {}	// ignore if we cannot read the metadata
+
+	if (img.isNull())
+		return false;
+
+	// some cameras embed letterboxed, cropped or rotated previews - these would not show the whole image
+	// sensor sizes include a few pixels that are cropped in the preview, so we allow for 2% deviation
+	double aspectDeviation = pixelSize.isEmpty() ? 1.0 :
+		qAbs(((double)img.width()/img.height()) / ((double)pixelSize.width()/pixelSize.height()) - 1.0);
+
+	if (aspectDeviation > 0.02) {
+		qInfo() << "embedded preview" << img.size() << "of" << filePath << "does not match the image size" << pixelSize << "- ignoring it";
+		return false;
+	}
+
+	if (!DkSettingsManager::param().metaData().ignoreExifOrientation)
+		img = rotate(img, orientation);
+
+	mFile = filePath;
+	mLoader = qt_loader;	// previews are JPGs
+	setEditImage(img, tr("Original Image"));
+
+	qInfo() << "embedded preview (" << img.width() << "x" << img.height() << ") of" << filePath << "loaded in" << dt;
+
+	return true;
+}
+
+void DkBasicLoader::setTargetSize(const QSize& size) {
+	mTargetSize = size;
+}
+
+void DkBasicLoader::setTiling(bool tiling) {
+	mTiling = tiling;
+}
+
+/**
+ * Loads a preview of gigapixel images.
+ * The full resolution is decoded tile-wise on demand (see DkTiledImage),
+ * so we neither wait for nor need memory for the whole image.
+ * @param filePath the file to be loaded.
+ * @param img the preview.
+ * @param ba the file buffer (might be empty).
+ * @return bool true if the image is tiled and the preview could be loaded.
+ **/
+bool DkBasicLoader::loadTiledFile(const QString& filePath, QImage& img, QSharedPointer<QByteArray> ba) {
+
+	// tiles are not rotated
+	int orientation = mMetaData ? mMetaData->getOrientationDegree() : 0;
+	if (orientation != 0 && orientation != -1 && !DkSettingsManager::param().metaData().ignoreExifOrientation)
+		return false;
+
+	QBuffer buffer;
+	QImageReader reader;
+
+	if (ba && !ba->isEmpty()) {
+		buffer.setBuffer(ba.data());
+		buffer.open(QIODevice::ReadOnly);
+		reader.setDevice(&buffer);
+	}
+	else
+		reader.setFileName(filePath);
+
+	if (!DkTiledImage::isTileable(reader))
+		return false;
+
+	QSharedPointer<DkTiledImage> tiledImage(new DkTiledImage(filePath, reader.size()));
+	reader.setScaledSize(tiledImage->previewSize());
+	img = reader.read();
+
+	if (img.isNull()) {
+		qWarning() << "could not load preview of" << filePath << reader.errorString();
+		return false;
+	}
+
+	mTiledImage = tiledImage;
+	qInfo() << "tiled image" << tiledImage->size() << "preview:" << img.size();
+
+	return true;
+}
+
 /**
  * Loads special RAW files that are generated by the Hamamatsu camera.
  * @param fileName the filename of the file to be loaded.
@@ -411,13 +974,24 @@ bool DkBasicLoader::loadRawFile(const QString& filePath, QImage& img, QSharedPoi
 
 				mMetaData->readMetaData(filePath, ba);
 
-				int minWidth = 0;
+				QSize size = mTargetSize;
+				bool decodeIfSmall = false;
 
 #ifdef WITH_LIBRAW	// if nomacs has libraw - we can still hope for a fallback -> otherwise try whatever we have here
-				if (DkSettingsManager::param().resources().loadRawThumb == DkSettings::raw_thumb_if_large)
-					minWidth = 1920;
+				if (!fast && DkSettingsManager::param().resources().loadRawThumb == DkSettings::raw_thumb_if_large) {
+					decodeIfSmall = true;
+
+					if (size.isEmpty())
+						size = QSize(1920, 1920);
+				}
 #endif
-				img = mMetaData->getPreviewImage(minWidth);
+				// the smallest preview that covers the size we need
+				if (!size.isEmpty())
+					img = mMetaData->getBestFitPreview(size);
+
+				// otherwise the largest preview is still faster than decoding
+				if (img.isNull() && !decodeIfSmall)
+					img = mMetaData->getPreviewImage();
 
 				if (!img.isNull()) {
 					//setEditImage(img, tr("Original Image"));
@@ -825,6 +1399,7 @@ bool DkBasicLoader::loadPSDFile(const QString& filePath, QImage& img, QSharedPoi
 void DkBasicLoader::setImage(const QImage & img, const QString & editName, const QString & file) {
 
 	mFile = file;
+	mTiledImage.clear();
 	setEditImage(img, editName);
 };
 
@@ -838,21 +1413,27 @@ void DkBasicLoader::setEditImage(const QImage& img, const QString& editName) {
 		mImages.pop_back();
 	}
 
-	// compute new history size
-	int historySize = 0;
-	for (const DkEditImage& e : mImages) {
-		historySize += e.size();
-	}
-
 	DkEditImage newImg(img, editName);
 
-	if (historySize + newImg.size() > DkSettingsManager::param().resources().historyMemory && mImages.size() > mMinHistorySize) {
-		mImages.removeAt(1);
-		qDebug() << "removing history image because it's too large:" << historySize + newImg.size() << "MB";
-	}
-
 	mImages.append(newImg);
 	mImageIndex = mImages.size() - 1;	// set the index again to the last
+
+	updateHistoryCache();
+}
+
+/**
+ * Replaces the preview of a gigapixel image with its full resolution.
+ * The full image is no edit, so the history is not changed.
+ * @param img the image in full resolution
+ **/
+void DkBasicLoader::setFullImage(const QImage& img) {
+
+	if (img.isNull() || !mTiledImage || mImages.isEmpty())
+		return;
+
+	mImages.first().setImage(img);
+	mTiledImage.clear();
+	updateHistoryCache();
 }
 
 QImage DkBasicLoader::image() const {
@@ -868,16 +1449,34 @@ QImage DkBasicLoader::image() const {
 	return mImages[mImageIndex].image();
 }
 
+/**
+ * Returns the tiled representation of gigapixel images.
+ * If the image was edited, the tiles are not valid anymore
+ * and a null pointer is returned.
+ * @return QSharedPointer<DkTiledImage> the tiled image or null.
+ **/
+QSharedPointer<DkTiledImage> DkBasicLoader::tiledImage() const {
+
+	if (mImageIndex != 0)
+		return QSharedPointer<DkTiledImage>();
+
+	return mTiledImage;
+}
+
 void DkBasicLoader::undo() {
 	
 	if (mImageIndex > 0)
 		mImageIndex--;
+
+	updateHistoryCache();
 }
 
 void DkBasicLoader::redo() {
 
 	if (mImageIndex < mImages.size()-1)
 		mImageIndex++;
+
+	updateHistoryCache();
 }
 
 QVector<DkEditImage>* DkBasicLoader::history() {
@@ -894,12 +1493,75 @@ int DkBasicLoader::historyIndex() const {
 	return mImageIndex;
 }
 
-void DkBasicLoader::setMinHistorySize(int size) {
-	mMinHistorySize = size;
+/**
+ * Returns the memory of all edit states but the current one in MB.
+ **/
+float DkBasicLoader::historyMemory() const {
+
+	float mem = 0;
+
+	for (int idx = 0; idx < mImages.size(); idx++) {
+		if (idx != mImageIndex)
+			mem += mImages[idx].size();
+	}
+
+	return mem;
+}
+
+/**
+ * Spills edit states to disk until mem MB are released.
+ * The current state is kept, the oldest states are spilled first.
+ * Spilling is done in the background, the memory released is an estimate.
+ * @param mem the memory that should be released in MB
+ * @return float the memory released in MB.
+ **/
+float DkBasicLoader::releaseHistory(float mem) {
+
+	float released = 0;
+
+	for (int idx = 0; idx < mImages.size() && released < mem; idx++) {
+
+		float s = mImages[idx].size();
+
+		if (idx == mImageIndex || s <= 0)
+			continue;
+
+		mImages[idx].spill();
+		released += s;
+	}
+
+	if (released > 0)
+		qDebug() << "[DkBasicLoader]" << released << "MB of history spilled";
+
+	return released;
+}
+
+/**
+ * Compresses edit states that are not needed soon.
+ * The current state and its neighbors (undo/redo) are kept uncompressed
+ * (or decompressed in the background). If the history exceeds
+ * resources().historyMemory, the oldest states are spilled to disk.
+ **/
+void DkBasicLoader::updateHistoryCache() {
+
+	for (int idx = 0; idx < mImages.size(); idx++)
+		mImages[idx].setCached(qAbs(idx - mImageIndex) <= 1);
+
+	float mem = historyMemory();
+
+	for (int idx = 0; idx < mImages.size() && mem > DkSettingsManager::param().resources().historyMemory; idx++) {
+
+		if (qAbs(idx - mImageIndex) <= 1)
+			continue;
+
+		mem -= mImages[idx].size();
+		mImages[idx].spill();
+	}
 }
 
 void DkBasicLoader::setHistoryIndex(int idx) {
 	mImageIndex = idx;
+	updateHistoryCache();
 }
 
 void DkBasicLoader::loadFileToBuffer(const QString& fileInfo, QByteArray& ba) const {
@@ -922,6 +1584,7 @@ QSharedPointer<QByteArray> DkBasicLoader::loadFileToBuffer(const QString& fileIn
 		return DkZipContainer::extractImage(DkZipContainer::decodeZipFile(fileInfo), DkZipContainer::decodeImageFile(fileInfo));
 #endif
 
+	// not mapped: the buffer might be kept (e.g. to save the metadata) while the file is rewritten
 	QFile file(fileInfo);
 	file.open(QIODevice::ReadOnly);
 
@@ -931,21 +1594,110 @@ QSharedPointer<QByteArray> DkBasicLoader::loadFileToBuffer(const QString& fileIn
 	return ba;
 }
 
+/**
+ * Maps a file to memory instead of reading it.
+ * The buffer returned references the mapped pages (via QByteArray::fromRawData),
+ * hence the file is neither copied to the heap nor duplicated to the page cache.
+ * The file is unmapped if the last reference to the buffer is released.
+ * Note: modifying the buffer detaches (copies) it - the file is never changed.
+ * Only use it for short-lived, read-only decoding (e.g. thumbnails): if the file
+ * is truncated while it is mapped, reading the buffer raises SIGBUS.
+ * @param filePath the file to be mapped.
+ * @return QSharedPointer<QByteArray> the mapped buffer or a null pointer if the file
+ * cannot be mapped (small files, network shares) - the caller should read it then.
+ **/
+QSharedPointer<QByteArray> DkBasicLoader::mapFileToBuffer(const QString& filePath) {
+
+#ifdef Q_OS_WIN
+	// windows locks mapped files (they could neither be deleted nor overwritten by the user)
+	Q_UNUSED(filePath);
+	return QSharedPointer<QByteArray>();
+#else
+
+	// page faults are more expensive than reading small files
+	const qint64 minMapSize = 1024*1024;
+
+	QSharedPointer<QFile> file(new QFile(filePath));
+
+	if (file->size() < minMapSize || file->size() > INT_MAX)
+		return QSharedPointer<QByteArray>();
+
+#if QT_VERSION >= 0x050400
+	// mapped files on network shares crash if the connection is lost
+	QString fsType = QStorageInfo(filePath).fileSystemType();
+	if (fsType.contains(QRegExp("(nfs|cifs|smb|fuse|9p|afs|davfs)", Qt::CaseInsensitive)))
+		return QSharedPointer<QByteArray>();
+#else
+	return QSharedPointer<QByteArray>();
+#endif
+
+	if (!file->open(QIODevice::ReadOnly))
+		return QSharedPointer<QByteArray>();
+
+	uchar* data = file->map(0, file->size());
+
+	if (!data)
+		return QSharedPointer<QByteArray>();
+
+#ifdef Q_OS_UNIX
+	// we typically read the whole file - so start reading ahead (e.g. if the file is prefetched)
+	madvise(data, (size_t)file->size(), MADV_WILLNEED);
+#endif
+
+	QByteArray* ba = new QByteArray(QByteArray::fromRawData((const char*)data, (int)file->size()));
+
+	return QSharedPointer<QByteArray>(ba, [file, data](QByteArray* ba) {
+		delete ba;
+		file->unmap(data);
+	});
+#endif
+}
+
 bool DkBasicLoader::writeBufferToFile(const QString& fileInfo, const QSharedPointer<QByteArray> ba) const {
 
 	if (!ba || ba->isEmpty())
 		return false;
 
-	QFile file(fileInfo);
-	file.open(QIODevice::WriteOnly);
+	QFileInfo fInfo(fileInfo);
+
+	// existing files are written in place: replacing them would break hardlinks and
+	// lose their owner, ACLs and extended attributes. The file is not truncated before
+	// it is written, so (short-lived) mappings of it stay valid unless it shrinks.
+	if (fInfo.exists()) {
+
+		QFile file(fInfo.absoluteFilePath());
+
+		if (!file.open(QIODevice::ReadWrite))
+			return false;
+
+		qint64 bytesWritten = file.write(*ba.data(), ba->size());
+		qDebug() << "[DkBasicLoader] buffer saved, bytes written: " << bytesWritten;
+
+		if (bytesWritten != ba->size())
+			return false;
+
+		if (file.size() > ba->size())
+			return file.resize(ba->size());
+
+		return true;
+	}
+
+	// new files are written & renamed - so there is never a partially written file
+	QSaveFile file(fInfo.absoluteFilePath());
+	file.setDirectWriteFallback(true);	// read-only folders
+
+	if (!file.open(QIODevice::WriteOnly))
+		return false;
+
 	qint64 bytesWritten = file.write(*ba.data(), ba->size());
-	file.close();
 	qDebug() << "[DkBasicLoader] buffer saved, bytes written: " << bytesWritten;
 
-	if (!bytesWritten || bytesWritten == -1)
+	if (bytesWritten != ba->size()) {
+		file.cancelWriting();
 		return false;
+	}
 
-	return true;
+	return file.commit();
 }
 
 void DkBasicLoader::indexPages(const QString& filePath) {
@@ -1282,6 +2034,7 @@ void DkBasicLoader::release(bool clear) {
 	saveMetaData(mFile);
 
 	mImages.clear();
+	mTiledImage.clear();
 	//metaData.clear();
 	
 	// TODO: where should we clear the metadata?
@@ -68,6 +68,8 @@ class QNetworkReply;
 namespace nmc {
 
 class DkMetaDataT;
+class DkTiledImage;
+class DkEditData;
 
 #ifdef WITH_QUAZIP
 class DllCoreExport DkZipContainer {
@@ -95,6 +97,13 @@ protected:
 };
 #endif
 
+/**
+ * An edit state of the history.
+ * States that are not needed soon can be compressed (zlib) or
+ * spilled to a temporary file. Both (and decompressing states
+ * that are needed soon) is done in the background. Copies share
+ * the same state.
+ **/
 class DllCoreExport DkEditImage {
 
 public:
@@ -103,10 +112,17 @@ public:
 	void setImage(const QImage& img);
 	QImage image() const;
 	QString editName() const;
-	int size() const;
+	float size() const;
+
+	void setCached(bool cached);
+	void spill();
 
 protected:
-	QImage mImg;
+	static void update(QSharedPointer<DkEditData> d);
+	static QByteArray compress(const QImage& img);
+	static QImage uncompress(QSharedPointer<DkEditData> d);
+
+	QSharedPointer<DkEditData> mData;
 	QString mEditName;
 
 };
@@ -155,6 +171,33 @@ public:
 	 **/
 	bool loadGeneral(const QString& filePath, const QSharedPointer<QByteArray> ba, bool loadMetaData = false, bool fast = false);
 
+	/**
+	 * Loads a down-scaled image which covers size
+	 * @param size the size which should be covered (e.g. the viewport size)
+	 * @return bool true if the decoder supports fast down-scaling and the preview was loaded
+	 **/
+	bool loadPreview(const QString& filePath, const QSharedPointer<QByteArray> ba, const QSize& size);
+
+	/**
+	 * Loads the smallest embedded preview (e.g. of RAW files) which covers size
+	 * @param size the size which should be covered (e.g. the thumbnail or viewport size)
+	 * @param mode the aspect ratio mode (see DkMetaDataT::getBestFitPreview)
+	 * @return bool true if a preview was large enough
+	 **/
+	bool loadEmbeddedPreview(const QString& filePath, const QSharedPointer<QByteArray> ba, const QSize& size, Qt::AspectRatioMode mode = Qt::KeepAspectRatio);
+
+	/**
+	 * Sets the size the image is needed at.
+	 * If it is valid, fast RAW loading picks the smallest embedded preview that covers it.
+	 **/
+	void setTargetSize(const QSize& size);
+
+	/**
+	 * Allows loadGeneral() to decode just a preview of gigapixel images (see DkTiledImage).
+	 * Only the viewer opts in - all other callers need the full resolution.
+	 **/
+	void setTiling(bool tiling);
+
 	/**
 	 * Loads the page requested (with respect to the current page)
 	 * @param skipIdx number of pages to skip
@@ -182,6 +225,8 @@ public:
 	void saveMetaData(const QString& filePath);
 
 	static bool isContainer(const QString& filePath);
+	static int detectLoader(const QByteArray& header, const QString& suffix, QByteArray& format);
+	static QString loaderName(int loaderId);
 
 	/**
 	 * Sets a new image (if edited outside the basicLoader class)
@@ -190,6 +235,7 @@ public:
 	 **/
 	void setImage(const QImage& img, const QString& editName, const QString& file);
 	void setEditImage(const QImage& img, const QString& editName = "");
+	void setFullImage(const QImage& img);
 
 	void setTraining(bool training) {
 		training = true;
@@ -207,6 +253,8 @@ public:
 		return mMetaData;
 	};
 
+	QSharedPointer<DkTiledImage> tiledImage() const;
+
 	/**
 	 * Returns the 8-bit image, which is rendered.
 	 * @return QImage an 8bit image
@@ -240,14 +288,17 @@ public:
 	void undo();
 	void redo();
 	QVector<DkEditImage>* history();
+	float historyMemory() const;
+	float releaseHistory(float mem);
+	void updateHistoryCache();
 	DkEditImage lastEdit() const;
 
-	void setMinHistorySize(int size);
 	void setHistoryIndex(int idx);
 	int historyIndex() const;
 
 	void loadFileToBuffer(const QString& filePath, QByteArray& ba) const;
 	QSharedPointer<QByteArray> loadFileToBuffer(const QString& filePath) const;
+	static QSharedPointer<QByteArray> mapFileToBuffer(const QString& filePath);
 	bool writeBufferToFile(const QString& fileInfo, const QSharedPointer<QByteArray> ba) const;
 
 	void release(bool clear = false);
@@ -287,10 +338,14 @@ public slots:
 protected:
 	bool loadRohFile(const QString& filePath, QImage& img, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>()) const;
 	bool loadRawFile(const QString& filePath, QImage& img, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>(), bool fast = false) const;
+	bool loadTiledFile(const QString& filePath, QImage& img, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>());
 	void indexPages(const QString& filePath);
 	void convert32BitOrder(void *buffer, int width);
 
 	int mLoader;
+	int mDetectedLoader = no_loader;	// cached result of detectLoader()
+	QByteArray mDetectedFormat;
+	QString mDetectedFile;
 	bool mTraining;
 	int mMode;
 	
@@ -300,8 +355,10 @@ protected:
 	bool mPageIdxDirty;
 	QSharedPointer<DkMetaDataT> mMetaData;
 	QVector<DkEditImage> mImages;
-	int mMinHistorySize = 2;
 	int mImageIndex = 0;
+	QSharedPointer<DkTiledImage> mTiledImage;
+	QSize mTargetSize;
+	bool mTiling = false;
 };
 
 // file downloader from: http://qt-project.org/wiki/Download_Data_from_URL
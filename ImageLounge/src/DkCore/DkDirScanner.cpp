@@ -0,0 +1,184 @@
+/*******************************************************************************************************
+ DkDirScanner.cpp
+ Created on:	18.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#include "DkDirScanner.h"
+
+#pragma warning(push, 0)	// no warnings from includes - begin
+#include <QDir>
+#include <QFile>
+#include <QRegExp>
+#include <QDebug>
+#pragma warning(pop)		// no warnings from includes - end
+
+#include <cstring>
+
+#ifdef Q_OS_LINUX
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+namespace nmc {
+
+// DkDirScanner --------------------------------------------------------------------
+/**
+ * Creates a scanner.
+ * Filters of the form *.ext are matched by a hash look-up,
+ * all other wildcards are matched with QDir::match.
+ * @param nameFilters the wildcard filters (e.g. the browse filters).
+ **/
+DkDirScanner::DkDirScanner(const QStringList& nameFilters) : mNameFilters(nameFilters) {
+
+	for (const QString& filter : nameFilters) {
+
+		QString suffix = filter.mid(2);
+
+		if (filter.startsWith("*.") && !suffix.isEmpty() && suffix.length() <= max_suffix_length &&
+			!suffix.contains(QRegExp("[*?\\[\\.]")))
+			mSuffixes.insert(suffix.toLower().toUtf8());
+		else
+			mPatterns << filter;
+	}
+}
+
+/**
+ * Lists the files of a folder.
+ * Hidden files are skipped.
+ * @param dirPath the folder.
+ * @param batchReady if set, it is called with every batch_size new files (and the remaining files).
+ * Listing is stopped if it returns false.
+ * @return QStringList the (unsorted) names of all accepted files.
+ **/
+QStringList DkDirScanner::scan(const QString& dirPath, std::function<bool(const QStringList&)> batchReady) const {
+
+	QStringList fileNames;
+	int batchStart = 0;
+
+#ifdef Q_OS_LINUX
+
+	DIR* dir = opendir(QFile::encodeName(dirPath).constData());
+
+	if (!dir) {
+		qWarning() << "[DkDirScanner] cannot open" << dirPath;
+		return fileNames;
+	}
+
+	// readdir reads many entries per getdents64 call
+	for (struct dirent* entry = readdir(dir); entry; entry = readdir(dir)) {
+
+		const char* name = entry->d_name;
+
+		if (name[0] == '.')
+			continue;	// hidden files, . and ..
+
+		// links & file systems without d_type need a stat
+		if (entry->d_type != DT_REG) {
+
+			if (entry->d_type != DT_LNK && entry->d_type != DT_UNKNOWN)
+				continue;
+
+			struct stat st;
+			if (fstatat(dirfd(dir), name, &st, 0) != 0 || !S_ISREG(st.st_mode))
+				continue;
+		}
+
+		int length = (int)strlen(name);
+
+		if (acceptsSuffix(name, length))
+			fileNames << QFile::decodeName(QByteArray::fromRawData(name, length));
+		else if (!mPatterns.empty()) {
+			QString fileName = QFile::decodeName(QByteArray::fromRawData(name, length));
+			if (QDir::match(mPatterns, fileName))
+				fileNames << fileName;
+		}
+		else
+			continue;
+
+		if (batchReady && fileNames.size() - batchStart >= batch_size) {
+
+			bool proceed = batchReady(fileNames.mid(batchStart));
+			batchStart = fileNames.size();
+
+			if (!proceed)
+				break;
+		}
+	}
+
+	closedir(dir);
+
+#else
+
+	QDir dir(dirPath);
+	fileNames = dir.entryList(mNameFilters, QDir::Files | QDir::NoDotAndDotDot, QDir::Unsorted);
+
+	for (; batchReady && fileNames.size() - batchStart >= batch_size; batchStart += batch_size) {
+		if (!batchReady(fileNames.mid(batchStart, batch_size))) {
+			batchStart = fileNames.size();
+			break;
+		}
+	}
+#endif
+
+	if (batchReady && batchStart < fileNames.size())
+		batchReady(fileNames.mid(batchStart));
+
+	return fileNames;
+}
+
+/**
+ * Returns true if a file name matches the filters.
+ **/
+bool DkDirScanner::accepts(const QString& fileName) const {
+
+	QByteArray name = QFile::encodeName(fileName);
+
+	return acceptsSuffix(name.constData(), name.size()) || QDir::match(mPatterns, fileName);
+}
+
+bool DkDirScanner::acceptsSuffix(const char* fileName, int length) const {
+
+	const char* dot = strrchr(fileName, '.');
+
+	if (!dot || dot == fileName)
+		return false;
+
+	int suffixLength = length - (int)(dot - fileName) - 1;
+
+	if (suffixLength <= 0 || suffixLength > max_suffix_length)
+		return false;
+
+	// lower case (ASCII) in a stack buffer - no allocation per file
+	char suffix[max_suffix_length];
+	for (int idx = 0; idx < suffixLength; idx++) {
+		char c = dot[idx + 1];
+		suffix[idx] = (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+	}
+
+	return mSuffixes.contains(QByteArray::fromRawData(suffix, suffixLength));
+}
+
+}
@@ -0,0 +1,81 @@
+/*******************************************************************************************************
+ DkDirScanner.h
+ Created on:	18.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#pragma once
+
+#pragma warning(push, 0)	// no warnings from includes - begin
+#include <QString>
+#include <QStringList>
+#include <QSet>
+#include <QByteArray>
+#pragma warning(pop)		// no warnings from includes - end
+
+#include <functional>
+
+#pragma warning(disable: 4251)	// TODO: remove
+
+#ifndef DllCoreExport
+#ifdef DK_CORE_DLL_EXPORT
+#define DllCoreExport Q_DECL_EXPORT
+#elif DK_DLL_IMPORT
+#define DllCoreExport Q_DECL_IMPORT
+#else
+#define DllCoreExport Q_DECL_IMPORT
+#endif
+#endif
+
+namespace nmc {
+
+/**
+ * Lists the files of a folder that match the browse filters.
+ * On Linux, the folder is read with readdir: d_type skips folders etc.
+ * without a stat call and suffixes are matched against a hashed set of
+ * extensions. The names are not sorted since the folder index sorts them
+ * anyway. Other platforms use an unsorted QDir::entryList.
+ **/
+class DllCoreExport DkDirScanner {
+
+public:
+	enum {
+		batch_size = 1024,	// files per batch
+		max_suffix_length = 15,
+	};
+
+	DkDirScanner(const QStringList& nameFilters);
+
+	QStringList scan(const QString& dirPath, std::function<bool(const QStringList&)> batchReady = std::function<bool(const QStringList&)>()) const;
+	bool accepts(const QString& fileName) const;
+
+protected:
+	bool acceptsSuffix(const char* fileName, int length) const;
+
+	QStringList mNameFilters;
+	QSet<QByteArray> mSuffixes;		// lower case suffixes of *.ext filters
+	QStringList mPatterns;			// all other filters
+};
+
+}
@@ -0,0 +1,231 @@
+/*******************************************************************************************************
+ DkDirWatcher.cpp
+ Created on:	18.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#include "DkDirWatcher.h"
+
+#pragma warning(push, 0)	// no warnings from includes - begin
+#include <QFileSystemWatcher>
+#include <QSocketNotifier>
+#include <QFile>
+#include <QDebug>
+#pragma warning(pop)		// no warnings from includes - end
+
+#ifdef Q_OS_LINUX
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace nmc {
+
+// DkDirWatcher --------------------------------------------------------------------
+DkDirWatcher::DkDirWatcher(QObject* parent) : QObject(parent) {
+
+#ifdef Q_OS_LINUX
+	mNotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+	if (mNotifyFd != -1) {
+		mNotifier = new QSocketNotifier(mNotifyFd, QSocketNotifier::Read, this);
+		connect(mNotifier, SIGNAL(activated(int)), this, SLOT(readEvents()));
+	}
+	else
+		qWarning() << "[DkDirWatcher] inotify is not available - folders are reloaded if they change";
+#endif
+
+	if (mNotifyFd == -1) {
+		mFallbackWatcher = new QFileSystemWatcher(this);
+		connect(mFallbackWatcher, SIGNAL(directoryChanged(const QString&)), this, SIGNAL(directoryChanged(const QString&)));
+	}
+
+	mBatchTimer.setSingleShot(true);
+	mBatchTimer.setInterval(mBatchInterval);
+	connect(&mBatchTimer, SIGNAL(timeout()), this, SLOT(emitChanges()));
+}
+
+DkDirWatcher::~DkDirWatcher() {
+
+#ifdef Q_OS_LINUX
+	if (mNotifyFd != -1)
+		close(mNotifyFd);
+#endif
+}
+
+/**
+ * Watches a new folder.
+ * Changes of the previous folder that were not emitted yet are dropped.
+ * @param dirPath the folder - an empty path stops watching.
+ **/
+void DkDirWatcher::setDirPath(const QString& dirPath) {
+
+	if (dirPath == mDirPath && (mWatchDescriptor != -1 || mFallbackWatcher))
+		return;
+
+	clearChanges();
+	mDirPath = dirPath;
+
+	if (mFallbackWatcher) {
+		if (!mFallbackWatcher->directories().isEmpty())
+			mFallbackWatcher->removePaths(mFallbackWatcher->directories());
+		if (!dirPath.isEmpty())
+			mFallbackWatcher->addPath(dirPath);
+		return;
+	}
+
+#ifdef Q_OS_LINUX
+	if (mWatchDescriptor != -1) {
+		inotify_rm_watch(mNotifyFd, mWatchDescriptor);
+		mWatchDescriptor = -1;
+	}
+
+	if (dirPath.isEmpty())
+		return;
+
+	// IN_CLOSE_WRITE rather than IN_CREATE: we are not interested in files that are still being written
+	uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+	mWatchDescriptor = inotify_add_watch(mNotifyFd, QFile::encodeName(dirPath).constData(), mask);
+
+	if (mWatchDescriptor == -1)
+		qWarning() << "[DkDirWatcher] cannot watch" << dirPath;
+#endif
+}
+
+QString DkDirWatcher::dirPath() const {
+	return mDirPath;
+}
+
+/**
+ * Returns true if changes are reported per file.
+ **/
+bool DkDirWatcher::isIncremental() const {
+	return mWatchDescriptor != -1;
+}
+
+void DkDirWatcher::readEvents() {
+
+#ifdef Q_OS_LINUX
+
+	// inotify_event is variable sized - the buffer must be aligned for its fixed part
+	alignas(struct inotify_event) char buffer[16384];
+	bool reload = false;
+	bool watchLost = false;
+
+	for (;;) {
+
+		ssize_t len = read(mNotifyFd, buffer, sizeof(buffer));
+
+		if (len <= 0)
+			break;	// EAGAIN: all events are read
+
+		for (char* ptr = buffer; ptr < buffer + len; ) {
+
+			const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(ptr);
+			ptr += sizeof(struct inotify_event) + event->len;
+
+			if (event->mask & IN_Q_OVERFLOW) {
+				reload = true;
+				continue;
+			}
+
+			// events of a folder that is not watched anymore
+			if (event->wd != mWatchDescriptor)
+				continue;
+
+			if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+				reload = true;
+				watchLost = true;
+				continue;
+			}
+
+			if (event->len == 0 || (event->mask & IN_ISDIR))
+				continue;
+
+			QString fileName = QFile::decodeName(event->name);
+
+			if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+				fileAdded(fileName);
+			else if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+				fileRemoved(fileName);
+		}
+	}
+
+	if (reload) {
+		qInfo() << "[DkDirWatcher] per-file events lost - reloading" << mDirPath;
+		clearChanges();
+
+		// the descriptor is stale (or already ignored by the kernel) if the folder was
+		// renamed or deleted - a folder that (again) exists at the path is watched anew
+		if (watchLost && mWatchDescriptor != -1) {
+			inotify_rm_watch(mNotifyFd, mWatchDescriptor);
+			mWatchDescriptor = -1;
+
+			if (QFile::exists(mDirPath))
+				setDirPath(mDirPath);
+		}
+
+		emit directoryChanged(mDirPath);
+	}
+	else if ((!mAdded.isEmpty() || !mRemoved.isEmpty()) && !mBatchTimer.isActive())
+		mBatchTimer.start();	// not restarted - a constant stream of files is still emitted
+#endif
+}
+
+void DkDirWatcher::emitChanges() {
+
+	QStringList added = mAdded.toList();
+	QStringList removed = mRemoved.toList();
+	clearChanges();
+
+	if (!added.isEmpty() || !removed.isEmpty())
+		emit filesChanged(added, removed);
+}
+
+/**
+ * A file was written or moved into the folder.
+ * Files that are added again (e.g. overwritten) are reported as added only.
+ **/
+void DkDirWatcher::fileAdded(const QString& fileName) {
+
+	mAdded.insert(fileName);
+}
+
+/**
+ * A file was deleted or moved out of the folder.
+ * Renames are reported as removed and added files.
+ **/
+void DkDirWatcher::fileRemoved(const QString& fileName) {
+
+	mAdded.remove(fileName);
+	mRemoved.insert(fileName);
+}
+
+void DkDirWatcher::clearChanges() {
+
+	mBatchTimer.stop();
+	mAdded.clear();
+	mRemoved.clear();
+}
+
+}
@@ -0,0 +1,104 @@
+/*******************************************************************************************************
+ DkDirWatcher.h
+ Created on:	18.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#pragma once
+
+#pragma warning(push, 0)	// no warnings from includes - begin
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QSet>
+#include <QTimer>
+#pragma warning(pop)		// no warnings from includes - end
+
+#pragma warning(disable: 4251)	// TODO: remove
+
+#ifndef DllCoreExport
+#ifdef DK_CORE_DLL_EXPORT
+#define DllCoreExport Q_DECL_EXPORT
+#elif DK_DLL_IMPORT
+#define DllCoreExport Q_DECL_IMPORT
+#else
+#define DllCoreExport Q_DECL_IMPORT
+#endif
+#endif
+
+// Qt defines
+class QFileSystemWatcher;
+class QSocketNotifier;
+
+namespace nmc {
+
+/**
+ * Watches the current folder for changes.
+ * On Linux, inotify reports which files were added or removed. These events
+ * are collected for a short time and then emitted as one filesChanged() batch
+ * so that the folder index can be updated without listing the folder again.
+ * If per-file events are not available (other platforms, the event queue
+ * overflowed or the folder itself was moved), directoryChanged() is emitted
+ * and the folder needs to be reloaded.
+ **/
+class DllCoreExport DkDirWatcher : public QObject {
+	Q_OBJECT
+
+public:
+	DkDirWatcher(QObject* parent = 0);
+	virtual ~DkDirWatcher();
+
+	void setDirPath(const QString& dirPath);
+	QString dirPath() const;
+	bool isIncremental() const;
+
+signals:
+	void directoryChanged(const QString& dirPath) const;
+	void filesChanged(const QStringList& added, const QStringList& removed) const;
+
+protected slots:
+	void readEvents();
+	void emitChanges();
+
+protected:
+	void fileAdded(const QString& fileName);
+	void fileRemoved(const QString& fileName);
+	void clearChanges();
+
+	QString mDirPath;
+	QFileSystemWatcher* mFallbackWatcher = 0;
+
+	// inotify
+	int mNotifyFd = -1;
+	int mWatchDescriptor = -1;
+	QSocketNotifier* mNotifier = 0;
+
+	// file names (relative to mDirPath) that changed since the last batch
+	QSet<QString> mAdded;
+	QSet<QString> mRemoved;
+	QTimer mBatchTimer;
+	int mBatchInterval = 100;	// ms
+};
+
+}
@@ -0,0 +1,782 @@
+/*******************************************************************************************************
+ DkFolderIndex.cpp
+ Created on:	18.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#include "DkFolderIndex.h"
+#include "DkImageContainer.h"
+#include "DkSettings.h"
+#include "DkUtils.h"
+
+#pragma warning(push, 0)	// no warnings from includes - begin
+#include <QDir>
+#include <QDebug>
+#include <QFile>
+#include <QThread>
+#include <QtConcurrentMap>
+#include <QSet>
+#include <qmath.h>
+#pragma warning(pop)		// no warnings from includes - end
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+namespace nmc {
+
+template <typename T>
+static void moveItem(QVector<T>& vec, int from, int to) {
+
+	typename QVector<T>::iterator first = vec.begin();
+
+	if (from > to)
+		std::rotate(first + to, first + from, first + from + 1);
+	else
+		std::rotate(first + from, first + from + 1, first + to + 1);
+}
+
+// DkFolderIndex --------------------------------------------------------------------
+DkFolderIndex::DkFolderIndex(const QFileInfoList& files) {
+
+	mFilePaths.reserve(files.size());
+	mFileNames.reserve(files.size());
+
+	for (const QFileInfo& fi : files) {
+		mFilePaths << fi.absoluteFilePath();
+		mFileNames << fi.fileName();
+	}
+
+	mContainers.resize(mFilePaths.size());
+	statFiles(files);
+	computeSortKeys();
+	updateLookup();
+}
+
+int DkFolderIndex::size() const {
+	return mFilePaths.size();
+}
+
+bool DkFolderIndex::empty() const {
+	return mFilePaths.empty();
+}
+
+QString DkFolderIndex::filePath(int idx) const {
+	return mFilePaths.at(idx);
+}
+
+QString DkFolderIndex::fileName(int idx) const {
+	return mFileNames.at(idx);
+}
+
+qint64 DkFolderIndex::fileSize(int idx) const {
+	return mFileSizes.at(idx);
+}
+
+QDateTime DkFolderIndex::lastModified(int idx) const {
+	return mModified.at(idx) ? QDateTime::fromMSecsSinceEpoch(mModified.at(idx)) : QDateTime();
+}
+
+QDateTime DkFolderIndex::created(int idx) const {
+	return mCreated.at(idx) ? QDateTime::fromMSecsSinceEpoch(mCreated.at(idx)) : QDateTime();
+}
+
+/**
+ * Returns the other representations of an entry.
+ * If duplicates are filtered, only the preferred file of e.g. a RAW+JPG
+ * pair is indexed. The remaining files of the pair are its alternates.
+ * @param idx the index of the entry.
+ * @return QStringList the absolute file paths of the alternates.
+ **/
+QStringList DkFolderIndex::alternates(int idx) const {
+
+	if (mAlternates.isEmpty())
+		return QStringList();
+
+	return mAlternates.value(mFilePaths.at(idx));
+}
+
+/**
+ * Sets the alternates of the indexed files.
+ * Alternates of files that are not indexed are dropped.
+ * @param alternates maps the absolute file path to its alternates.
+ **/
+void DkFolderIndex::setAlternates(const QHash<QString, QStringList>& alternates) {
+
+	mAlternates.clear();
+
+	for (auto it = alternates.constBegin(); it != alternates.constEnd(); ++it) {
+		if (mLookup.contains(it.key()))
+			mAlternates.insert(it.key(), it.value());
+	}
+}
+
+/**
+ * Returns the index of a file.
+ * @param filePath the absolute file path.
+ * @return int the index or -1 if the file is not indexed.
+ **/
+int DkFolderIndex::indexOf(const QString& filePath) const {
+
+	// in converting the string from a fileInfo - we guarantee that the separators are the same (/ vs \)
+	QString lFilePath = filePath;
+	lFilePath.replace("\\", QDir::separator());
+
+	return mLookup.value(lFilePath, -1);
+}
+
+int DkFolderIndex::indexOf(QSharedPointer<DkImageContainerT> imgC) const {
+
+	if (!imgC)
+		return -1;
+
+	return indexOf(imgC->filePath());
+}
+
+/**
+ * Returns the index of the first entry that is sorted after file.
+ * This is used to locate files that are not indexed anymore (e.g. deleted).
+ * The entries are compared like sort() does, using the file's (cached) attributes.
+ * @param file the file.
+ * @return int the index of the first entry after file or size().
+ **/
+int DkFolderIndex::upperBound(const QFileInfo& file) const {
+
+	int sortMode = DkSettingsManager::param().global().sortMode;
+	bool ascending = DkSettingsManager::param().global().sortDir == DkSettings::sort_ascending;
+
+	if (sortMode == DkSettings::sort_random)
+		return size();
+
+	// an index with the file only - so we can use the comparator of sort()
+	QDateTime m = file.lastModified();
+	QDateTime c = file.created();
+
+	DkFolderIndex key;
+	key.mSortKeys << DkUtils::naturalSortKey(file.fileName());
+	key.mFileSizes << file.size();
+	key.mModified << (m.isValid() ? m.toMSecsSinceEpoch() : 0);
+	key.mCreated << (c.isValid() ? c.toMSecsSinceEpoch() : 0);
+
+	// the entries are identified by their position in mSortKeys
+	auto isAfter = [&](int, const QByteArray& entry) {
+		int idx = int(&entry - mSortKeys.constData());
+		return ascending ? lessThan(key, 0, *this, idx, sortMode) : lessThan(*this, idx, key, 0, sortMode);
+	};
+
+	return int(std::upper_bound(mSortKeys.constBegin(), mSortKeys.constEnd(), 0, isAfter) - mSortKeys.constBegin());
+}
+
+/**
+ * Returns the image container of entry idx.
+ * The container is created if it does not exist yet.
+ * @param idx the index of the entry.
+ * @return QSharedPointer<DkImageContainerT> the container of the entry.
+ **/
+QSharedPointer<DkImageContainerT> DkFolderIndex::at(int idx) const {
+
+	if (idx < 0 || idx >= mContainers.size())
+		return QSharedPointer<DkImageContainerT>();
+
+	if (!mContainers.at(idx)) {
+		mContainers[idx] = QSharedPointer<DkImageContainerT>(new DkImageContainerT(mFilePaths.at(idx)));
+		mMaterialized << mContainers.at(idx);
+	}
+
+	return mContainers.at(idx);
+}
+
+/**
+ * Returns the image container of entry idx if it was materialized before.
+ * @param idx the index of the entry.
+ * @return QSharedPointer<DkImageContainerT> the container or a null pointer.
+ **/
+QSharedPointer<DkImageContainerT> DkFolderIndex::materialized(int idx) const {
+
+	if (idx < 0 || idx >= mContainers.size())
+		return QSharedPointer<DkImageContainerT>();
+
+	return mContainers.at(idx);
+}
+
+/**
+ * Returns all containers that are materialized.
+ * The containers are not in folder order - but this does not
+ * need to walk all entries of large folders.
+ **/
+QVector<QSharedPointer<DkImageContainerT> > DkFolderIndex::materialized() const {
+	return mMaterialized;
+}
+
+int DkFolderIndex::numMaterialized() const {
+	return mMaterialized.size();
+}
+
+/**
+ * Takes over the containers of another index.
+ * Containers are only kept if the file was not modified in the meantime.
+ * @param other the old index of the same folder.
+ **/
+void DkFolderIndex::adopt(const DkFolderIndex& other) {
+
+	for (int oIdx = 0; oIdx < other.mContainers.size(); oIdx++) {
+
+		const QSharedPointer<DkImageContainerT>& imgC = other.mContainers.at(oIdx);
+
+		if (!imgC)
+			continue;
+
+		int idx = mLookup.value(other.mFilePaths.at(oIdx), -1);
+
+		if (idx != -1 && !mContainers.at(idx) && mModified.at(idx) == other.mModified.at(oIdx)) {
+			mContainers[idx] = imgC;
+			mMaterialized << imgC;
+		}
+	}
+}
+
+/**
+ * Takes over a container that was created outside of the index.
+ * This way the current image is not created twice if its folder is indexed.
+ * @param imgC the container - it is ignored if the file is not indexed.
+ **/
+void DkFolderIndex::adopt(QSharedPointer<DkImageContainerT> imgC) {
+
+	int idx = indexOf(imgC);
+
+	if (idx != -1 && !mContainers.at(idx)) {
+		mContainers[idx] = imgC;
+		mMaterialized << imgC;
+	}
+}
+
+/**
+ * Sorts the index according to the sort settings.
+ **/
+void DkFolderIndex::sort() {
+
+	permute(sortOrder());
+}
+
+/**
+ * Computes the order of the entries according to the sort settings.
+ * This function does not change the index and can be called from a thread.
+ * The entries are compared using the precomputed sort keys and attributes.
+ * @return QVector<int> the old indexes in sorted order.
+ **/
+QVector<int> DkFolderIndex::sortOrder() const {
+
+	QVector<int> order(size());
+	for (int idx = 0; idx < order.size(); idx++)
+		order[idx] = idx;
+
+	// read the settings once - not for every comparison
+	int sortMode = DkSettingsManager::param().global().sortMode;
+	bool ascending = DkSettingsManager::param().global().sortDir == DkSettings::sort_ascending;
+
+	if (sortMode == DkSettings::sort_random) {
+
+		for (int idx = order.size()-1; idx > 0; idx--)
+			qSwap(order[idx], order[qrand() % (idx+1)]);
+
+		return order;
+	}
+
+	auto lessThan = [this, sortMode, ascending](int lIdx, int rIdx) {
+		return ascending ? this->lessThan(lIdx, rIdx, sortMode) : this->lessThan(rIdx, lIdx, sortMode);
+	};
+
+	int numBlocks = qMin(QThread::idealThreadCount(), order.size() / (int)parallel_block_size);
+
+	if (numBlocks <= 1) {
+		qSort(order.begin(), order.end(), lessThan);
+		return order;
+	}
+
+	// parallel merge sort: sort blocks in threads & merge neighboring blocks
+	int* data = order.data();	// detach before the threads start
+	int numEntries = order.size();
+	int blockSize = qCeil(numEntries / (double)numBlocks);
+
+	QVector<int> blocks;
+	for (int idx = 0; idx < numEntries; idx += blockSize)
+		blocks << idx;
+
+	QtConcurrent::blockingMap(blocks, [&](int start) {
+		qSort(data + start, data + qMin(start + blockSize, numEntries), lessThan);
+	});
+
+	for (int width = blockSize; width < numEntries; width *= 2) {
+
+		QVector<int> merges;
+		for (int idx = 0; idx + width < numEntries; idx += 2*width)
+			merges << idx;
+
+		QtConcurrent::blockingMap(merges, [&](int start) {
+			std::inplace_merge(data + start, data + start + width, data + qMin(start + 2*width, numEntries), lessThan);
+		});
+	}
+
+	return order;
+}
+
+/**
+ * Reorders all entries.
+ * @param order the old indexes in their new order (see sortOrder).
+ **/
+void DkFolderIndex::permute(const QVector<int>& order) {
+
+	if (order.size() != size()) {
+		qWarning() << "[DkFolderIndex] cannot reorder" << size() << "entries with" << order.size() << "indexes";
+		return;
+	}
+
+	QStringList filePaths;
+	QStringList fileNames;
+	QVector<QByteArray> sortKeys(order.size());
+	QVector<qint64> fileSizes(order.size());
+	QVector<qint64> modified(order.size());
+	QVector<qint64> created(order.size());
+	QVector<QSharedPointer<DkImageContainerT> > containers(order.size());
+
+	filePaths.reserve(order.size());
+	fileNames.reserve(order.size());
+
+	for (int idx = 0; idx < order.size(); idx++) {
+
+		int oIdx = order.at(idx);
+
+		filePaths << mFilePaths.at(oIdx);
+		fileNames << mFileNames.at(oIdx);
+		sortKeys[idx] = mSortKeys.at(oIdx);
+		fileSizes[idx] = mFileSizes.at(oIdx);
+		modified[idx] = mModified.at(oIdx);
+		created[idx] = mCreated.at(oIdx);
+		containers[idx] = mContainers.at(oIdx);
+	}
+
+	mFilePaths = filePaths;
+	mFileNames = fileNames;
+	mSortKeys = sortKeys;
+	mFileSizes = fileSizes;
+	mModified = modified;
+	mCreated = created;
+	mContainers = containers;
+
+	updateLookup();
+}
+
+/**
+ * Adds files to the sorted index.
+ * Each file is stat'ed and placed by a binary search, so the index stays sorted
+ * and the containers of the other entries are kept. Files that are indexed
+ * already (e.g. overwritten) are replaced since their attributes changed.
+ * @param files the new files.
+ * @return int the number of inserted entries.
+ **/
+int DkFolderIndex::insert(const QFileInfoList& files) {
+
+	if (files.empty())
+		return 0;
+
+	QStringList replaced;
+	for (const QFileInfo& fi : files) {
+		if (mLookup.contains(fi.absoluteFilePath()))
+			replaced << fi.absoluteFilePath();
+	}
+	remove(replaced);
+
+	// read the settings once - not for every comparison
+	int sortMode = DkSettingsManager::param().global().sortMode;
+	bool ascending = DkSettingsManager::param().global().sortDir == DkSettings::sort_ascending;
+
+	for (const QFileInfo& fi : files) {
+
+		qint64 fileSize = 0, modified = 0, created = 0;
+		statFile(fi, fileSize, modified, created);
+
+		// append the entry & move it to its sorted position
+		mFilePaths << fi.absoluteFilePath();
+		mFileNames << fi.fileName();
+		mSortKeys << DkUtils::naturalSortKey(fi.fileName());
+		mFileSizes << fileSize;
+		mModified << modified;
+		mCreated << created;
+		mContainers << QSharedPointer<DkImageContainerT>();
+
+		int nIdx = size()-1;
+		int pos = nIdx;
+
+		if (sortMode == DkSettings::sort_random)
+			pos = qrand() % (nIdx+1);
+		else {
+			// upper bound - the new entry goes behind equal entries
+			int lo = 0;
+			int hi = nIdx;
+
+			while (lo < hi) {
+				int mid = (lo + hi) / 2;
+				bool before = ascending ? lessThan(nIdx, mid, sortMode) : lessThan(mid, nIdx, sortMode);
+
+				if (before)
+					hi = mid;
+				else
+					lo = mid + 1;
+			}
+			pos = lo;
+		}
+
+		moveEntry(nIdx, pos);
+	}
+
+	updateLookup();
+
+	return files.size();
+}
+
+/**
+ * Removes files from the index.
+ * The order of the remaining entries and their containers are kept.
+ * @param filePaths the absolute file paths - files that are not indexed are ignored.
+ * @return int the number of removed entries.
+ **/
+int DkFolderIndex::remove(const QStringList& filePaths) {
+
+	QVector<bool> removed(size(), false);
+	int numRemoved = 0;
+
+	for (const QString& filePath : filePaths) {
+
+		int idx = indexOf(filePath);
+
+		if (idx != -1 && !removed[idx]) {
+			removed[idx] = true;
+			numRemoved++;
+		}
+	}
+
+	if (!numRemoved)
+		return 0;
+
+	// compact all attributes in one pass
+	int wIdx = 0;
+	QSet<DkImageContainerT*> removedContainers;
+
+	for (int idx = 0; idx < size(); idx++) {
+
+		if (removed[idx]) {
+			if (mContainers.at(idx))
+				removedContainers.insert(mContainers.at(idx).data());
+			mAlternates.remove(mFilePaths.at(idx));
+			continue;
+		}
+
+		if (wIdx != idx) {
+			mFilePaths[wIdx] = mFilePaths.at(idx);
+			mFileNames[wIdx] = mFileNames.at(idx);
+			mSortKeys[wIdx] = mSortKeys.at(idx);
+			mFileSizes[wIdx] = mFileSizes.at(idx);
+			mModified[wIdx] = mModified.at(idx);
+			mCreated[wIdx] = mCreated.at(idx);
+			mContainers[wIdx] = mContainers.at(idx);
+		}
+		wIdx++;
+	}
+
+	mFilePaths.erase(mFilePaths.begin() + wIdx, mFilePaths.end());
+	mFileNames.erase(mFileNames.begin() + wIdx, mFileNames.end());
+	mSortKeys.resize(wIdx);
+	mFileSizes.resize(wIdx);
+	mModified.resize(wIdx);
+	mCreated.resize(wIdx);
+	mContainers.resize(wIdx);
+
+	if (!removedContainers.isEmpty()) {
+		mMaterialized.erase(std::remove_if(mMaterialized.begin(), mMaterialized.end(),
+			[&](const QSharedPointer<DkImageContainerT>& imgC) { return removedContainers.contains(imgC.data()); }),
+			mMaterialized.end());
+	}
+
+	updateLookup();
+
+	return numRemoved;
+}
+
+/**
+ * Merges another sorted index into this sorted index.
+ * Both indexes must be sorted with the current settings - then
+ * the merge is linear. Files that are indexed already are skipped.
+ * @param other the index to be merged (e.g. the next batch of a folder that is listed).
+ * @return int the number of entries added.
+ **/
+int DkFolderIndex::merge(const DkFolderIndex& other) {
+
+	// read the settings once - not for every comparison
+	int sortMode = DkSettingsManager::param().global().sortMode;
+	bool ascending = DkSettingsManager::param().global().sortDir == DkSettings::sort_ascending;
+
+	DkFolderIndex merged;
+	int numEntries = size() + other.size();
+
+	merged.mFilePaths.reserve(numEntries);
+	merged.mFileNames.reserve(numEntries);
+	merged.mSortKeys.reserve(numEntries);
+	merged.mFileSizes.reserve(numEntries);
+	merged.mModified.reserve(numEntries);
+	merged.mCreated.reserve(numEntries);
+	merged.mContainers.reserve(numEntries);
+
+	int idx = 0;
+	int oIdx = 0;
+
+	while (idx < size() || oIdx < other.size()) {
+
+		if (oIdx < other.size() && mLookup.contains(other.mFilePaths.at(oIdx))) {
+			oIdx++;
+			continue;
+		}
+
+		bool takeOther;
+
+		if (idx == size())
+			takeOther = true;
+		else if (oIdx == other.size())
+			takeOther = false;
+		else if (sortMode == DkSettings::sort_random)
+			takeOther = qrand() % 2 == 0;
+		else
+			takeOther = ascending ? lessThan(other, oIdx, *this, idx, sortMode) : lessThan(*this, idx, other, oIdx, sortMode);
+
+		if (takeOther)
+			merged.append(other, oIdx++);
+		else
+			merged.append(*this, idx++);
+	}
+
+	int numAdded = merged.size() - size();
+
+	mFilePaths = merged.mFilePaths;
+	mFileNames = merged.mFileNames;
+	mSortKeys = merged.mSortKeys;
+	mFileSizes = merged.mFileSizes;
+	mModified = merged.mModified;
+	mCreated = merged.mCreated;
+	mContainers = merged.mContainers;
+	mMaterialized = merged.mMaterialized;
+
+	for (auto it = other.mAlternates.constBegin(); it != other.mAlternates.constEnd(); ++it)
+		mAlternates.insert(it.key(), it.value());
+
+	updateLookup();
+
+	return numAdded;
+}
+
+/**
+ * Appends entry oIdx of another index (the lookup is not updated).
+ **/
+void DkFolderIndex::append(const DkFolderIndex& other, int oIdx) {
+
+	mFilePaths << other.mFilePaths.at(oIdx);
+	mFileNames << other.mFileNames.at(oIdx);
+	mSortKeys << other.mSortKeys.at(oIdx);
+	mFileSizes << other.mFileSizes.at(oIdx);
+	mModified << other.mModified.at(oIdx);
+	mCreated << other.mCreated.at(oIdx);
+	mContainers << other.mContainers.at(oIdx);
+
+	if (other.mContainers.at(oIdx))
+		mMaterialized << other.mContainers.at(oIdx);
+}
+
+bool DkFolderIndex::lessThan(int lIdx, int rIdx, int sortMode) const {
+
+	return lessThan(*this, lIdx, *this, rIdx, sortMode);
+}
+
+bool DkFolderIndex::lessThan(const DkFolderIndex& l, int lIdx, const DkFolderIndex& r, int rIdx, int sortMode) {
+
+	switch (sortMode) {
+
+	case DkSettings::sort_date_created:
+		if (l.mCreated.at(lIdx) != r.mCreated.at(rIdx))
+			return l.mCreated.at(lIdx) < r.mCreated.at(rIdx);
+		break;
+
+	case DkSettings::sort_date_modified:
+		if (l.mModified.at(lIdx) != r.mModified.at(rIdx))
+			return l.mModified.at(lIdx) < r.mModified.at(rIdx);
+		break;
+
+	case DkSettings::sort_file_size:
+		if (l.mFileSizes.at(lIdx) != r.mFileSizes.at(rIdx))
+			return l.mFileSizes.at(lIdx) < r.mFileSizes.at(rIdx);
+		break;
+	}
+
+	// filename - or files with the same date/size
+	return keyLessThan(l.mSortKeys.at(lIdx), r.mSortKeys.at(rIdx));
+}
+
+bool DkFolderIndex::keyLessThan(const QByteArray& lKey, const QByteArray& rKey) {
+
+	int cmp = memcmp(lKey.constData(), rKey.constData(), qMin(lKey.size(), rKey.size()));
+
+	if (cmp != 0)
+		return cmp < 0;
+
+	return lKey.size() < rKey.size();
+}
+
+/**
+ * Reads the size and the dates of all files.
+ * This is the only place where the files are stat'ed - sorting uses the
+ * cached values. The files are processed in parallel since stat calls
+ * are mostly waiting for the (network) file system.
+ * @param files the files in the same order as mFilePaths.
+ **/
+void DkFolderIndex::statFiles(const QFileInfoList& files) {
+
+	int numEntries = files.size();
+	mFileSizes.resize(numEntries);
+	mModified.resize(numEntries);
+	mCreated.resize(numEntries);
+
+	// threads write to distinct elements - so get the pointers once
+	qint64* sizes = mFileSizes.data();
+	qint64* modified = mModified.data();
+	qint64* created = mCreated.data();
+
+	QVector<int> blocks;
+	for (int idx = 0; idx < numEntries; idx += stat_block_size)
+		blocks << idx;
+
+	auto statBlock = [&](int start) {
+		for (int idx = start; idx < qMin(start + (int)stat_block_size, numEntries); idx++)
+			statFile(files.at(idx), sizes[idx], modified[idx], created[idx]);
+	};
+
+	if (blocks.size() > 1)
+		QtConcurrent::blockingMap(blocks, statBlock);
+	else if (!blocks.empty())
+		statBlock(0);
+}
+
+/**
+ * Reads the size and the dates of a file.
+ * On Linux, statx is used which needs a single call and returns the birth time.
+ * Otherwise the QFileInfo is queried (its attributes might be cached already
+ * if the file system reported them while the folder was listed).
+ * The dates are in msecs since epoch, all values are 0 if the file does not exist.
+ **/
+void DkFolderIndex::statFile(const QFileInfo& file, qint64& size, qint64& modified, qint64& created) {
+
+#if defined(Q_OS_LINUX) && defined(STATX_BASIC_STATS)
+
+	struct statx stx;
+	QByteArray path = QFile::encodeName(file.absoluteFilePath());
+
+	// AT_STATX_DONT_SYNC: network file systems are allowed to answer from their attribute cache
+	if (statx(AT_FDCWD, path.constData(), AT_STATX_DONT_SYNC, STATX_SIZE | STATX_MTIME | STATX_CTIME | STATX_BTIME, &stx) == 0) {
+
+		// like QFileInfo::created() we fall back to the status change time if there is no birth time
+		const struct statx_timestamp& ct = (stx.stx_mask & STATX_BTIME) ? stx.stx_btime : stx.stx_ctime;
+
+		size = (qint64)stx.stx_size;
+		modified = (qint64)stx.stx_mtime.tv_sec * 1000 + stx.stx_mtime.tv_nsec / 1000000;
+		created = (qint64)ct.tv_sec * 1000 + ct.tv_nsec / 1000000;
+		return;
+	}
+	// fall back to QFileInfo (e.g. statx is not supported by the kernel)
+#endif
+
+	QDateTime m = file.lastModified();
+	QDateTime c = file.created();
+
+	size = file.size();
+	modified = m.isValid() ? m.toMSecsSinceEpoch() : 0;
+	created = c.isValid() ? c.toMSecsSinceEpoch() : 0;
+}
+
+/**
+ * Computes the natural sort keys of all file names.
+ * Large folders are processed in parallel.
+ **/
+void DkFolderIndex::computeSortKeys() {
+
+	int numEntries = mFileNames.size();
+	mSortKeys.resize(numEntries);
+
+	// threads write to distinct elements - so get the pointer once
+	QByteArray* keys = mSortKeys.data();
+	const QStringList& fileNames = mFileNames;
+
+	QVector<int> blocks;
+	for (int idx = 0; idx < numEntries; idx += parallel_block_size)
+		blocks << idx;
+
+	auto computeBlock = [&](int start) {
+		for (int idx = start; idx < qMin(start + (int)parallel_block_size, numEntries); idx++)
+			keys[idx] = DkUtils::naturalSortKey(fileNames.at(idx));
+	};
+
+	if (blocks.size() > 1)
+		QtConcurrent::blockingMap(blocks, computeBlock);
+	else if (!blocks.empty())
+		computeBlock(0);
+}
+
+/**
+ * Moves a single entry and shifts the entries in between.
+ * The lookup is not updated.
+ **/
+void DkFolderIndex::moveEntry(int from, int to) {
+
+	if (from == to)
+		return;
+
+	mFilePaths.move(from, to);
+	mFileNames.move(from, to);
+
+	moveItem(mSortKeys, from, to);
+	moveItem(mFileSizes, from, to);
+	moveItem(mModified, from, to);
+	moveItem(mCreated, from, to);
+	moveItem(mContainers, from, to);
+}
+
+void DkFolderIndex::updateLookup() {
+
+	mLookup.clear();
+	mLookup.reserve(mFilePaths.size());
+
+	for (int idx = 0; idx < mFilePaths.size(); idx++)
+		mLookup.insert(mFilePaths.at(idx), idx);
+}
+
+}
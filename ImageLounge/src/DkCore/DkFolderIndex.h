@@ -0,0 +1,131 @@
+/*******************************************************************************************************
+ DkFolderIndex.h
+ Created on:	18.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#pragma once
+
+#pragma warning(push, 0)	// no warnings from includes - begin
+#include <QVector>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QSharedPointer>
+#include <QByteArray>
+#pragma warning(pop)		// no warnings from includes - end
+
+#pragma warning(disable: 4251)	// TODO: remove
+
+#ifndef DllCoreExport
+#ifdef DK_CORE_DLL_EXPORT
+#define DllCoreExport Q_DECL_EXPORT
+#elif DK_DLL_IMPORT
+#define DllCoreExport Q_DECL_IMPORT
+#else
+#define DllCoreExport Q_DECL_IMPORT
+#endif
+#endif
+
+namespace nmc {
+
+// nomacs defines
+class DkImageContainerT;
+
+/**
+ * Compact index of the files in the current folder.
+ * The file attributes are stored in contiguous arrays (one per attribute)
+ * so that indexing and sorting large folders does not need any heap object
+ * per file. A DkImageContainerT is materialized by at() only if an entry
+ * is viewed, prefetched or thumbnailed. Containers are then kept by the
+ * index so that all users of an index share the same container per file.
+ * The containers must only be materialized from the main thread.
+ **/
+class DllCoreExport DkFolderIndex {
+
+public:
+	enum {
+		parallel_block_size = 4096,		// files per thread if keys are computed or sorted in parallel
+		stat_block_size = 256,			// files per thread if the attributes are read
+	};
+
+	DkFolderIndex(const QFileInfoList& files = QFileInfoList());
+
+	int size() const;
+	bool empty() const;
+
+	QString filePath(int idx) const;
+	QString fileName(int idx) const;
+	qint64 fileSize(int idx) const;
+	QDateTime lastModified(int idx) const;
+	QDateTime created(int idx) const;
+	QStringList alternates(int idx) const;
+	void setAlternates(const QHash<QString, QStringList>& alternates);
+
+	int indexOf(const QString& filePath) const;
+	int indexOf(QSharedPointer<DkImageContainerT> imgC) const;
+	int upperBound(const QFileInfo& file) const;
+
+	QSharedPointer<DkImageContainerT> at(int idx) const;
+	QSharedPointer<DkImageContainerT> materialized(int idx) const;
+	QVector<QSharedPointer<DkImageContainerT> > materialized() const;
+	int numMaterialized() const;
+
+	void adopt(const DkFolderIndex& other);
+	void adopt(QSharedPointer<DkImageContainerT> imgC);
+	void sort();
+	QVector<int> sortOrder() const;
+	void permute(const QVector<int>& order);
+	int insert(const QFileInfoList& files);
+	int merge(const DkFolderIndex& other);
+	int remove(const QStringList& filePaths);
+
+protected:
+	bool lessThan(int lIdx, int rIdx, int sortMode) const;
+	static bool lessThan(const DkFolderIndex& l, int lIdx, const DkFolderIndex& r, int rIdx, int sortMode);
+	void append(const DkFolderIndex& other, int oIdx);
+	static bool keyLessThan(const QByteArray& lKey, const QByteArray& rKey);
+	void statFiles(const QFileInfoList& files);
+	static void statFile(const QFileInfo& file, qint64& size, qint64& modified, qint64& created);
+	void computeSortKeys();
+	void updateLookup();
+	void moveEntry(int from, int to);
+
+	QStringList mFilePaths;
+	QStringList mFileNames;
+	QVector<QByteArray> mSortKeys;	// natural sort keys of the file names
+	QVector<qint64> mFileSizes;
+	QVector<qint64> mModified;		// msecs since epoch
+	QVector<qint64> mCreated;		// msecs since epoch
+	QHash<QString, int> mLookup;	// file path -> index
+	QHash<QString, QStringList> mAlternates;	// file path -> hidden duplicates (e.g. RAW of a JPG)
+
+	// sparse - only entries that were used have a container
+	mutable QVector<QSharedPointer<DkImageContainerT> > mContainers;
+	mutable QVector<QSharedPointer<DkImageContainerT> > mMaterialized;	// all containers (in the order they were created)
+};
+
+}
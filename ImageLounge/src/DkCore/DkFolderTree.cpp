@@ -0,0 +1,388 @@
+/*******************************************************************************************************
+ DkFolderTree.cpp
+ Created on:	18.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#include "DkFolderTree.h"
+#include "DkDirScanner.h"
+#include "DkSettings.h"
+#include "DkUtils.h"
+#include "DkTimer.h"
+
+#pragma warning(push, 0)	// no warnings from includes - begin
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QSaveFile>
+#include <QFileInfo>
+#include <QDataStream>
+#include <QStandardPaths>
+#include <QtConcurrentRun>
+#include <QDebug>
+#pragma warning(pop)		// no warnings from includes - end
+
+namespace nmc {
+
+// DkFolderTree --------------------------------------------------------------------
+DkFolderTree::DkFolderTree(QObject* parent) : QObject(parent) {
+
+	connect(&mCrawlWatcher, SIGNAL(finished()), this, SLOT(crawled()));
+	loadCache();
+}
+
+DkFolderTree::~DkFolderTree() {
+
+	if (mCrawlWatcher.isRunning()) {
+		mAbort.storeRelease(1);
+		mCrawlWatcher.waitForFinished();
+	}
+}
+
+/**
+ * Sets the root of the tree and starts crawling it.
+ * If the root did not change, the tree is refreshed - only folders
+ * that were modified since they were crawled are listed again.
+ * @param rootPath the root folder.
+ **/
+void DkFolderTree::setRootPath(const QString& rootPath) {
+
+	if (rootPath != mRootPath) {
+		mFolders.clear();
+		mLookup.clear();
+		updateNeighbors();
+	}
+
+	mRootPath = rootPath;
+
+	if (mCrawlWatcher.isRunning())
+		mAbort.storeRelease(1);	// crawled() starts the new crawl
+	else
+		startCrawl();
+}
+
+QString DkFolderTree::rootPath() const {
+	return mRootPath;
+}
+
+bool DkFolderTree::isCrawling() const {
+	return mCrawlWatcher.isRunning();
+}
+
+/**
+ * Blocks until the current root is crawled.
+ **/
+void DkFolderTree::waitForCrawl() {
+
+	// a crawl of an old root might be running
+	while (mCrawlWatcher.isRunning()) {
+		mCrawlWatcher.waitForFinished();
+		crawled();
+	}
+}
+
+int DkFolderTree::size() const {
+	return mFolders.size();
+}
+
+QString DkFolderTree::folder(int folderIdx) const {
+	return mFolders.at(folderIdx).path;
+}
+
+int DkFolderTree::numImages(int folderIdx) const {
+	return mFolders.at(folderIdx).numImages;
+}
+
+int DkFolderTree::indexOf(const QString& dirPath) const {
+	return mLookup.value(dirPath, -1);
+}
+
+/**
+ * Returns the next folder that has images.
+ * @param folderIdx the current folder.
+ * @param loop if true, the first folder with images is returned at the end of the tree.
+ * @return int the index of the next folder or -1.
+ **/
+int DkFolderTree::nextFolder(int folderIdx, bool loop) const {
+
+	if (folderIdx < 0 || folderIdx >= mNext.size())
+		return -1;
+
+	int nextIdx = mNext.at(folderIdx);
+
+	if (nextIdx == -1 && loop)
+		nextIdx = mFirst;
+
+	return nextIdx != folderIdx ? nextIdx : -1;
+}
+
+/**
+ * Returns the previous folder that has images.
+ * @param folderIdx the current folder.
+ * @param loop if true, the last folder with images is returned at the start of the tree.
+ * @return int the index of the previous folder or -1.
+ **/
+int DkFolderTree::prevFolder(int folderIdx, bool loop) const {
+
+	if (folderIdx < 0 || folderIdx >= mPrev.size())
+		return -1;
+
+	int prevIdx = mPrev.at(folderIdx);
+
+	if (prevIdx == -1 && loop)
+		prevIdx = mLast;
+
+	return prevIdx != folderIdx ? prevIdx : -1;
+}
+
+/**
+ * Updates the number of images of a folder that was listed anyway.
+ * This keeps the tree up-to-date between two crawls.
+ * @param dirPath the folder.
+ * @param numImages the number of images in this folder.
+ **/
+void DkFolderTree::setNumImages(const QString& dirPath, int numImages) {
+
+	int folderIdx = indexOf(dirPath);
+
+	if (folderIdx == -1)
+		return;
+
+	Folder& f = mFolders[folderIdx];
+	bool emptyChanged = (f.numImages == 0) != (numImages == 0);
+
+	f.numImages = numImages;
+	f.modified = QFileInfo(dirPath).lastModified().toMSecsSinceEpoch();
+	mCache.insert(dirPath, f);
+
+	if (emptyChanged)
+		updateNeighbors();
+}
+
+void DkFolderTree::crawled() {
+
+	if (mCrawledPath.isEmpty())
+		return;	// already handled by waitForCrawl()
+
+	QVector<Folder> folders = mCrawlWatcher.result();
+	QString crawledPath = mCrawledPath;
+	mCrawledPath.clear();
+
+	// the root changed in the meantime
+	if (mAbort.loadAcquire() || crawledPath != mRootPath) {
+		startCrawl();
+		return;
+	}
+
+	mFolders = folders;
+	mLookup.clear();
+	mLookup.reserve(mFolders.size());
+
+	for (int idx = 0; idx < mFolders.size(); idx++) {
+		mLookup.insert(mFolders.at(idx).path, idx);
+		mCache.insert(mFolders.at(idx).path, mFolders.at(idx));
+	}
+
+	updateNeighbors();
+	saveCache();
+
+	emit treeUpdated();
+}
+
+void DkFolderTree::startCrawl() {
+
+	mAbort.storeRelease(0);
+
+	if (mRootPath.isEmpty())
+		return;
+
+	// image counts of other filters are worthless
+	const QStringList& nameFilters = DkSettingsManager::param().app().browseFilters;
+	if (mCacheFilters != nameFilters) {
+		mCache.clear();
+		mCacheFilters = nameFilters;
+	}
+
+	mCrawledPath = mRootPath;
+	mCrawlWatcher.setFuture(QtConcurrent::run(&nmc::DkFolderTree::crawl, mRootPath, nameFilters, mCache, &mAbort));
+}
+
+/**
+ * Precomputes the neighboring folders with images.
+ **/
+void DkFolderTree::updateNeighbors() {
+
+	int numFolders = mFolders.size();
+	mNext.fill(-1, numFolders);
+	mPrev.fill(-1, numFolders);
+
+	int lastIdx = -1;
+	for (int idx = 0; idx < numFolders; idx++) {
+		mPrev[idx] = lastIdx;
+		if (mFolders.at(idx).numImages > 0)
+			lastIdx = idx;
+	}
+	mLast = lastIdx;
+
+	int nextIdx = -1;
+	for (int idx = numFolders-1; idx >= 0; idx--) {
+		mNext[idx] = nextIdx;
+		if (mFolders.at(idx).numImages > 0)
+			nextIdx = idx;
+	}
+	mFirst = nextIdx;
+}
+
+/**
+ * Crawls a folder tree (runs in a thread).
+ * Folders that were not modified since they were cached are not listed again.
+ * @param rootPath the root folder.
+ * @param nameFilters the image file filters.
+ * @param cache the folders that were crawled before.
+ * @param abort the crawl is stopped if this is set.
+ * @return QVector<DkFolderTree::Folder> all folders (including the root) in natural sort order.
+ **/
+QVector<DkFolderTree::Folder> DkFolderTree::crawl(const QString& rootPath, const QStringList& nameFilters, const QHash<QString, Folder>& cache, const QAtomicInt* abort) {
+
+	DkTimer dt;
+
+	QStringList dirPaths;
+	dirPaths << rootPath;
+
+	QDirIterator dirs(rootPath, QDir::Dirs | QDir::NoDotAndDotDot | QDir::NoSymLinks, QDirIterator::Subdirectories);
+
+	while (dirs.hasNext() && dirPaths.size() < max_folders) {
+		dirs.next();
+		dirPaths << dirs.filePath();
+
+		if (abort->loadAcquire())
+			return QVector<Folder>();
+	}
+
+	qSort(dirPaths.begin(), dirPaths.end(), DkUtils::compLogicQString);
+
+	DkDirScanner scanner(nameFilters);
+	QVector<Folder> folders;
+	folders.reserve(dirPaths.size());
+	int numListed = 0;
+
+	for (const QString& dirPath : dirPaths) {
+
+		if (abort->loadAcquire())
+			return QVector<Folder>();
+
+		Folder f;
+		f.path = dirPath;
+		f.modified = QFileInfo(dirPath).lastModified().toMSecsSinceEpoch();
+
+		QHash<QString, Folder>::const_iterator cached = cache.constFind(dirPath);
+
+		// the modification time of a folder changes if files are added, removed or renamed
+		if (cached != cache.constEnd() && cached->modified == f.modified)
+			f.numImages = cached->numImages;
+		else {
+			f.numImages = scanner.scan(dirPath).size();
+			numListed++;
+		}
+
+		folders << f;
+	}
+
+	qInfo() << "[DkFolderTree]" << folders.size() << "folders of" << rootPath << "indexed (" << numListed << "listed) in" << dt;
+
+	return folders;
+}
+
+QString DkFolderTree::cacheFilePath() {
+	return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/folders.dat";
+}
+
+void DkFolderTree::loadCache() {
+
+	QFile file(cacheFilePath());
+
+	if (!file.open(QIODevice::ReadOnly))
+		return;
+
+	QDataStream ds(&file);
+
+	quint32 version = 0;
+	qint32 numFolders = 0;
+	ds >> version;
+
+	if (version != 2)
+		return;
+
+	ds >> mCacheFilters >> numFolders;
+
+	if (ds.status() != QDataStream::Ok || numFolders < 0) {
+		mCacheFilters.clear();
+		return;
+	}
+
+	mCache.reserve(numFolders);
+
+	for (int idx = 0; idx < numFolders && ds.status() == QDataStream::Ok; idx++) {
+
+		Folder f;
+		qint32 numImages = 0;
+		ds >> f.path >> f.modified >> numImages;
+		f.numImages = numImages;
+
+		if (ds.status() == QDataStream::Ok)
+			mCache.insert(f.path, f);
+	}
+}
+
+void DkFolderTree::saveCache() const {
+
+	// the cache grew too large: keep the current tree only
+	const QHash<QString, Folder>* cache = &mCache;
+	QHash<QString, Folder> treeCache;
+
+	if (mCache.size() > max_cached_folders) {
+		for (const Folder& f : mFolders)
+			treeCache.insert(f.path, f);
+		cache = &treeCache;
+	}
+
+	QDir().mkpath(QFileInfo(cacheFilePath()).absolutePath());
+	QSaveFile file(cacheFilePath());
+
+	if (!file.open(QIODevice::WriteOnly)) {
+		qWarning() << "[DkFolderTree] cannot write" << cacheFilePath();
+		return;
+	}
+
+	QDataStream ds(&file);
+	ds << (quint32)2 << mCacheFilters << (qint32)cache->size();
+
+	for (const Folder& f : *cache)
+		ds << f.path << f.modified << (qint32)f.numImages;
+
+	if (ds.status() != QDataStream::Ok || !file.commit())
+		qWarning() << "[DkFolderTree] cannot write" << cacheFilePath();
+}
+
+}
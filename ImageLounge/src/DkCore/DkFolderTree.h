@@ -0,0 +1,124 @@
+/*******************************************************************************************************
+ DkFolderTree.h
+ Created on:	18.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#pragma once
+
+#pragma warning(push, 0)	// no warnings from includes - begin
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+#include <QFutureWatcher>
+#include <QAtomicInt>
+#pragma warning(pop)		// no warnings from includes - end
+
+#pragma warning(disable: 4251)	// TODO: remove
+
+#ifndef DllCoreExport
+#ifdef DK_CORE_DLL_EXPORT
+#define DllCoreExport Q_DECL_EXPORT
+#elif DK_DLL_IMPORT
+#define DllCoreExport Q_DECL_IMPORT
+#else
+#define DllCoreExport Q_DECL_IMPORT
+#endif
+#endif
+
+namespace nmc {
+
+/**
+ * Index of the folders below a root folder.
+ * The tree is crawled in a background thread. For each folder, the number
+ * of images and the folder's modification time are stored. These are
+ * persisted between sessions, so a refresh only lists folders that changed.
+ * The neighboring folders with images are precomputed, so stepping to the
+ * next/previous folder is a look-up.
+ **/
+class DllCoreExport DkFolderTree : public QObject {
+	Q_OBJECT
+
+public:
+	enum {
+		max_folders = 10000,			// folders per tree
+		max_cached_folders = 50000,		// folders that are persisted
+	};
+
+	struct Folder {
+		QString path;
+		qint64 modified = 0;	// msecs since epoch
+		int numImages = 0;
+	};
+
+	DkFolderTree(QObject* parent = 0);
+	virtual ~DkFolderTree();
+
+	void setRootPath(const QString& rootPath);
+	QString rootPath() const;
+	bool isCrawling() const;
+	void waitForCrawl();
+
+	int size() const;
+	QString folder(int folderIdx) const;
+	int numImages(int folderIdx) const;
+	int indexOf(const QString& dirPath) const;
+	int nextFolder(int folderIdx, bool loop) const;
+	int prevFolder(int folderIdx, bool loop) const;
+
+	void setNumImages(const QString& dirPath, int numImages);
+
+signals:
+	void treeUpdated() const;
+
+protected slots:
+	void crawled();
+
+protected:
+	void startCrawl();
+	void updateNeighbors();
+	void loadCache();
+	void saveCache() const;
+
+	static QString cacheFilePath();
+	static QVector<Folder> crawl(const QString& rootPath, const QStringList& nameFilters, const QHash<QString, Folder>& cache, const QAtomicInt* abort);
+
+	QString mRootPath;
+	QString mCrawledPath;			// root of the tree that is crawled right now
+	QVector<Folder> mFolders;		// sorted like the folder paths
+	QHash<QString, int> mLookup;	// folder path -> index
+	QVector<int> mNext;				// next folder with images (or -1)
+	QVector<int> mPrev;				// previous folder with images (or -1)
+	int mFirst = -1;				// first folder with images
+	int mLast = -1;					// last folder with images
+
+	QHash<QString, Folder> mCache;	// all folders ever crawled (persisted)
+	QStringList mCacheFilters;		// browse filters the cached image counts refer to
+	QFutureWatcher<QVector<Folder> > mCrawlWatcher;
+	QAtomicInt mAbort;
+};
+
+}
@@ -115,8 +115,7 @@ void DkImageContainer::clear() {
 
 	if (mLoader)
 		mLoader->release();
-	if (mFileBuffer)
-		mFileBuffer->clear();
+	mFileBuffer.clear();	// releases mapped files too
 	init();
 }
 
@@ -137,12 +136,12 @@ void DkImageContainer::setHistoryIndex(int idx) {
 void DkImageContainer::cropImage(const DkRotatingRect & rect, const QColor & col, bool cropToMetadata) {
 
 	if (!cropToMetadata) {
-		QImage cropped = DkImage::cropToImage(image(), rect, col);
+		QImage cropped = DkImage::cropToImage(loadFullImage(), rect, col);
 		setImage(cropped, QObject::tr("Cropped"));
 		getMetaData()->clearXMPRect();
 	}
 	else
-		getMetaData()->saveRectToXMP(rect, image().size());
+		getMetaData()->saveRectToXMP(rect, imageSize());
 }
 
 QFileInfo DkImageContainer::fileInfo() const {
@@ -261,15 +260,46 @@ QSharedPointer<QByteArray> DkImageContainer::getFileBuffer() {
 
 float DkImageContainer::getMemoryUsage() const {
 
-	if (!mLoader)
-		return 0;
-
 	float memSize = mFileBuffer ? mFileBuffer->size()/(1024.0f*1024.0f) : 0;
-	memSize += DkImage::getBufferSizeFloat(mLoader->image().size(), mLoader->image().depth());
+
+	if (mLoader)
+		memSize += DkImage::getBufferSizeFloat(mLoader->image().size(), mLoader->image().depth());
+
+	return memSize;
+}
+
+float DkImageContainer::getScaledMemoryUsage() const {
+
+	float memSize = 0;
+
+	for (const QImage& img : scaledImages)
+		memSize += DkImage::getBufferSizeFloat(img.size(), img.depth());
 
 	return memSize;
 }
 
+void DkImageContainer::clearScaledImages() {
+	scaledImages.clear();
+}
+
+float DkImageContainer::getThumbMemoryUsage() const {
+
+	if (!mThumb || mThumb->hasImage() != DkThumbNail::loaded)
+		return 0;
+
+	return mThumb->memoryUsage();
+}
+
+/**
+ * Releases the thumbnail image.
+ * It is fetched again (e.g. from the thumbnail store) if needed.
+ **/
+void DkImageContainer::releaseThumb() {
+
+	if (mThumb && mThumb->hasImage() == DkThumbNail::loaded)
+		mThumb->clearImage();
+}
+
 float DkImageContainer::getFileSize() const {
 
 	return QFileInfo(mFilePath).size()/(1024.0f*1024.0f);
@@ -280,7 +310,7 @@ DkRotatingRect DkImageContainer::cropRect() {
 	QSharedPointer<DkMetaDataT> metaData = getMetaData();
 
 	if (metaData) {
-		return metaData->getXMPRect(image().size());
+		return metaData->getXMPRect(imageSize());
 	}
 	else
 		qWarning() << "empty crop rect because there are no metadata...";
@@ -289,31 +319,135 @@ DkRotatingRect DkImageContainer::cropRect() {
 }
 
 
+/**
+ * Returns the image in full resolution.
+ * Gigapixel images that are displayed as tiled previews (see DkTiledImage)
+ * are never decoded implicitly - a null image is returned for them.
+ * Use displayImage() to show them and loadFullImage() to save, print or edit them.
+ * @return QImage the image
+ **/
 QImage DkImageContainer::image() {
 
 	if (getLoader()->image().isNull() && getLoadState() == not_loaded)
 		loadImage();
 
+	if (getLoader()->tiledImage())
+		return QImage();
+
 	return mLoader->image();
 }
 
+/**
+ * Decodes the image in full resolution.
+ * Tiled images are decoded by a separate loader, so the
+ * preview and its tiles are not touched. This blocks -
+ * the viewer runs loadFullImageIntern() in a thread instead.
+ * @return QImage the image in full resolution
+ **/
+QImage DkImageContainer::loadFullImage() {
+
+	if (!isTiled())
+		return image();
+
+	return loadFullImageIntern(mFilePath, getFileBuffer());
+}
+
+/**
+ * Returns true if the image is displayed as tiled preview.
+ * image() returns a null image in this case.
+ **/
+bool DkImageContainer::isTiled() {
+
+	return !getLoader()->tiledImage().isNull();
+}
+
+QImage DkImageContainer::loadFullImageIntern(const QString& filePath, const QSharedPointer<QByteArray> fileBuffer) {
+
+	DkTimer dt;
+	DkBasicLoader loader;
+
+	try {
+		loader.loadGeneral(filePath, fileBuffer, true);
+	} catch (...) {
+		qWarning() << "Unknown error in DkImageContainer::loadFullImageIntern";
+	}
+
+	qInfo() << filePath << "decoded in full resolution in" << dt;
+
+	return loader.image();
+}
+
+/**
+ * Returns the image that is displayed.
+ * For gigapixel images this is the preview that is
+ * rendered with tiles (see DkTiledImage) - use it for display only.
+ * @return QImage the displayed image
+ **/
+QImage DkImageContainer::displayImage() {
+
+	if (getLoader()->image().isNull() && getLoadState() == not_loaded)
+		loadImage();
+
+	return mLoader->image();
+}
+
+/**
+ * Returns the size of the image in full resolution.
+ * In contrast to image().size(), gigapixel images are not decoded.
+ * @return QSize the image size
+ **/
+QSize DkImageContainer::imageSize() {
+
+	QSharedPointer<DkTiledImage> tiledImage = getLoader()->tiledImage();
+
+	if (tiledImage)
+		return tiledImage->size();
+
+	return displayImage().size();
+}
+
 QImage DkImageContainer::imageScaledToHeight(int height) {
 
 	// check cash first
+	QImage sImg = cachedImageScaledToHeight(height);
+
+	if (!sImg.isNull())
+		return sImg;
+
+	// cache it
+	sImg = displayImage().scaledToHeight(height, Qt::SmoothTransformation);
+	cacheScaledImage(sImg);
+
+	return sImg;
+}
+
+/**
+ * Returns a scaled copy of the image if it was computed before.
+ * It never scales the image - so it is cheap to call from paint events.
+ * @param height the height of the scaled copy
+ * @return QImage the scaled copy or a null image
+ **/
+QImage DkImageContainer::cachedImageScaledToHeight(int height) const {
+
 	for (const QImage& img : scaledImages) {
 		if (img.height() == height)
 			return img;
 	}
 
-	// cache it
-	QImage sImg = image().scaledToHeight(height, Qt::SmoothTransformation);
-	scaledImages << sImg;
+	return QImage();
+}
+
+/**
+ * Adds a scaled copy of the current image (e.g. one that was computed in a thread).
+ * @param img the scaled copy
+ **/
+void DkImageContainer::cacheScaledImage(const QImage& img) {
+
+	scaledImages << img;
 
 	// clean up
 	if (scaledImages.size() > 10)
 		scaledImages.pop_front();
-
-	return sImg;
 }
 
 QImage DkImageContainer::imageScaledToWidth(int width) {
@@ -325,7 +459,7 @@ QImage DkImageContainer::imageScaledToWidth(int width) {
 	}
 
 	// cache it
-	QImage sImg = image().scaledToWidth(width, Qt::SmoothTransformation);
+	QImage sImg = displayImage().scaledToWidth(width, Qt::SmoothTransformation);
 	scaledImages << sImg;
 
 	// clean up
@@ -372,6 +506,11 @@ bool DkImageContainer::hasImage() const {
 	return mLoader->hasImage();
 }
 
+bool DkImageContainer::hasFileBuffer() const {
+
+	return mFileBuffer && !mFileBuffer->isEmpty();
+}
+
 int DkImageContainer::getLoadState() const {
 
 	return mLoadState;
@@ -385,13 +524,33 @@ bool DkImageContainer::loadImage() {
 	if (getFileBuffer()->isEmpty())
 		mFileBuffer = loadFileToBuffer(mFilePath);
 
+	// synchronous loads (e.g. batch processing) need all pixels
+	getLoader()->setTiling(false);
 	mLoader = loadImageIntern(mFilePath, getLoader(), mFileBuffer);
 
 	return mLoader->hasImage();
 }
 
+/**
+ * Loads the smallest embedded preview (e.g. of RAW files) that covers size.
+ * This is used instead of loadImage() if the image is down-scaled anyway.
+ * @param size the size that should be covered
+ * @param mode the aspect ratio mode (see DkMetaDataT::getBestFitPreview)
+ * @return bool true if a preview was large enough
+ **/
+bool DkImageContainer::loadEmbeddedPreview(const QSize& size, Qt::AspectRatioMode mode) {
+
+	if (!QFileInfo(mFileInfo).exists())
+		return false;
+
+	if (getFileBuffer()->isEmpty())
+		mFileBuffer = loadFileToBuffer(mFilePath);
+
+	return getLoader()->loadEmbeddedPreview(mFilePath, mFileBuffer, size, mode);
+}
+
 bool DkImageContainer::saveImage(const QString& filePath, int compression /* = -1 */) {
-	return saveImage(filePath, getLoader()->image(), compression);
+	return saveImage(filePath, loadFullImage(), compression);
 }
 
 bool DkImageContainer::saveImage(const QString& filePath, const QImage saveImg, int compression /* = -1 */) {
@@ -420,6 +579,10 @@ QSharedPointer<QByteArray> DkImageContainer::loadFileToBuffer(const QString& fil
 		return QSharedPointer<QByteArray>(new QByteArray());
 	}
 
+	// the buffer lives as long as the image is cached and the file might be rewritten meanwhile
+	// so it is read to the heap - mapped pages would raise SIGBUS if the file is truncated.
+	// The metadata (exiv2) references the buffer too, so it cannot be unmapped after decoding.
+	// Thumbnails (DkThumbNail::fileBuffer) are decoded from short-lived mappings instead.
 	QFile file(fInfo.absoluteFilePath());
 	file.open(QIODevice::ReadOnly);
 
@@ -550,6 +713,13 @@ bool imageContainerLessThan(const DkImageContainer& l, const DkImageContainer& r
 		else
 			return DkUtils::compDateModifiedInv(l.fileInfo(), r.fileInfo());
 
+	case DkSettings::sort_file_size:
+		if (DkSettingsManager::param().global().sortDir == DkSettings::sort_ascending)
+			return l.fileInfo().size() < r.fileInfo().size();
+		else
+			return r.fileInfo().size() < l.fileInfo().size();
+		break;
+
 	case DkSettings::sort_random:
 		return DkUtils::compRandom(l.fileInfo(), r.fileInfo());
 
@@ -577,6 +747,9 @@ DkImageContainerT::~DkImageContainerT() {
 	mBufferWatcher.cancel();
 	mImageWatcher.blockSignals(true);
 	mImageWatcher.cancel();
+	mPreviewWatcher.blockSignals(true);
+	mPreviewWatcher.cancel();
+	mPreviewWatcher.waitForFinished();	// the preview is decoded by a member function
 
 	saveMetaData();
 
@@ -687,11 +860,58 @@ bool DkImageContainerT::loadImageThreaded(bool force) {
 		setFilePath(getZipData()->getImageFileName());
 #endif
 	
+	// the viewer renders gigapixel images tile-wise
+	getLoader()->setTiling(true);
+
 	mLoadState = loading;
 	fetchFile();
 	return true;
 }
 
+/**
+ * Enables two-phase loading for the next load request.
+ * If the decoder supports fast down-scaling (jpg), an image that
+ * covers size is decoded & shown first (imageUpdatedSignal) while
+ * the full resolution image is decoded in parallel.
+ * @param size the size that should be covered (e.g. the viewport).
+ **/
+void DkImageContainerT::setPreviewSize(const QSize& size) {
+	mPreviewSize = size;
+}
+
+/**
+ * Returns true if the down-scaled preview is shown while the full image is decoded.
+ **/
+bool DkImageContainerT::showsPreview() const {
+	return mShowsPreview;
+}
+
+/**
+ * Returns the full image.
+ * If the preview is shown, this blocks until the full image is decoded,
+ * since edits on the preview would be overwritten by the full image.
+ * @return QImage the image
+ **/
+QImage DkImageContainerT::image() {
+
+	waitForFullImage();
+
+	return DkImageContainer::image();
+}
+
+/**
+ * Blocks until the full image replaced the preview.
+ **/
+void DkImageContainerT::waitForFullImage() {
+
+	if (!mShowsPreview)
+		return;
+
+	qInfo() << "waiting for the full resolution of" << fileName();
+	mImageWatcher.waitForFinished();
+	imageLoaded();
+}
+
 void DkImageContainerT::fetchFile() {
 	
 	if (mFetchingBuffer && getLoadState() == loading_canceled) {
@@ -751,15 +971,47 @@ void DkImageContainerT::fetchImage() {
 	qInfoClean() << "loading " << filePath();
 	mFetchingImage = true;
 
+	// phase one: decode a down-scaled preview for the first paint
+	if (mPreviewSize.isValid()) {
+		connect(&mPreviewWatcher, SIGNAL(finished()), this, SLOT(previewLoaded()), Qt::UniqueConnection);
+
+		mPreviewWatcher.setFuture(QtConcurrent::run(this,
+			&nmc::DkImageContainerT::loadPreviewIntern, filePath(), mFileBuffer, mPreviewSize));
+		mPreviewSize = QSize();
+	}
+
+	// phase two: the full image
 	connect(&mImageWatcher, SIGNAL(finished()), this, SLOT(imageLoaded()), Qt::UniqueConnection);
 
 	mImageWatcher.setFuture(QtConcurrent::run(this, 
 		&nmc::DkImageContainerT::loadImageIntern, filePath(), mLoader, mFileBuffer));
 }
 
+void DkImageContainerT::previewLoaded() {
+
+	// the full image was faster or we were canceled
+	if (!mFetchingImage || getLoadState() != loading)
+		return;
+
+	QSharedPointer<DkBasicLoader> loader = mPreviewWatcher.result();
+
+	if (!loader || !loader->hasImage())
+		return;
+
+	// the loader decoding the full image is owned by the worker thread until imageLoaded() swaps it in
+	mLoader = loader;
+	mShowsPreview = true;
+	emit imageUpdatedSignal();
+}
+
 void DkImageContainerT::imageLoaded() {
 
+	// we might have waited for the image already (see waitForFullImage)
+	if (!mFetchingImage)
+		return;
+
 	mFetchingImage = false;
+	mShowsPreview = false;
 
 	if (getLoadState() == loading_canceled) {
 		mLoadState = not_loaded;
@@ -808,12 +1060,18 @@ void DkImageContainerT::loadingFinished() {
 		return;
 	}
 	else if (!getThumb()->hasImage()) {
-		getThumb()->setImage(getLoader()->image());
+
+		// do not rescale large images in the main thread - the viewport's pyramid or the thumbnail loader provide the thumbnail
+		QSize s = getLoader()->image().size();
+		if (qMax(s.width(), s.height()) > DkImageStorage::max_level_size)
+			getThumb()->fetchThumb(DkThumbNailT::do_not_force, mFileBuffer);
+		else
+			getThumb()->setImage(getLoader()->image());
 	}
 
 	// clear file buffer if it exceeds a certain size?! e.g. psd files
 	if (mFileBuffer && mFileBuffer->size()/(1024.0f*1024.0f) > DkSettingsManager::param().resources().cacheMemory*0.5f)
-		mFileBuffer->clear();
+		mFileBuffer.clear();
 	
 	mLoadState = loaded;
 	emit fileLoadedSignal(true);
@@ -856,12 +1114,21 @@ void DkImageContainerT::fileDownloaded() {
 
 void DkImageContainerT::cancel() {
 
+	// a pure file fetch (see prefetcher) can be canceled too
+	if (mLoadState == not_loaded && mFetchingBuffer)
+		mLoadState = loading_canceled;
+
 	if (mLoadState != loading)
 		return;
 
 	mLoadState = loading_canceled;
 }
 
+bool DkImageContainerT::isFetching() const {
+
+	return mFetchingBuffer || mFetchingImage;
+}
+
 void DkImageContainerT::receiveUpdates(QObject* obj, bool connectSignals /* = true */) {
 
 	// !selected - do not connect twice
@@ -899,7 +1166,7 @@ void DkImageContainerT::saveMetaDataThreaded() {
 
 bool DkImageContainerT::saveImageThreaded(const QString& filePath, int compression /* = -1 */) {
 
-	return saveImageThreaded(filePath, getLoader()->image(), compression);
+	return saveImageThreaded(filePath, loadFullImage(), compression);
 }
 
 
@@ -950,8 +1217,7 @@ void DkImageContainerT::savingFinished() {
 		//// reset thumb - loadImageThreaded should do it anyway
 		//thumb = QSharedPointer<DkThumbNailT>(new DkThumbNailT(saveFile, loader->image()));
 
-		if (mFileBuffer)
-			mFileBuffer->clear();	// do a complete clear?
+		mFileBuffer.clear();	// the file might be mapped
 		setFilePath(savePath);
 		mEdited = false;
 		mDownloaded = false;
@@ -973,6 +1239,21 @@ QSharedPointer<DkBasicLoader> DkImageContainerT::loadImageIntern(const QString&
 	return DkImageContainer::loadImageIntern(filePath, loader, fileBuffer);
 }
 
+QSharedPointer<DkBasicLoader> DkImageContainerT::loadPreviewIntern(const QString& filePath, const QSharedPointer<QByteArray> fileBuffer, const QSize& size) {
+
+	QSharedPointer<DkBasicLoader> loader(new DkBasicLoader());
+
+	try {
+		if (!loader->loadPreview(filePath, fileBuffer, size))
+			return QSharedPointer<DkBasicLoader>();
+	} catch (...) {
+		qWarning() << "Unknown error in DkImageContainerT::loadPreviewIntern";
+		return QSharedPointer<DkBasicLoader>();
+	}
+
+	return loader;
+}
+
 QString DkImageContainerT::saveImageIntern(const QString& filePath, QSharedPointer<DkBasicLoader> loader, QImage saveImg, int compression) {
 
 	qDebug() << "saveImage in T: " << filePath;
@@ -1011,16 +1292,19 @@ bool DkImageContainerT::isFileDownloaded() const {
 }
 
 void DkImageContainerT::undo() {
+	waitForFullImage();
 	DkImageContainer::undo();
 	emit imageUpdatedSignal();
 }
 
 void DkImageContainerT::redo() {
+	waitForFullImage();
 	DkImageContainer::redo();
 	emit imageUpdatedSignal();
 }
 
 void DkImageContainerT::setHistoryIndex(int idx) {
+	waitForFullImage();
 	DkImageContainer::setHistoryIndex(idx);
 	emit imageUpdatedSignal();
 }
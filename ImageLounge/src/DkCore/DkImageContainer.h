@@ -75,11 +75,18 @@ public:
 	bool operator> (const DkImageContainer& o) const;
 	bool operator>= (const DkImageContainer& o) const;
 
-	QImage image();
+	virtual QImage image();
+	QImage displayImage();
+	QSize imageSize();
+	QImage loadFullImage();
+	bool isTiled();
 	QImage imageScaledToHeight(int height);
 	QImage imageScaledToWidth(int width);
+	QImage cachedImageScaledToHeight(int height) const;
+	void cacheScaledImage(const QImage& img);
 
 	bool hasImage() const;
+	bool hasFileBuffer() const;
 	int getLoadState() const;
 	QFileInfo fileInfo() const;
 	QString filePath() const;
@@ -91,6 +98,10 @@ public:
 	void setEdited(bool edited);
 	QString getTitleAttribute() const;
 	float getMemoryUsage() const;
+	float getScaledMemoryUsage() const;
+	void clearScaledImages();
+	float getThumbMemoryUsage() const;
+	void releaseThumb();
 	float getFileSize() const;
 
 	virtual QSharedPointer<DkBasicLoader> getLoader();
@@ -109,6 +120,8 @@ public:
 
 	QSharedPointer<QByteArray> loadFileToBuffer(const QString& filePath);
 	bool loadImage();
+	bool loadEmbeddedPreview(const QSize& size, Qt::AspectRatioMode mode = Qt::KeepAspectRatio);
+	static QImage loadFullImageIntern(const QString& filePath, const QSharedPointer<QByteArray> fileBuffer);
 	void setImage(const QImage& img, const QString& editName);
 	void setImage(const QImage& img, const QString& editName, const QString& filePath);
 	bool saveImage(const QString& filePath, const QImage saveImg, int compression = -1);
@@ -163,11 +176,15 @@ public:
 
 	void fetchFile();
 	void cancel();
+	bool isFetching() const;
 	void clear();
 	void receiveUpdates(QObject* obj, bool connectSignals = true);
 	void downloadFile(const QUrl& url);
 
 	bool loadImageThreaded(bool force = false);
+	void setPreviewSize(const QSize& size);
+	bool showsPreview() const;
+	QImage image() override;
 	bool saveImageThreaded(const QString& filePath, const QImage saveImg, int compression = -1);
 	bool saveImageThreaded(const QString& filePath, int compression = -1);
 	void saveMetaDataThreaded();
@@ -194,6 +211,7 @@ public slots:
 
 protected slots:
 	void bufferLoaded();
+	void previewLoaded();
 	void imageLoaded();
 	void savingFinished();
 	void loadingFinished();
@@ -201,14 +219,17 @@ protected slots:
 
 protected:
 	void fetchImage();
+	void waitForFullImage();
 	
 	QSharedPointer<QByteArray> loadFileToBuffer(const QString& filePath);
 	QSharedPointer<DkBasicLoader> loadImageIntern(const QString& filePath, QSharedPointer<DkBasicLoader> loader, const QSharedPointer<QByteArray> fileBuffer);
+	QSharedPointer<DkBasicLoader> loadPreviewIntern(const QString& filePath, const QSharedPointer<QByteArray> fileBuffer, const QSize& size);
 	QString saveImageIntern(const QString& filePath, QSharedPointer<DkBasicLoader> loader, QImage saveImg, int compression);
 	void saveMetaDataIntern(const QString& filePath, QSharedPointer<DkBasicLoader> loader, QSharedPointer<QByteArray> fileBuffer);
 	
 	QFutureWatcher<QSharedPointer<QByteArray> > mBufferWatcher;
 	QFutureWatcher<QSharedPointer<DkBasicLoader> > mImageWatcher;
+	QFutureWatcher<QSharedPointer<DkBasicLoader> > mPreviewWatcher;
 	QFutureWatcher<QString> mSaveImageWatcher;
 	QFutureWatcher<bool> mSaveMetaDataWatcher;
 
@@ -227,6 +248,8 @@ protected:
 	bool mFetchingImage = false;
 	bool mFetchingBuffer = false;
 	bool mDownloaded = false;
+	QSize mPreviewSize;		// if valid, a down-scaled preview is shown while loading
+	bool mShowsPreview = false;	// true while the preview's loader is swapped in
 
 	QTimer mFileUpdateTimer;
 };
@@ -40,11 +40,13 @@
 #include "DkUtils.h"
 #include "DkStatusBar.h"
 #include "DkActionManager.h"
+#include "DkDirWatcher.h"
+#include "DkDirScanner.h"
+#include "DkFolderTree.h"
 
 #pragma warning(push, 0)	// no warnings from includes - begin
 #include <QWidget>
 #include <QImageWriter>
-#include <QFileSystemWatcher>
 #include <QFileInfo>
 #include <QFile>
 #include <QSettings>
@@ -71,6 +73,7 @@
 #include <QPluginLoader>
 #include <QFileDialog>
 #include <QPainter>
+#include <QSet>
 #include <qmath.h>
 #include <QtConcurrentRun>
 
@@ -97,6 +100,340 @@
 
 namespace nmc {
 
+// DkPrefetcher --------------------------------------------------------------------
+DkPrefetcher::DkPrefetcher() {
+	mStepTimer.start();
+}
+
+/**
+ * Updates the prefetch window.
+ * The window is predicted from the current index, the navigation direction,
+ * the stride (the user might jump) and the navigation speed. Images close to
+ * the current one are fully decoded, the others just fetched to memory.
+ * Stale requests are canceled & the LRU is evicted if the budget is exceeded.
+ * Only the images of the window are materialized.
+ * @param images the index of the current folder.
+ * @param cIdx the index of the current image.
+ **/
+void DkPrefetcher::update(const DkFolderIndex& images, int cIdx) {
+
+	if (cIdx < 0 || cIdx >= images.size())
+		return;
+
+	DkTimer dt;
+	float budget = DkSettingsManager::param().resources().cacheMemory;
+
+	updateVelocity(cIdx, images.size());
+
+	QVector<int> window = predictWindow(cIdx, images.size());
+	QVector<QSharedPointer<DkImageContainerT> > windowImages;
+
+	// decode the first images of the window - if the user is fast (or a slideshow is running) we decode more
+	int numDecode = (mSlideshow || mVelocity > 2.0) ? 3 : 2;
+	if (mVelocity > 8.0)	// the user holds the key - decoding would just waste cpu
+		numDecode = 1;
+
+	float mem = 0;
+
+	for (int idx = 0; idx < window.size(); idx++) {
+
+		QSharedPointer<DkImageContainerT> imgC = images.at(window[idx]);
+
+		if (!imgC)
+			continue;
+
+		windowImages << imgC;
+		touch(imgC);
+
+		// the current image is handled by the loader
+		if (idx == 0) {
+			mem += imgC->getMemoryUsage();
+			continue;
+		}
+
+		// estimate what we are going to need
+		float imgMem = (imgC->getLoadState() == DkImageContainerT::not_loaded) ? imgC->getFileSize() : imgC->getMemoryUsage();
+
+		if (mem + imgMem > budget)
+			break;
+
+		mem += imgMem;
+
+		if (imgC->getLoadState() != DkImageContainerT::not_loaded || imgC->isEdited())
+			continue;
+
+		if (idx <= numDecode) {
+			imgC->loadImageThreaded();
+			qDebug() << "[Cacher] " << imgC->filePath() << " fully cached...";
+		}
+		else {
+			imgC->fetchFile();
+			qDebug() << "[Cacher] " << imgC->filePath() << " file fetched...";
+		}
+	}
+
+	// the current image is the most recently used
+	touch(images.at(cIdx));
+
+	evict(windowImages, budget);
+
+	mLastIdx = cIdx;
+
+	qDebug() << "[Cacher] direction:" << mDirection << "stride:" << mStride << "velocity:" << mVelocity
+		<< "cache:" << cachedMemory() << "MB updated in:" << dt;
+}
+
+/**
+ * Accounts cache hits and misses.
+ * Call this function when an image is requested by the user.
+ * @param imgC the image requested.
+ **/
+void DkPrefetcher::registerRequest(QSharedPointer<DkImageContainerT> imgC) {
+
+	if (!imgC)
+		return;
+
+	if (imgC->hasImage())
+		mHits++;
+	else if (imgC->getLoadState() == DkImageContainerT::loading || imgC->hasFileBuffer())
+		mFileHits++;
+	else
+		mMisses++;
+}
+
+void DkPrefetcher::setSlideshow(bool playing) {
+	mSlideshow = playing;
+}
+
+/**
+ * Forgets about all cached images.
+ * The images are not released, since they might still be in use.
+ **/
+void DkPrefetcher::clear() {
+
+	mLru.clear();
+	mLruEntries.clear();
+	mLastIdx = -1;
+	mVelocity = 0.0;
+}
+
+/**
+ * Releases cached images if the memory manager needs memory.
+ * The least recently used images are released first, the current image is kept.
+ * @param mem the memory that should be released in MB
+ * @return float the memory released in MB.
+ **/
+float DkPrefetcher::release(float mem) {
+
+	float released = 0;
+	LruList::iterator it = mLru.end();
+
+	while (it != mLru.begin() && released < mem) {
+
+		--it;
+
+		// the current image is kept
+		if (it == mLru.begin())
+			break;
+
+		QSharedPointer<DkImageContainerT> imgC = *it;
+
+		// do not loose edits
+		if (imgC->isEdited())
+			continue;
+
+		released += imgC->getMemoryUsage();
+		imgC->clear();
+		it = remove(it);
+	}
+
+	return released;
+}
+
+int DkPrefetcher::hits() const {
+	return mHits;
+}
+
+int DkPrefetcher::fileHits() const {
+	return mFileHits;
+}
+
+int DkPrefetcher::misses() const {
+	return mMisses;
+}
+
+int DkPrefetcher::direction() const {
+	return mDirection;
+}
+
+int DkPrefetcher::stride() const {
+	return mStride;
+}
+
+double DkPrefetcher::velocity() const {
+	return mVelocity;
+}
+
+float DkPrefetcher::cachedMemory() const {
+
+	float mem = 0;
+
+	for (const QSharedPointer<DkImageContainerT>& imgC : mLru)
+		mem += imgC->getMemoryUsage();
+
+	return mem;
+}
+
+void DkPrefetcher::updateVelocity(int cIdx, int numImages) {
+
+	if (mLastIdx == -1 || mLastIdx == cIdx) {
+		mStepTimer.restart();
+		return;
+	}
+
+	int step = cIdx - mLastIdx;
+
+	// we looped the folder
+	if (qAbs(step) > numImages/2)
+		step += (step > 0) ? -numImages : numImages;
+
+	int dir = (step > 0) ? 1 : -1;
+	mDirectionChanged = dir != mDirection;
+	mDirection = dir;
+	mStride = qMax(qAbs(step), 1);
+
+	double elapsed = qMax(mStepTimer.restart(), (qint64)1)/1000.0;
+	double cVelocity = qAbs(step) / elapsed;
+
+	// reset if the user paused for a while
+	if (elapsed > 5.0)
+		mVelocity = cVelocity;
+	else
+		mVelocity = 0.7*mVelocity + 0.3*cVelocity;
+}
+
+/**
+ * Returns the indexes of the images which should be cached.
+ * The vector is sorted according to the priority (the current index is first).
+ **/
+QVector<int> DkPrefetcher::predictWindow(int cIdx, int numImages) const {
+
+	int numAhead = qMax(DkSettingsManager::param().resources().maxImagesCached, 1);
+
+	// look further ahead if the user is fast
+	numAhead += qMin(qRound(mVelocity), 3*numAhead);
+
+	// keep the image we came from - if the user is alternating, look back just as far
+	int numBehind = mDirectionChanged ? numAhead : 1;
+
+	bool loop = DkSettingsManager::param().global().loop;
+	QVector<int> window;
+	window << cIdx;
+
+	for (int idx = 1; idx <= qMax(numAhead, numBehind); idx++) {
+
+		int steps[2] = {mDirection*mStride*idx, -mDirection*mStride*idx};
+		int num[2] = {numAhead, numBehind};
+
+		for (int sIdx = 0; sIdx < 2; sIdx++) {
+
+			if (idx > num[sIdx])
+				continue;
+
+			int wIdx = cIdx + steps[sIdx];
+
+			if (loop)
+				wIdx = ((wIdx % numImages) + numImages) % numImages;
+
+			if (wIdx >= 0 && wIdx < numImages && !window.contains(wIdx))
+				window << wIdx;
+		}
+	}
+
+	return window;
+}
+
+/**
+ * Moves the image to the front of the LRU in constant time.
+ * @param imgC the image that was used.
+ **/
+void DkPrefetcher::touch(QSharedPointer<DkImageContainerT> imgC) {
+
+	if (!imgC)
+		return;
+
+	QHash<DkImageContainerT*, LruList::iterator>::const_iterator entry = mLruEntries.constFind(imgC.data());
+
+	if (entry != mLruEntries.constEnd()) {
+		mLru.splice(mLru.begin(), mLru, entry.value());
+	}
+	else {
+		mLru.push_front(imgC);
+		mLruEntries.insert(imgC.data(), mLru.begin());
+	}
+}
+
+/**
+ * Removes an entry from the LRU.
+ * @param it the entry
+ * @return LruList::iterator the next entry
+ **/
+DkPrefetcher::LruList::iterator DkPrefetcher::remove(LruList::iterator it) {
+
+	mLruEntries.remove(it->data());
+	return mLru.erase(it);
+}
+
+/**
+ * Releases least recently used images.
+ * Images outside the window are canceled if they are still loading.
+ * Edited images are released as soon as they are not current anymore.
+ * Entries that neither hold memory nor load are dropped, so that
+ * the LRU is bounded by the budget and the window - not the folder size.
+ **/
+void DkPrefetcher::evict(const QVector<QSharedPointer<DkImageContainerT> >& window, float budget) {
+
+	QSet<DkImageContainerT*> windowEntries;
+	for (const QSharedPointer<DkImageContainerT>& imgC : window)
+		windowEntries.insert(imgC.data());
+
+	float mem = 0;
+
+	for (LruList::iterator it = mLru.begin(); it != mLru.end();) {
+
+		QSharedPointer<DkImageContainerT> imgC = *it;
+
+		// the current image is never released
+		if (!window.empty() && imgC == window.first()) {
+			mem += imgC->getMemoryUsage();
+			++it;
+			continue;
+		}
+
+		bool inWindow = windowEntries.contains(imgC.data());
+		bool busy = imgC->getLoadState() == DkImageContainerT::loading || imgC->isFetching();
+		float imgMem = imgC->getMemoryUsage();
+
+		if ((!inWindow && busy) ||
+			imgC->isEdited() ||
+			mem + imgMem > budget) {
+
+			imgC->clear();
+			it = remove(it);
+			continue;
+		}
+
+		// nothing to release - it is touched again if it enters the window
+		if (!inWindow && !busy && imgMem <= 0) {
+			it = remove(it);
+			continue;
+		}
+
+		mem += imgMem;
+		++it;
+	}
+}
+
 // DkImageLoader -> is nomacs file handling routine --------------------------------------------------------------------
 /**
  * Default constructor.
@@ -107,13 +444,17 @@ DkImageLoader::DkImageLoader(const QString& filePath) {
 
 	qRegisterMetaType<QFileInfo>("QFileInfo");
 
-	mDirWatcher = new QFileSystemWatcher(this);
-	connect(mDirWatcher, SIGNAL(directoryChanged(QString)), this, SLOT(directoryChanged(QString)));
+	mFolderTree = new DkFolderTree(this);
+
+	mDirWatcher = new DkDirWatcher(this);
+	connect(mDirWatcher, SIGNAL(directoryChanged(const QString&)), this, SLOT(directoryChanged(const QString&)));
+	connect(mDirWatcher, SIGNAL(filesChanged(const QStringList&, const QStringList&)), this, SLOT(filesChanged(const QStringList&, const QStringList&)));
 
 	mSortingIsDirty = false;
 	mSortingImages = false;
 
 	connect(&mCreateImageWatcher, SIGNAL(finished()), this, SLOT(imagesSorted()));
+	connect(&mDirScanWatcher, SIGNAL(finished()), this, SLOT(dirScanned()));
 
 	mDelayedUpdateTimer.setSingleShot(true);
 	connect(&mDelayedUpdateTimer, SIGNAL(timeout()), this, SLOT(directoryChanged()));
@@ -121,6 +462,12 @@ DkImageLoader::DkImageLoader(const QString& filePath) {
 	connect(DkActionManager::instance().action(DkActionManager::menu_edit_undo), SIGNAL(triggered()), this, SLOT(undo()));
 	connect(DkActionManager::instance().action(DkActionManager::menu_edit_redo), SIGNAL(triggered()), this, SLOT(redo()));
 
+	DkMemoryManager& mm = DkMemoryManager::instance();
+	mm.registerClient(this, DkMemoryManager::mem_cache, DkMemoryManager::priority_low);
+	mm.registerClient(this, DkMemoryManager::mem_scaled, DkMemoryManager::priority_low);
+	mm.registerClient(this, DkMemoryManager::mem_thumbs, DkMemoryManager::priority_medium);
+	mm.registerClient(this, DkMemoryManager::mem_history, DkMemoryManager::priority_high);
+
 	//saveDir = DkSettingsManager::param().global().lastSaveDir;	// loading save dir is obsolete ?!
 	 
 	QFileInfo fInfo(filePath);
@@ -136,10 +483,120 @@ DkImageLoader::DkImageLoader(const QString& filePath) {
  **/ 
 DkImageLoader::~DkImageLoader() {
 	
+	DkMemoryManager::instance().unregisterClient(this);
+	stopDirScan();
+
 	if (mCreateImageWatcher.isRunning())
 		mCreateImageWatcher.blockSignals(true);
 }
 
+float DkImageLoader::memoryUsage(int subsystem) const {
+
+	if (subsystem == DkMemoryManager::mem_cache)
+		return mPrefetcher.cachedMemory();
+
+	float mem = 0;
+
+	for (const QSharedPointer<DkImageContainerT>& imgC : releaseOrder()) {
+
+		switch (subsystem) {
+		case DkMemoryManager::mem_history:
+			if (imgC->hasImage())
+				mem += imgC->getLoader()->historyMemory();
+			break;
+		case DkMemoryManager::mem_scaled:
+			mem += imgC->getScaledMemoryUsage();
+			break;
+		case DkMemoryManager::mem_thumbs:
+			mem += imgC->getThumbMemoryUsage();
+			break;
+		}
+	}
+
+	return mem;
+}
+
+/**
+ * Releases memory of the images in this folder.
+ * Images far away from the current image are released first.
+ * @param subsystem the subsystem (see DkMemoryManager::Subsystem)
+ * @param mem the memory that should be released in MB
+ * @return float the memory released in MB.
+ **/
+float DkImageLoader::releaseMemory(int subsystem, float mem) {
+
+	if (subsystem == DkMemoryManager::mem_cache)
+		return mPrefetcher.release(mem);
+
+	float released = 0;
+
+	for (const QSharedPointer<DkImageContainerT>& imgC : releaseOrder()) {
+
+		if (released >= mem)
+			break;
+
+		switch (subsystem) {
+		case DkMemoryManager::mem_history:
+			// do not touch images that are currently loaded
+			if (imgC->hasImage() && imgC->getLoadState() == DkImageContainerT::loaded)
+				released += imgC->getLoader()->releaseHistory(mem - released);
+			break;
+		case DkMemoryManager::mem_scaled:
+			released += imgC->getScaledMemoryUsage();
+			imgC->clearScaledImages();
+			break;
+		case DkMemoryManager::mem_thumbs:
+			released += imgC->getThumbMemoryUsage();
+			imgC->releaseThumb();
+			break;
+		}
+	}
+
+	return released;
+}
+
+/**
+ * Returns all materialized images sorted by their distance to the current image (descending).
+ * The current image is always last.
+ **/
+QVector<QSharedPointer<DkImageContainerT> > DkImageLoader::releaseOrder() const {
+
+	int cIdx = mCurrentImage ? mImages->indexOf(mCurrentImage) : -1;
+
+	// only materialized images hold memory - large folders are not walked
+	QVector<QSharedPointer<DkImageContainerT> > images = mImages->materialized();
+	QVector<int> fileIdx(images.size());
+	QVector<int> order(images.size());
+
+	for (int idx = 0; idx < images.size(); idx++) {
+		fileIdx[idx] = mImages->indexOf(images.at(idx));
+		order[idx] = idx;
+	}
+
+	// farthest first - left before right if both are equally far (folder order if there is no current image)
+	qSort(order.begin(), order.end(), [&](int l, int r) {
+		int lDist = (cIdx == -1) ? 0 : qAbs(fileIdx[l] - cIdx);
+		int rDist = (cIdx == -1) ? 0 : qAbs(fileIdx[r] - cIdx);
+		if (lDist != rDist)
+			return lDist > rDist;
+		return fileIdx[l] < fileIdx[r];
+	});
+
+	QVector<QSharedPointer<DkImageContainerT> > sorted;
+	sorted.reserve(images.size()+1);
+
+	for (int idx : order)
+		sorted << images.at(idx);
+
+	images = sorted;
+
+	// edited images might not be part of the folder
+	if (mCurrentImage && cIdx == -1)
+		images << mCurrentImage;
+
+	return images;
+}
+
 /**
  * Clears the path.
  * Calling this method makes the loader forget
@@ -152,7 +609,7 @@ void DkImageLoader::clearPath() {
 	if (mCurrentImage && mCurrentImage->exists()) {
 		mCurrentImage->receiveUpdates(this, false);
 		mLastImageLoaded = mCurrentImage;
-		mImages.clear();
+		clearImages();
 	}
 
 	mCurrentImage.clear();
@@ -220,17 +677,27 @@ bool DkImageLoader::loadDir(const QString& newDirPath, bool scanRecursive) {
 	//}
 
 	DkTimer dt;
+
+	if (mDirScanning) {
+
+		// the folder is listed right now
+		if (newDirPath == mCurrentDir && !mFolderUpdated)
+			return true;
+
+		stopDirScan();
+	}
 	
 	// folder changed signal was emitted
 	if (mFolderUpdated && newDirPath == mCurrentDir) {
 		
 		mFolderUpdated = false;
-		QFileInfoList files = getFilteredFileInfoList(newDirPath, mIgnoreKeywords, mKeywords, mFolderFilterString);		// this line takes seconds if you have lots of files and slow loading (e.g. network)
+		QHash<QString, QStringList> alternates;
+		QFileInfoList files = getFilteredFileInfoList(newDirPath, mIgnoreKeywords, mKeywords, mFolderFilterString, &alternates);		// this line takes seconds if you have lots of files and slow loading (e.g. network)
 
 		// might get empty too (e.g. someone deletes all images)
  		if (files.empty()) {
 			emit showInfoSignal(tr("%1 \n does not contain any image").arg(newDirPath), 4000);	// stop showing
-			mImages.clear();
+			clearImages();
 			emit updateDirSignal(mImages);
 			return false;
 		}
@@ -241,14 +708,15 @@ bool DkImageLoader::loadDir(const QString& newDirPath, bool scanRecursive) {
 		//	sortImagesThreaded(images);
 		//}
 		//else
-			createImages(files, true);
+			createImages(files, true, alternates);
 
 		qDebug() << "getting file list.....";
 	}
 	// new folder is loaded
-	else if ((newDirPath != mCurrentDir || mImages.empty()) && !newDirPath.isEmpty() && QDir(newDirPath).exists()) {
+	else if ((newDirPath != mCurrentDir || mImages->empty()) && !newDirPath.isEmpty() && QDir(newDirPath).exists()) {
 
 		QFileInfoList files;
+		QHash<QString, QStringList> alternates;
 
 		//newDir.setNameFilters(DkSettingsManager::param().app().fileFilters);
 		//newDir.setSorting(QDir::LocaleAware);		// TODO: extend
@@ -260,9 +728,9 @@ bool DkImageLoader::loadDir(const QString& newDirPath, bool scanRecursive) {
 		mFolderFilterString.clear();	// delete key words -> otherwise user may be confused
 
 		if (scanRecursive && DkSettingsManager::param().global().scanSubFolders)
-			files = updateSubFolders(mCurrentDir);
+			files = updateSubFolders(mCurrentDir, &alternates);
 		else 
-			files = getFilteredFileInfoList(mCurrentDir, mIgnoreKeywords, mKeywords, mFolderFilterString);		// this line takes seconds if you have lots of files and slow loading (e.g. network)
+			files = getFilteredFileInfoList(mCurrentDir, mIgnoreKeywords, mKeywords, mFolderFilterString, &alternates);		// this line takes seconds if you have lots of files and slow loading (e.g. network)
 
 		if (files.empty()) {
 			emit showInfoSignal(tr("%1 \n does not contain any image").arg(mCurrentDir), 4000);	// stop showing
@@ -270,7 +738,9 @@ bool DkImageLoader::loadDir(const QString& newDirPath, bool scanRecursive) {
 		}
 
 		// ok new folder, this should speed-up loading
-		mImages.clear();
+		clearImages();
+		mPrefetcher.clear();
+		mCacheIdx = -1;
 		
 		//// TODO: creating ~120 000 images takes about 2 secs
 		//// but sorting (just filenames) takes ages (on windows)
@@ -282,17 +752,224 @@ bool DkImageLoader::loadDir(const QString& newDirPath, bool scanRecursive) {
 		//	sortImagesThreaded(mImages);
 		//}
 		//else
-			createImages(files, true);
+			createImages(files, true, alternates);
 
-		qInfoClean() << newDirPath << " [" << mImages.size() << "] loaded in " << dt;
+		qInfoClean() << newDirPath << " [" << mImages->size() << "] loaded in " << dt;
 	}
 	//else
 	//	qDebug() << "ignoring... old dir: " << dir.absolutePath() << " newDir: " << newDir << " file size: " << images.size();
 
+	// we just listed this folder - keep the folder tree up-to-date
+	if (mKeywords.empty() && mIgnoreKeywords.empty() && mFolderFilterString.isEmpty())
+		mFolderTree->setNumImages(mCurrentDir, mImages->size());
+
 	return true;
 }
 
-void DkImageLoader::sortImagesThreaded(QVector<QSharedPointer<DkImageContainerT > > images) {
+/**
+ * Loads a directory without blocking.
+ * The folder is listed in a thread. The files arrive in sorted batches which
+ * are merged into the index, so the current image is shown (and browsing
+ * is possible) while a large (or remote) folder is still listed.
+ * Sub folder scans and folder updates are loaded synchronously (see loadDir).
+ * @param newDirPath the directory to be loaded.
+ * @return bool false if the directory does not exist.
+ **/
+bool DkImageLoader::loadDirAsync(const QString& newDirPath) {
+
+	if (DkSettingsManager::param().global().scanSubFolders || mFolderUpdated || 
+		(newDirPath == mCurrentDir && (!mImages->empty() || mDirScanning)))
+		return loadDir(newDirPath);
+
+	if (newDirPath.isEmpty() || !QDir(newDirPath).exists())
+		return false;
+
+	stopDirScan();
+
+	mCurrentDir = newDirPath;
+	mFolderFilterString.clear();	// delete key words -> otherwise user may be confused
+
+	clearImages();
+	mPrefetcher.clear();
+	mCacheIdx = -1;
+
+	// the folder is watched once it is listed
+	if (mDirWatcher)
+		mDirWatcher->setDirPath(QString());
+
+	QStringList preferredSuffixes;
+	if (DkSettingsManager::param().resources().filterDuplicats)
+		preferredSuffixes = preferredExtensions();
+
+	mDirScanning = true;
+	mDirScanAbort.storeRelease(0);
+	mDirUpdateTimer.invalidate();
+	mDirScanWatcher.setFuture(QtConcurrent::run(this, &DkImageLoader::scanDirThreaded, 
+		newDirPath, DkSettingsManager::param().app().browseFilters, DkKeywordFilter(mKeywords, mIgnoreKeywords), preferredSuffixes));
+
+	return true;
+}
+
+/**
+ * Lists a folder and publishes the files in sorted batches (runs in a thread).
+ * @param dirPath the folder.
+ * @param nameFilters the browse filters.
+ * @param filter the keyword filter.
+ * @param preferredSuffixes if not empty, duplicates are filtered - then all files are published at once.
+ **/
+void DkImageLoader::scanDirThreaded(const QString& dirPath, const QStringList& nameFilters, const DkKeywordFilter& filter, const QStringList& preferredSuffixes) {
+
+	DkTimer dt;
+
+	DkDirScanner scanner(nameFilters);
+	QStringList fileNames;
+
+	scanner.scan(dirPath, [&](const QStringList& batch) {
+
+		if (mDirScanAbort.loadAcquire())
+			return false;
+
+		// duplicates can only be found if all files are known
+		if (!preferredSuffixes.empty())
+			fileNames << batch;
+		else
+			publishDirBatch(dirPath, filter.filter(batch));
+
+		return true;
+	});
+
+	if (!preferredSuffixes.empty() && !mDirScanAbort.loadAcquire()) {
+
+		QHash<QString, QStringList> duplicates;
+		fileNames = filterDuplicates(filter.filter(fileNames), preferredSuffixes, &duplicates);
+		publishDirBatch(dirPath, fileNames, duplicates);
+	}
+
+	qInfoClean() << dirPath << " listed in " << dt;
+}
+
+/**
+ * Indexes & sorts a batch of files and hands it over to the main thread.
+ * This function is called from the listing thread.
+ **/
+void DkImageLoader::publishDirBatch(const QString& dirPath, const QStringList& fileNames, const QHash<QString, QStringList>& duplicates) {
+
+	if (fileNames.empty())
+		return;
+
+	QFileInfoList files;
+	files.reserve(fileNames.size());
+
+	for (const QString& fileName : fileNames)
+		files << QFileInfo(dirPath, fileName);
+
+	// the file attributes are read here - not in the main thread
+	QSharedPointer<DkFolderIndex> batch(new DkFolderIndex(files));
+
+	QHash<QString, QStringList> alternates;
+	for (auto it = duplicates.constBegin(); it != duplicates.constEnd(); ++it) {
+
+		QStringList paths;
+		for (const QString& fileName : it.value())
+			paths << QFileInfo(dirPath, fileName).absoluteFilePath();
+
+		alternates.insert(QFileInfo(dirPath, it.key()).absoluteFilePath(), paths);
+	}
+
+	batch->setAlternates(alternates);
+	batch->sort();
+
+	mDirBatchMutex.lock();
+	mDirBatches << batch;
+	mDirBatchMutex.unlock();
+
+	QMetaObject::invokeMethod(this, "mergeDirBatches", Qt::QueuedConnection);
+}
+
+/**
+ * Merges the batches of the folder that is listed into the index.
+ * The consumers of updateDirSignal are notified at most every dir_update_interval ms.
+ **/
+void DkImageLoader::mergeDirBatches() {
+
+	QList<QSharedPointer<DkFolderIndex> > batches;
+
+	mDirBatchMutex.lock();
+	batches.swap(mDirBatches);
+	mDirBatchMutex.unlock();
+
+	if (batches.empty() || !mDirScanning)
+		return;
+
+	// others might still hold the current index
+	QSharedPointer<DkFolderIndex> images(new DkFolderIndex(*mImages));
+
+	for (const QSharedPointer<DkFolderIndex>& batch : batches)
+		images->merge(*batch);
+
+	images->adopt(mCurrentImage);
+	mImages = images;
+
+	if (!mDirUpdateTimer.isValid() || mDirUpdateTimer.elapsed() > dir_update_interval) {
+		emit updateDirSignal(mImages);
+		mDirUpdateTimer.restart();
+	}
+}
+
+void DkImageLoader::dirScanned() {
+
+	if (!mDirScanning)
+		return;
+
+	mergeDirBatches();
+	mDirScanning = false;
+
+	if (mImages->empty())
+		emit showInfoSignal(tr("%1 \n does not contain any image").arg(mCurrentDir), 4000);	// stop showing
+
+	emit updateDirSignal(mImages);
+
+	if (mDirWatcher)
+		mDirWatcher->setDirPath(mCurrentDir);
+
+	// we just listed this folder - keep the folder tree up-to-date
+	if (mKeywords.empty() && mIgnoreKeywords.empty())
+		mFolderTree->setNumImages(mCurrentDir, mImages->size());
+
+	qInfoClean() << mCurrentDir << " [" << mImages->size() << "] loaded";
+}
+
+/**
+ * Blocks until the folder is listed completely.
+ * This is needed if the final index is needed (e.g. to jump to the last file).
+ **/
+void DkImageLoader::finishDirScan() {
+
+	if (!mDirScanning)
+		return;
+
+	mDirScanWatcher.waitForFinished();
+	dirScanned();
+}
+
+/**
+ * Cancels the folder listing (if any).
+ **/
+void DkImageLoader::stopDirScan() {
+
+	if (!mDirScanning)
+		return;
+
+	mDirScanAbort.storeRelease(1);
+	mDirScanWatcher.waitForFinished();
+	mDirScanning = false;
+
+	mDirBatchMutex.lock();
+	mDirBatches.clear();
+	mDirBatchMutex.unlock();
+}
+
+void DkImageLoader::sortImagesThreaded(QSharedPointer<DkFolderIndex> images) {
 
 	if (mSortingImages) {
 		mSortingIsDirty = true;
@@ -301,8 +978,7 @@ void DkImageLoader::sortImagesThreaded(QVector<QSharedPointer<DkImageContainerT
 
 	mSortingIsDirty = false;
 	mSortingImages = true;
-	mCreateImageWatcher.setFuture(QtConcurrent::run(this, 
-		&nmc::DkImageLoader::sortImages, images));
+	mCreateImageWatcher.setFuture(QtConcurrent::run(&nmc::DkImageLoader::sortImages, images));
 
 	qDebug() << "sorting images threaded...";
 }
@@ -310,7 +986,6 @@ void DkImageLoader::sortImagesThreaded(QVector<QSharedPointer<DkImageContainerT
 void DkImageLoader::imagesSorted() {
 
 	mSortingImages = false;
-	mImages = mCreateImageWatcher.result();
 
 	if (mSortingIsDirty) {
 		qDebug() << "re-sorting because it's dirty...";
@@ -318,55 +993,67 @@ void DkImageLoader::imagesSorted() {
 		return;
 	}
 
+	// the index might have been replaced in the meantime
+	QVector<int> order = mCreateImageWatcher.result();
+	if (order.size() != mImages->size()) {
+		sortImagesThreaded(mImages);
+		return;
+	}
+
+	mImages->permute(order);
 	emit updateDirSignal(mImages);
 
-	if (mDirWatcher) {
-		if (!mDirWatcher->directories().isEmpty())
-			mDirWatcher->removePaths(mDirWatcher->directories());
-		mDirWatcher->addPath(mCurrentDir);
-	}
+	if (mDirWatcher)
+		mDirWatcher->setDirPath(mCurrentDir);
 
 	qDebug() << "images sorted...";
 }
 
-void DkImageLoader::createImages(const QFileInfoList& files, bool sort) {
+/**
+ * Indexes the files of the current folder.
+ * No image container is created here - they are materialized
+ * by the index if an image is viewed, prefetched or thumbnailed.
+ * Containers of the old index are kept if their files did not change.
+ * @param files the files of the current folder.
+ * @param sort if true, the index is sorted and published.
+ * @param alternates the duplicates that were filtered per file.
+ **/
+void DkImageLoader::createImages(const QFileInfoList& files, bool sort, const QHash<QString, QStringList>& alternates) {
 
-	// TODO: change files to QStringList
 	DkTimer dt;
-	QVector<QSharedPointer<DkImageContainerT > > oldImages = mImages;
-	mImages.clear();
-
-	for (int idx = 0; idx < files.size(); idx++) {
+	QSharedPointer<DkFolderIndex> oldImages = mImages;
 
-		int oIdx = findFileIdx(files.at(idx).absoluteFilePath(), oldImages);
+	mImages = QSharedPointer<DkFolderIndex>(new DkFolderIndex(files));
+	mImages->setAlternates(alternates);
+	mImages->adopt(*oldImages);
+	mImages->adopt(mCurrentImage);
 
-		if (oIdx != -1 && QFileInfo(oldImages.at(oIdx)->filePath()).lastModified() == files.at(idx).lastModified())
-			mImages.append(oldImages.at(oIdx));
-		else
-			mImages.append(QSharedPointer<DkImageContainerT >(new DkImageContainerT(files.at(idx).absoluteFilePath())));
-	}
-	qDebugClean() << "[DkImageLoader] " << mImages.size() << " containers created in " << dt;
+	qDebugClean() << "[DkImageLoader] " << mImages->size() << " files indexed (" << mImages->numMaterialized() << " containers kept) in " << dt;
 
 	if (sort) {
-		qSort(mImages.begin(), mImages.end(), imageContainerLessThanPtr);
+		mImages->sort();
 		qDebug() << "[DkImageLoader] after sorting: " << dt;
 
 		emit updateDirSignal(mImages);
 
-		if (mDirWatcher) {
-			if (!mDirWatcher->directories().isEmpty())
-				mDirWatcher->removePaths(mDirWatcher->directories());
-			mDirWatcher->addPath(mCurrentDir);
-		}
+		if (mDirWatcher)
+			mDirWatcher->setDirPath(mCurrentDir);
 	}
 
 }
 
-QVector<QSharedPointer<DkImageContainerT > > DkImageLoader::sortImages(QVector<QSharedPointer<DkImageContainerT > > images) const {
+/**
+ * Forgets the current index.
+ * A new (empty) index is created since others might still hold the old one.
+ **/
+void DkImageLoader::clearImages() {
 
-	qSort(images.begin(), images.end(), imageContainerLessThanPtr);
+	mImages = QSharedPointer<DkFolderIndex>(new DkFolderIndex());
+}
 
-	return images;
+QVector<int> DkImageLoader::sortImages(QSharedPointer<DkFolderIndex> images) {
+
+	return images->sortOrder();
 }
 
 /**
@@ -423,6 +1110,10 @@ QSharedPointer<DkImageContainerT> DkImageLoader::getSkippedImage(int skipIdx, bo
 	if (!recursive)
 		loadDir(mCurrentImage->dirPath(), false);
 
+	// the current image is not indexed yet
+	if (mDirScanning && currentIdx(mCurrentImage) == -1)
+		finishDirScan();
+
 	// locate the current file
 	int newFileIdx = 0;
 	
@@ -437,21 +1128,16 @@ QSharedPointer<DkImageContainerT> DkImageLoader::getSkippedImage(int skipIdx, bo
 
 		QString file = (mCurrentImage->exists()) ? mCurrentImage->filePath() : mCurrentDir;
 
-		mTmpFileIdx = findFileIdx(file, mImages);
+		mTmpFileIdx = findFileIdx(file);
 
 		// could not locate the file -> it was deleted?!
 		if (mTmpFileIdx == -1) {
 
-			mTmpFileIdx = 0;
-			for (; mTmpFileIdx < mImages.size(); mTmpFileIdx++) {
-
-				if (*(mCurrentImage.data()) < *(mImages[mTmpFileIdx].data()))
-					break;
-			}
+			mTmpFileIdx = mImages->upperBound(mCurrentImage->fileInfo());
 
 			if (skipIdx > 0)
 				mTmpFileIdx--;	// -1 because the current file does not exist
-			if (mImages.size() == mTmpFileIdx)	// could not locate file - resize
+			if (mImages->size() == mTmpFileIdx)	// could not locate file - resize
 				mTmpFileIdx = 0;
 
 		}		
@@ -461,17 +1147,9 @@ QSharedPointer<DkImageContainerT> DkImageLoader::getSkippedImage(int skipIdx, bo
 
 	//qDebug() << "subfolders: " << DkSettingsManager::param().global().scanSubFolders << "subfolder size: " << (subFolders.size() > 1);
 
-	if (DkSettingsManager::param().global().scanSubFolders && mSubFolders.size() > 1 && (newFileIdx < 0 || newFileIdx >= mImages.size())) {
+	if (DkSettingsManager::param().global().scanSubFolders && mFolderTree->size() > 1 && (newFileIdx < 0 || newFileIdx >= mImages->size())) {
 
-		int folderIdx = 0;
-
-		// locate folder
-		for (int idx = 0; idx < mSubFolders.size(); idx++) {
-			if (mSubFolders[idx] == mCurrentDir) {
-				folderIdx = idx;
-				break;
-			}
-		}
+		int folderIdx = qMax(mFolderTree->indexOf(mCurrentDir), 0);
 
 		if (newFileIdx < 0)
 			folderIdx = getPrevFolderIdx(folderIdx);
@@ -483,11 +1161,11 @@ QSharedPointer<DkImageContainerT> DkImageLoader::getSkippedImage(int skipIdx, bo
 		//if (DkSettingsManager::param().global().loop)
 		//	folderIdx %= subFolders.size();
 
-		if (folderIdx >= 0 && folderIdx < mSubFolders.size()) {
+		if (folderIdx >= 0 && folderIdx < mFolderTree->size()) {
 				
-			int oldFileSize = mImages.size();
-			loadDir(mSubFolders[folderIdx], false);	// don't scan recursive again
-			qDebug() << "loading new folder: " << mSubFolders[folderIdx];
+			int oldFileSize = mImages->size();
+			loadDir(mFolderTree->folder(folderIdx), false);	// don't scan recursive again
+			qDebug() << "loading new folder: " << mFolderTree->folder(folderIdx);
 
 			if (newFileIdx >= oldFileSize) {
 				newFileIdx -= oldFileSize;
@@ -497,7 +1175,7 @@ QSharedPointer<DkImageContainerT> DkImageLoader::getSkippedImage(int skipIdx, bo
 			}
 			else if (newFileIdx < 0) {
 				newFileIdx += mTmpFileIdx;
-				mTmpFileIdx = mImages.size()-1;
+				mTmpFileIdx = mImages->size()-1;
 				qDebug() << "new skip idx: " << newFileIdx << "cFileIdx: " << mTmpFileIdx << " -----------------------------";
 				getSkippedImage(newFileIdx, false, true);
 			}
@@ -520,30 +1198,30 @@ QSharedPointer<DkImageContainerT> DkImageLoader::getSkippedImage(int skipIdx, bo
 	}
 
 #ifdef WITH_QUAZIP
-	if (mCurrentImage && (newFileIdx < 0 || newFileIdx >= mImages.size()) && mCurrentImage->isFromZip() && mCurrentImage->getZipData()) {
+	if (mCurrentImage && (newFileIdx < 0 || newFileIdx >= mImages->size()) && mCurrentImage->isFromZip() && mCurrentImage->getZipData()) {
 
 		// load the zip again and go on from there
 		setCurrentImage(QSharedPointer<DkImageContainerT>(new DkImageContainerT(mCurrentImage->getZipData()->getZipFilePath())));
 
-		if (newFileIdx >= mImages.size())
-			newFileIdx -= mImages.size() - 1;
+		if (newFileIdx >= mImages->size())
+			newFileIdx -= mImages->size() - 1;
 
 		return getSkippedImage(newFileIdx);
 	}
 #endif
 
 	// this should never happen!
-	if (mImages.empty()) {
+	if (mImages->empty()) {
 		qDebug() << "file list is empty, where it should not be";
 		return imgC;
 	}
 
 	// loop the directory
 	if (DkSettingsManager::param().global().loop) {
-		newFileIdx %= mImages.size();
+		newFileIdx %= mImages->size();
 
 		while (newFileIdx < 0)	// should be hit once
-			newFileIdx = mImages.size() + newFileIdx;
+			newFileIdx = mImages->size() + newFileIdx;
 
 	}
 	// clip to pos1 if skipIdx < -1
@@ -551,8 +1229,8 @@ QSharedPointer<DkImageContainerT> DkImageLoader::getSkippedImage(int skipIdx, bo
 		newFileIdx = 0;
 	}
 	// clip to end if skipIdx > 1
-	else if (mTmpFileIdx < mImages.size()-1 && newFileIdx >= mImages.size()) {
-		newFileIdx = mImages.size()-1;
+	else if (mTmpFileIdx < mImages->size()-1 && newFileIdx >= mImages->size()) {
+		newFileIdx = mImages->size()-1;
 	}
 	// tell user that there is nothing left to display
 	else if (newFileIdx < 0) {
@@ -563,7 +1241,7 @@ QSharedPointer<DkImageContainerT> DkImageLoader::getSkippedImage(int skipIdx, bo
 		return imgC;
 	}
 	// tell user that there is nothing left to display
-	else if (newFileIdx >= mImages.size()) {
+	else if (newFileIdx >= mImages->size()) {
 		QString msg = tr("You have reached the end");
 			
 		if (!DkSettingsManager::param().global().loop)
@@ -575,8 +1253,8 @@ QSharedPointer<DkImageContainerT> DkImageLoader::getSkippedImage(int skipIdx, bo
 
 	mTmpFileIdx = newFileIdx;
 
-	if (newFileIdx >= 0 && newFileIdx < mImages.size())
-		imgC = mImages.at(newFileIdx);
+	if (newFileIdx >= 0 && newFileIdx < mImages->size())
+		imgC = mImages->at(newFileIdx);
 
 
 	// file requested becomes current file
@@ -599,24 +1277,27 @@ void DkImageLoader::loadFileAt(int idx) {
 	else
 		qDebug() << "current image is NULL";
 
+	// we need the final index here
+	finishDirScan();
+
 	QDir cDir(mCurrentDir);
 
 	if (mCurrentImage && !cDir.exists())
 		loadDir(mCurrentImage->dirPath());
 
-	if(mImages.empty())
+	if(mImages->empty())
 		return;
 
 	if (cDir.exists()) {
 
 		if (idx == -1) {
-			idx = mImages.size()-1;
+			idx = mImages->size()-1;
 		}
 		else if (DkSettingsManager::param().global().loop) {
-			idx %= mImages.size();
+			idx %= mImages->size();
 
 			while (idx < 0)
-				idx = mImages.size() + idx;
+				idx = mImages->size() + idx;
 
 		}
 		else if (idx < 0 && !DkSettingsManager::param().global().loop) {
@@ -624,7 +1305,7 @@ void DkImageLoader::loadFileAt(int idx) {
 			emit showInfoSignal(msg, 1000);
 			return;
 		}
-		else if (idx >= mImages.size()) {
+		else if (idx >= mImages->size()) {
 			QString msg = tr("You have reached the end");
 			if (!DkSettingsManager::param().global().loop)
 				emit(setPlayer(false));
@@ -634,7 +1315,7 @@ void DkImageLoader::loadFileAt(int idx) {
 	}
 
 	// file requested becomes current file
-	setCurrentImage(mImages.at(idx));
+	setCurrentImage(mImages->at(idx));
 
 	load(mCurrentImage);
 }
@@ -651,61 +1332,35 @@ QSharedPointer<DkImageContainerT> DkImageLoader::findOrCreateFile(const QString&
 
 QSharedPointer<DkImageContainerT> DkImageLoader::findFile(const QString& filePath) const {
 
-	// if one image is from zip than all should be
-	// for images in zip the "images[idx]->file() == file" comparison somahow does not work
-	if(mImages.size() > 0) {
-
-		if (mImages[0]->isFromZip()) {
-			int idx = findFileIdx(filePath, mImages);
-			if (idx < 0) 
-				return QSharedPointer<DkImageContainerT>();
-			else 
-				return mImages[idx];
-		}
-	}
-
-	for (int idx = 0; idx < mImages.size(); idx++) {
-
-		if (mImages[idx]->filePath() == filePath)
-			return mImages[idx];
-	}
-
-	return QSharedPointer<DkImageContainerT>();
+	// materializes the container if the file is indexed
+	return mImages->at(findFileIdx(filePath));
 }
 
-int DkImageLoader::findFileIdx(const QString& filePath, const QVector<QSharedPointer<DkImageContainerT> >& images) const {
+int DkImageLoader::findFileIdx(const QString& filePath) const {
 
-	// this seems a bit bizare...
-	// however, in converting the string from a fileInfo - we quarantee that the separators are the same (/ vs \)
-	QString lFilePath = filePath;
-	lFilePath.replace("\\", QDir::separator());
-
-	for (int idx = 0; idx < images.size(); idx++) {
-
-		if (images[idx]->filePath() == lFilePath)
-			return idx;
-	}
-
-	return -1;
+	return mImages->indexOf(filePath);
 }
 
 QStringList DkImageLoader::getFileNames() const {
 
 	QStringList fileNames;
 
-	for (int idx = 0; idx < mImages.size(); idx++)
-		fileNames.append(QFileInfo(mImages[idx]->filePath()).fileName());
+	for (int idx = 0; idx < mImages->size(); idx++)
+		fileNames.append(mImages->fileName(idx));
 
 	return fileNames;
 }
 
-QVector<QSharedPointer<DkImageContainerT> > DkImageLoader::getImages() {
+QSharedPointer<DkFolderIndex> DkImageLoader::getImages() {
 
 	loadDir(mCurrentDir);
 	return mImages;
 }
 
-void DkImageLoader::setImages(QVector<QSharedPointer<DkImageContainerT> > images) {
+void DkImageLoader::setImages(QSharedPointer<DkFolderIndex> images) {
+
+	if (!images)
+		images = QSharedPointer<DkFolderIndex>(new DkFolderIndex());
 
 	mImages = images;
 	emit updateDirSignal(images);
@@ -804,7 +1459,7 @@ void DkImageLoader::setCurrentImage(QSharedPointer<DkImageContainerT> newImg) {
 	}
 
 	if (newImg)
-		loadDir(newImg->dirPath());
+		loadDirAsync(newImg->dirPath());
 	//else
 	//	qDebug() << "empty image assigned";
 	
@@ -860,7 +1515,9 @@ void DkImageLoader::reloadImage() {
 	}
 
 	mCurrentDir = "";
-	mImages.clear();
+	clearImages();
+	mPrefetcher.clear();
+	mCacheIdx = -1;
 	mCurrentImage->clear();
 	setCurrentImage(mCurrentImage);
 	loadDir(mCurrentImage->dirPath());
@@ -884,7 +1541,11 @@ void DkImageLoader::load(const QString& filePath) {
 		firstFile();
 	
 	// if here is a folder upate bug - this was before -- if (QFileInfo(filePath).isFile() || hasZipMarker) { 
-	loadDir(QFileInfo(filePath).absolutePath());
+	// the image is shown while its folder is listed
+	if (QFileInfo(filePath).isFile())
+		loadDirAsync(QFileInfo(filePath).absolutePath());
+	else
+		loadDir(QFileInfo(filePath).absolutePath());
 }
 
 void DkImageLoader::load(QSharedPointer<DkImageContainerT> image /* = QSharedPointer<DkImageContainerT> */) {
@@ -903,10 +1564,16 @@ void DkImageLoader::load(QSharedPointer<DkImageContainerT> image /* = QSharedPoi
 #endif
 
 	setCurrentImage(image);
+	mPrefetcher.registerRequest(mCurrentImage);
 
 	if (mCurrentImage && mCurrentImage->getLoadState() == DkImageContainerT::loading)
 		return;
 
+	// paint a down-scaled version first if the decoder supports it
+	QWidget* mainWindow = DkUtils::getMainWindow();
+	if (mainWindow && !mCurrentImage->hasImage())
+		mCurrentImage->setPreviewSize(mainWindow->size()*mainWindow->devicePixelRatio());
+
 	emit updateSpinnerSignalDelayed(true);
 	bool loaded = mCurrentImage->loadImageThreaded();	// loads file threaded
 	
@@ -933,24 +1600,29 @@ void DkImageLoader::imageLoaded(bool loaded /* = false */) {
 
 	if (mCurrentImage) {
 		// this signal is needed by the folder scrollbar
-		int idx = findFileIdx(mCurrentImage->filePath(), mImages);
+		int idx = findFileIdx(mCurrentImage->filePath());
 		emit imageUpdatedSignal(idx);
 	}
 
 	QApplication::sendPostedEvents();	// force an event post here
 
-	if (mCurrentImage && mCurrentImage->isFileDownloaded())
+	// gigapixel images are not decoded for the temp file
+	if (mCurrentImage && mCurrentImage->isFileDownloaded() && !mCurrentImage->isTiled())
 		saveTempFile(mCurrentImage->image());
 
 	updateCacher(mCurrentImage);
 	updateHistory();
 
+	DkMemoryManager::instance().balance();
+
 	if (mCurrentImage)
 		emit imageHasGPSSignal(DkMetaDataHelper::getInstance().hasGPS(mCurrentImage->getMetaData()));
 
 	// update status bar info
-	if (mCurrentImage && !mImages.empty() && mImages.indexOf(mCurrentImage) >= 0)
-		DkStatusBarManager::instance().setMessage(tr("%1 of %2").arg(mImages.indexOf(mCurrentImage)+1).arg(mImages.size()), DkStatusBar::status_filenumber_info);
+	int cIdx = mImages->indexOf(mCurrentImage);
+
+	if (cIdx >= 0)
+		DkStatusBarManager::instance().setMessage(tr("%1 of %2").arg(cIdx+1).arg(mImages->size()), DkStatusBar::status_filenumber_info);
 	else
 		DkStatusBarManager::instance().setMessage("", DkStatusBar::status_filenumber_info);
 
@@ -1265,7 +1937,7 @@ void DkImageLoader::saveFile(const QString& filePath, const QImage& saveImg, con
 	}
 
 	emit updateSpinnerSignalDelayed(true);
-	QImage sImg = (saveImg.isNull()) ? imgC->image() : saveImg;
+	QImage sImg = (saveImg.isNull()) ? imgC->loadFullImage() : saveImg;
 
 	mDirWatcher->blockSignals(true);
 	bool saveStarted = (threaded) ? imgC->saveImageThreaded(lFilePath, sImg, compression) : imgC->saveImage(lFilePath, sImg, compression);
@@ -1397,6 +2069,12 @@ void DkImageLoader::rotateImage(double angle) {
 		return;
 	}
 
+	// the viewer decodes gigapixel images before they are edited
+	if (mCurrentImage->isTiled()) {
+		qWarning() << "cannot rotate the preview of" << mCurrentImage->fileName();
+		return;
+	}
+
 	QImage img = mCurrentImage->getLoader()->rotate(mCurrentImage->image(), qRound(angle));
 
 	QImage thumb = DkImage::createThumb(mCurrentImage->image());
@@ -1518,6 +2196,77 @@ void DkImageLoader::directoryChanged(const QString& path) {
 	
 }
 
+/**
+ * Applies single file changes of the current directory to the index.
+ * The files are inserted/removed in the sorted index, so the folder is
+ * neither listed nor sorted again and all containers (and their caches
+ * and thumbnails) are kept. Big changes fall back to reloading the folder.
+ * @param added the names of new (or overwritten) files.
+ * @param removed the names of deleted files.
+ **/
+void DkImageLoader::filesChanged(const QStringList& added, const QStringList& removed) {
+
+	int numChanges = added.size() + removed.size();
+
+	// duplicates need the whole folder (e.g. the JPG of a RAW arrives later)
+	if (mImages->empty() ||
+		DkSettingsManager::param().resources().filterDuplicats ||
+		numChanges > qMin((int)max_incremental_changes, mImages->size() / 4)) {
+		directoryChanged(mCurrentDir);
+		return;
+	}
+
+	DkTimer dt;
+
+	QStringList removedPaths;
+	for (const QString& fileName : removed)
+		removedPaths << QFileInfo(mCurrentDir, fileName).absoluteFilePath();
+
+	DkDirScanner scanner(DkSettingsManager::param().app().browseFilters);
+
+	QStringList newFiles;
+	for (const QString& fileName : added) {
+		if (!fileName.startsWith(".") && scanner.accepts(fileName))
+			newFiles << fileName;
+	}
+	newFiles = filterKeywords(newFiles, mIgnoreKeywords, mKeywords, mFolderFilterString);
+
+	QFileInfoList addedFiles;
+	QStringList replacedPaths;
+	for (const QString& fileName : newFiles) {
+
+		QFileInfo fi(mCurrentDir, fileName);
+		if (!fi.isFile())
+			continue;
+
+		addedFiles << fi;
+
+		// overwritten files are replaced since their attributes changed
+		if (mImages->indexOf(fi.absoluteFilePath()) != -1)
+			replacedPaths << fi.absoluteFilePath();
+	}
+
+	// others (e.g. a thumbnail thread) might still read the current index
+	QSharedPointer<DkFolderIndex> images(new DkFolderIndex(*mImages));
+	int numRemoved = images->remove(removedPaths);
+	images->remove(replacedPaths);
+
+	// the new files are sorted once and merged linearly
+	DkFolderIndex addedImages(addedFiles);
+	addedImages.sort();
+	int numAdded = images->merge(addedImages);
+
+	if (!numRemoved && !numAdded)
+		return;
+
+	images->adopt(mCurrentImage);	// the current image is kept even if it was overwritten (e.g. saved)
+	mImages = images;
+
+	qDebug() << "[DkImageLoader]" << numAdded << "files added," << numRemoved << "removed in" << dt;
+
+	emit updateDirSignal(mImages);
+}
+
 /**
  * Returns true if a file was specified.
  * @return bool true if a file name/path was specified
@@ -1613,16 +2362,30 @@ QStringList DkImageLoader::getFoldersRecursive(const QString& dirPath) {
 	return subFolders;
 }
 
-QFileInfoList DkImageLoader::updateSubFolders(const QString& rootDirPath) {
+/**
+ * Lists the root folder and (re-)crawls its folder tree in the background.
+ * If the root folder has no images, the first sub folder with images is listed.
+ * @param rootDirPath the root folder.
+ * @param alternates if not 0, the duplicates that were filtered are added.
+ * @return QFileInfoList the files of the first folder with images.
+ **/
+QFileInfoList DkImageLoader::updateSubFolders(const QString& rootDirPath, QHash<QString, QStringList>* alternates) {
 	
-	mSubFolders = getFoldersRecursive(rootDirPath);
-	QFileInfoList files;
-	qDebug() << mSubFolders;
+	mFolderTree->setRootPath(rootDirPath);
+
+	mCurrentDir = rootDirPath;
+	QFileInfoList files = getFilteredFileInfoList(mCurrentDir, mIgnoreKeywords, mKeywords, QString(), alternates);		// this line takes seconds if you have lots of files and slow loading (e.g. network)
+
+	if (!files.empty())
+		return files;
+
+	// we need the sub folders now
+	mFolderTree->waitForCrawl();
 
 	// find the first subfolder that has images
-	for (int idx = 0; idx < mSubFolders.size(); idx++) {
-		mCurrentDir = mSubFolders[idx];
-		files = getFilteredFileInfoList(mCurrentDir, mIgnoreKeywords, mKeywords);		// this line takes seconds if you have lots of files and slow loading (e.g. network)
+	for (int idx = mFolderTree->nextFolder(mFolderTree->indexOf(rootDirPath), false); idx != -1; idx = mFolderTree->nextFolder(idx, false)) {
+		mCurrentDir = mFolderTree->folder(idx);
+		files = getFilteredFileInfoList(mCurrentDir, mIgnoreKeywords, mKeywords, QString(), alternates);		// this line takes seconds if you have lots of files and slow loading (e.g. network)
 		if (!files.empty())
 			break;
 	}
@@ -1630,60 +2393,58 @@ QFileInfoList DkImageLoader::updateSubFolders(const QString& rootDirPath) {
 	return files;
 }
 
+/**
+ * Returns the next folder with images.
+ * The folder tree knows the image count of each folder, so this is a look-up
+ * unless keywords are set (then, the candidates need to be listed).
+ * @param folderIdx the index of the current folder in the folder tree.
+ * @return int the index of the next folder or -1.
+ **/
 int DkImageLoader::getNextFolderIdx(int folderIdx) {
 	
-	int nextIdx = -1;
+	bool loop = DkSettingsManager::param().global().loop;
+	int nextIdx = mFolderTree->nextFolder(folderIdx, loop);
 
-	if (mSubFolders.empty())
+	if (mKeywords.empty() && mIgnoreKeywords.empty())
 		return nextIdx;
 
-	// find the first sub folder that has images
-	for (int idx = 1; idx < mSubFolders.size(); idx++) {
-		
-		int tmpNextIdx = folderIdx + idx;
+	// find the first sub folder that has images - after filtering
+	for (int idx = 1; idx < mFolderTree->size() && nextIdx != -1 && nextIdx != folderIdx; idx++) {
 
-		if (DkSettingsManager::param().global().loop)
-			tmpNextIdx %= mSubFolders.size();
-		else if (tmpNextIdx >= mSubFolders.size())
-			return -1;
+		QFileInfoList cFiles = getFilteredFileInfoList(mFolderTree->folder(nextIdx), mIgnoreKeywords, mKeywords);		// this line takes seconds if you have lots of files and slow loading (e.g. network)
+		if (!cFiles.empty())
+			return nextIdx;
 
-		QDir cDir = mSubFolders[tmpNextIdx];
-		QFileInfoList cFiles = getFilteredFileInfoList(cDir.absolutePath(), mIgnoreKeywords, mKeywords);		// this line takes seconds if you have lots of files and slow loading (e.g. network)
-		if (!cFiles.empty()) {
-			nextIdx = tmpNextIdx;
-			break;
-		}
+		nextIdx = mFolderTree->nextFolder(nextIdx, loop);
 	}
 
-	return nextIdx;
+	return -1;
 }
 
+/**
+ * Returns the previous folder with images.
+ * @param folderIdx the index of the current folder in the folder tree.
+ * @return int the index of the previous folder or -1.
+ **/
 int DkImageLoader::getPrevFolderIdx(int folderIdx) {
 	
-	int prevIdx = -1;
+	bool loop = DkSettingsManager::param().global().loop;
+	int prevIdx = mFolderTree->prevFolder(folderIdx, loop);
 
-	if (mSubFolders.empty())
+	if (mKeywords.empty() && mIgnoreKeywords.empty())
 		return prevIdx;
 
-	// find the first sub folder that has images
-	for (int idx = 1; idx < mSubFolders.size(); idx++) {
-
-		int tmpPrevIdx = folderIdx - idx;
+	// find the first sub folder that has images - after filtering
+	for (int idx = 1; idx < mFolderTree->size() && prevIdx != -1 && prevIdx != folderIdx; idx++) {
 
-		if (DkSettingsManager::param().global().loop && tmpPrevIdx < 0)
-			tmpPrevIdx += mSubFolders.size();
-		else if (tmpPrevIdx < 0)
-			return -1;
+		QFileInfoList cFiles = getFilteredFileInfoList(mFolderTree->folder(prevIdx), mIgnoreKeywords, mKeywords);		// this line takes seconds if you have lots of files and slow loading (e.g. network)
+		if (!cFiles.empty())
+			return prevIdx;
 
-		QDir cDir = mSubFolders[tmpPrevIdx];
-		QFileInfoList cFiles = getFilteredFileInfoList(cDir.absolutePath(), mIgnoreKeywords, mKeywords);		// this line takes seconds if you have lots of files and slow loading (e.g. network)
-		if (!cFiles.empty()) {
-			prevIdx = tmpPrevIdx;
-			break;
-		}
+		prevIdx = mFolderTree->prevFolder(prevIdx, loop);
 	}
 
-	return prevIdx;
+	return -1;
 }
 
 void DkImageLoader::errorDialog(const QString& msg) const {
@@ -1702,57 +2463,41 @@ void DkImageLoader::updateCacher(QSharedPointer<DkImageContainerT> imgC) {
 	if (!imgC || !DkSettingsManager::param().resources().cacheMemory)
 		return;
 
-	DkTimer dt;
-
-	//// no caching? delete all
-	//if (!DkSettingsManager::param().resources().cacheMemory) {
-	//	for (int idx = 0; idx < images.size(); idx++) {
-	//		images.at(idx)->clear();
-	//	}
-	//	return;
-	//}
-
-	int cIdx = findFileIdx(imgC->filePath(), mImages);
-	float mem = 0;
+	int cIdx = currentIdx(imgC);
 
 	if (cIdx == -1) {
 		qDebug() << "WARNING: image not found for caching!";
 		return;
 	}
 
-	for (int idx = 0; idx < mImages.size(); idx++) {
+	mCacheIdx = cIdx;
+	mPrefetcher.update(*mImages, cIdx);
+}
 
-		// clear images if they are edited
-		if (idx != cIdx && mImages.at(idx)->isEdited()) {
-			mImages.at(idx)->clear();
-			continue;
-		}
+/**
+ * Returns the index of imgC in the current image list.
+ * The neighbors of the last cached image are checked first
+ * so that we do not need to search the whole folder while browsing.
+ * @param imgC the image to be located.
+ * @return int the index or -1 if the image is not in the current folder.
+ **/ 
+int DkImageLoader::currentIdx(QSharedPointer<DkImageContainerT> imgC) const {
 
-		if (idx >= cIdx-1 && idx <= cIdx+DkSettingsManager::param().resources().maxImagesCached)
-			mem += mImages.at(idx)->getMemoryUsage();
-		else {
-			mImages.at(idx)->clear();
-			continue;
-		}
+	if (!imgC)
+		return -1;
 
-		// ignore the last and current one
-		if (idx == cIdx-1 || idx == cIdx) {
-			continue;
-		}
-		// fully load the next image
-		else if (idx == cIdx+1 && mem < DkSettingsManager::param().resources().cacheMemory && mImages.at(idx)->getLoadState() == DkImageContainerT::not_loaded) {
-			mImages.at(idx)->loadImageThreaded();
-			qDebug() << "[Cacher] " << mImages.at(idx)->filePath() << " fully cached...";
-		}
-		else if (idx > cIdx && idx < cIdx+DkSettingsManager::param().resources().maxImagesCached-2 && mem < DkSettingsManager::param().resources().cacheMemory && mImages.at(idx)->getLoadState() == DkImageContainerT::not_loaded) {
-			//dt.getIvl();
-			mImages.at(idx)->fetchFile();		// TODO: crash detected here
-			qDebug() << "[Cacher] " << mImages.at(idx)->filePath() << " file fetched...";
+	if (mCacheIdx >= 0 && mCacheIdx < mImages->size()) {
+
+		int stride = mPrefetcher.stride();
+
+		for (int idx : {mCacheIdx + stride, mCacheIdx - stride, mCacheIdx + 1, mCacheIdx - 1, mCacheIdx, mTmpFileIdx}) {
+			if (mImages->materialized(idx) == imgC)
+				return idx;
 		}
 	}
 
-	qDebug() << "cache with: " << mem << " MB created in: " << dt;
-
+	// look-up the file path
+	return mImages->indexOf(imgC);
 }
 
 /**
@@ -1763,9 +2508,10 @@ void DkImageLoader::updateCacher(QSharedPointer<DkImageContainerT> imgC) {
  * @param dir the directory to load the file list from.
  * @param ignoreKeywords if one of these keywords is in the file name, the file will be ignored.
  * @param keywords if one of these keywords is not in the file name, the file will be ignored.
+ * @param alternates if not 0, the duplicates that were filtered are added (see filterDuplicates).
  * @return QStringList all filtered files of the current directory.
  **/ 
-QFileInfoList DkImageLoader::getFilteredFileInfoList(const QString& dirPath, QStringList ignoreKeywords, QStringList keywords, QString folderKeywords) {
+QFileInfoList DkImageLoader::getFilteredFileInfoList(const QString& dirPath, QStringList ignoreKeywords, QStringList keywords, QString folderKeywords, QHash<QString, QStringList>* alternates) {
 
 	DkTimer dt;
 
@@ -1821,78 +2567,165 @@ QFileInfoList DkImageLoader::getFilteredFileInfoList(const QString& dirPath, QSt
 	qInfoClean() << "WinAPI, indexed (" << fileList.size() <<") files in: " << dt;
 #else
 
-	// true file list
-	QDir tmpDir = dirPath;
-	tmpDir.setSorting(QDir::LocaleAware);
-	QStringList fileList = tmpDir.entryList(DkSettingsManager::param().app().browseFilters);
-	qDebug() << fileList;
+	// no locale aware sorting here - the folder index sorts the files anyway
+	DkDirScanner scanner(DkSettingsManager::param().app().browseFilters);
+	QStringList fileList = scanner.scan(dirPath);
+
+	qInfoClean() << "indexed (" << fileList.size() << ") files in: " << dt;
 
 #endif
 
-	for (int idx = 0; idx < ignoreKeywords.size(); idx++) {
-		QRegExp exp = QRegExp("^((?!" + ignoreKeywords[idx] + ").)*$");
-		exp.setCaseSensitivity(Qt::CaseInsensitive);
-		fileList = fileList.filter(exp);
-	}
+	fileList = filterKeywords(fileList, ignoreKeywords, keywords, folderKeywords);
 
-	for (int idx = 0; idx < keywords.size(); idx++) {
-		fileList = fileList.filter(keywords[idx], Qt::CaseInsensitive);
-	}
+	QHash<QString, QStringList> duplicates;
+
+	if (DkSettingsManager::param().resources().filterDuplicats)
+		fileList = filterDuplicates(fileList, preferredExtensions(), alternates ? &duplicates : 0);
+
+	//fileList = sort(fileList, dir);
+
+	QFileInfoList fileInfoList;
+	
+	for (int idx = 0; idx < fileList.size(); idx++)
+		fileInfoList.append(QFileInfo(mCurrentDir, fileList.at(idx)));
 
-	if (folderKeywords != "") {
-		QStringList filterList = fileList;
-		fileList = DkUtils::filterStringList(folderKeywords, filterList);
+	// the index needs absolute paths
+	for (auto it = duplicates.constBegin(); it != duplicates.constEnd(); ++it) {
+
+		QStringList paths;
+		for (const QString& fileName : it.value())
+			paths << QFileInfo(mCurrentDir, fileName).absoluteFilePath();
+
+		alternates->insert(QFileInfo(mCurrentDir, it.key()).absoluteFilePath(), paths);
 	}
 
-	if (DkSettingsManager::param().resources().filterDuplicats) {
+	return fileInfoList;
+}
 
-		QString preferredExtension = DkSettingsManager::param().resources().preferredExtension;
-		preferredExtension = preferredExtension.replace("*.", "");
-		qDebug() << "preferred extension: " << preferredExtension;
+/**
+ * Applies the keyword filters to a list of file names.
+ * The keywords are compiled into a DkKeywordFilter which is
+ * kept until the keywords change, every name is scanned once.
+ * @param fileList the file names.
+ * @param ignoreKeywords if one of these keywords is in the file name, the file will be ignored.
+ * @param keywords if one of these keywords is not in the file name, the file will be ignored.
+ * @param folderKeywords the folder filter string.
+ * @return QStringList the remaining file names.
+ **/
+QStringList DkImageLoader::filterKeywords(const QStringList& fileList, const QStringList& ignoreKeywords, const QStringList& keywords, const QString& folderKeywords) {
 
-		QStringList resultList = fileList;
-		fileList.clear();
-		
-		for (int idx = 0; idx < resultList.size(); idx++) {
-			
-			QFileInfo cFName = QFileInfo(resultList.at(idx));
+	if (!mKeywordFilter.isCompiledFrom(keywords, ignoreKeywords, folderKeywords))
+		mKeywordFilter = DkKeywordFilter(keywords, ignoreKeywords, folderKeywords);
 
-			if (preferredExtension.compare(cFName.suffix(), Qt::CaseInsensitive) == 0) {
-				fileList.append(resultList.at(idx));
-				continue;
-			}
+	return mKeywordFilter.filter(fileList);
+}
 
-			QString cFBase = cFName.baseName();
-			bool remove = false;
+/**
+ * Returns the preferred extensions of duplicate files.
+ * The preferredExtension setting may hold a preference chain (e.g. "*.jpg; *.dng; *.cr2").
+ * @return QStringList the lower case suffixes in the order of preference.
+ **/
+QStringList DkImageLoader::preferredExtensions() {
 
-			for (int cIdx = 0; cIdx < resultList.size(); cIdx++) {
+	QStringList suffixes = DkSettingsManager::param().resources().preferredExtension.split(QRegExp("[;,\\s]+"), QString::SkipEmptyParts);
 
-				QString ccBase = QFileInfo(resultList.at(cIdx)).baseName();
+	for (QString& suffix : suffixes)
+		suffix = suffix.replace("*", "").replace(".", "").toLower();
 
-				if (cIdx != idx && ccBase == cFBase && resultList.at(cIdx).contains(preferredExtension, Qt::CaseInsensitive)) {
-					remove = true;
-					break;
-				}
-			}
-			
-			if (!remove)
-				fileList.append(resultList.at(idx));
+	suffixes.removeAll("");
+
+	return suffixes;
+}
+
+/**
+ * Removes duplicates which only differ in their extension (e.g. RAW+JPG pairs).
+ * Files are grouped by their name without the last suffix in one pass.
+ * Of each group, only the file(s) with the best ranked suffix are kept.
+ * Groups without any preferred suffix are not touched.
+ * @param fileNames the file names.
+ * @param preferredSuffixes lower case suffixes, best first.
+ * @param alternates if not 0, the removed files are assigned to the kept file of their group.
+ * @return QStringList the file names without duplicates (the order is kept).
+ **/
+QStringList DkImageLoader::filterDuplicates(const QStringList& fileNames, const QStringList& preferredSuffixes, QHash<QString, QStringList>* alternates) {
+
+	if (preferredSuffixes.empty() || fileNames.size() < 2)
+		return fileNames;
+
+	DkTimer dt;
+
+	const int notPreferred = preferredSuffixes.size();
+
+	QVector<int> ranks(fileNames.size(), notPreferred);
+	QVector<int> groups(fileNames.size());
+	QVector<int> bestRanks;		// best rank per group
+	QVector<int> groupSizes;
+	QHash<QString, int> groupLookup;
+	groupLookup.reserve(fileNames.size());
+
+	for (int idx = 0; idx < fileNames.size(); idx++) {
+
+		const QString& fileName = fileNames.at(idx);
+		int dotIdx = fileName.lastIndexOf('.');
+
+		if (dotIdx > 0) {
+			int rank = preferredSuffixes.indexOf(fileName.mid(dotIdx + 1).toLower());
+			if (rank != -1)
+				ranks[idx] = rank;
+		}
+
+		QString baseName = dotIdx > 0 ? fileName.left(dotIdx) : fileName;
+		int gIdx = groupLookup.value(baseName, -1);
+
+		if (gIdx == -1) {
+			gIdx = bestRanks.size();
+			groupLookup.insert(baseName, gIdx);
+			bestRanks << ranks[idx];
+			groupSizes << 1;
 		}
+		else {
+			bestRanks[gIdx] = qMin(bestRanks[gIdx], ranks[idx]);
+			groupSizes[gIdx]++;
+		}
+
+		groups[idx] = gIdx;
 	}
 
-	//fileList = sort(fileList, dir);
+	if (bestRanks.size() == fileNames.size())
+		return fileNames;	// no duplicates
 
-	QFileInfoList fileInfoList;
-	
-	for (int idx = 0; idx < fileList.size(); idx++)
-		fileInfoList.append(QFileInfo(mCurrentDir, fileList.at(idx)));
+	QStringList filteredNames;
+	filteredNames.reserve(bestRanks.size());
+	QVector<int> keptFile(bestRanks.size(), -1);	// the first kept file per group
+	QVector<int> removed;
 
-	return fileInfoList;
+	for (int idx = 0; idx < fileNames.size(); idx++) {
+
+		int gIdx = groups[idx];
+
+		if (groupSizes[gIdx] == 1 || bestRanks[gIdx] == notPreferred || ranks[idx] == bestRanks[gIdx]) {
+			filteredNames << fileNames.at(idx);
+
+			if (keptFile[gIdx] == -1)
+				keptFile[gIdx] = idx;
+		}
+		else
+			removed << idx;
+	}
+
+	if (alternates) {
+		for (int idx : removed)
+			(*alternates)[fileNames.at(keptFile[groups[idx]])] << fileNames.at(idx);
+	}
+
+	qDebug() << "[DkImageLoader]" << removed.size() << "duplicates removed in" << dt;
+
+	return filteredNames;
 }
 
 void DkImageLoader::sort() {
 	
-	qSort(mImages.begin(), mImages.end(), imageContainerLessThanPtr);
+	mImages->sort();
 	emit updateDirSignal(mImages);
 }
 
@@ -1930,7 +2763,7 @@ bool DkImageLoader::isEdited() const {
 };
 
 int DkImageLoader::numFiles() const {
-	return mImages.size();
+	return mImages->size();
 };
 
 void DkImageLoader::undo() {
@@ -2057,6 +2890,8 @@ QSharedPointer<DkImageContainerT> DkImageLoader::setImage(const QImage& img, con
 	setCurrentImage(newImg);
 	emit imageUpdatedSignal(mCurrentImage);
 
+	DkMemoryManager::instance().balance();
+
 	return newImg;
 }
 
@@ -2081,4 +2916,21 @@ QString DkImageLoader::fileName() const {
 	return mCurrentImage->fileName();
 }
 
+/**
+ * Returns the prefetcher which caches the images of the current folder.
+ * @return const DkPrefetcher& the prefetcher (e.g. for cache statistics).
+ **/ 
+const DkPrefetcher& DkImageLoader::prefetcher() const {
+	return mPrefetcher;
+}
+
+/**
+ * Tells the prefetcher that a slideshow is running.
+ * Slideshows are predictable so we decode more images in advance.
+ * @param playing true if the slideshow is playing.
+ **/ 
+void DkImageLoader::setSlideshow(bool playing) {
+	mPrefetcher.setSlideshow(playing);
+}
+
 }
\ No newline at end of file
@@ -30,6 +30,11 @@
 #pragma warning(push, 0)	// no warnings from includes - begin
 #include <QTimer>
 #include <QImage>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QHash>
+#include <list>
 #pragma warning(pop)	// no warnings from includes - end
 
 #ifndef DllCoreExport
@@ -44,17 +49,77 @@
 
 // my classes
 #include "DkImageContainer.h"
+#include "DkFolderIndex.h"
+#include "DkKeywordFilter.h"
+#include "DkMemoryManager.h"
 
 #ifdef Q_OS_LINUX
 	typedef  unsigned char byte;
 #endif
 
 // Qt defines
-class QFileSystemWatcher;
 class QUrl;
 
 namespace nmc {
 
+// nomacs defines
+class DkDirWatcher;
+class DkFolderTree;
+
+/**
+ * Predictive prefetcher for the images of the current folder.
+ * It tracks the navigation direction and speed and keeps an LRU
+ * of decoded images and file buffers below the cache memory budget.
+ * Only the prediction window around the current index is visited,
+ * so the folder is never rescanned when the image changes.
+ **/
+class DllCoreExport DkPrefetcher {
+
+public:
+	DkPrefetcher();
+
+	void update(const DkFolderIndex& images, int cIdx);
+	void registerRequest(QSharedPointer<DkImageContainerT> imgC);
+	void setSlideshow(bool playing);
+	void clear();
+	float release(float mem);
+
+	int hits() const;
+	int fileHits() const;
+	int misses() const;
+	int direction() const;
+	int stride() const;
+	double velocity() const;
+	float cachedMemory() const;
+
+protected:
+	void updateVelocity(int cIdx, int numImages);
+	typedef std::list<QSharedPointer<DkImageContainerT> > LruList;
+
+	QVector<int> predictWindow(int cIdx, int numImages) const;
+	void touch(QSharedPointer<DkImageContainerT> imgC);
+	LruList::iterator remove(LruList::iterator it);
+	void evict(const QVector<QSharedPointer<DkImageContainerT> >& window, float budget);
+
+	LruList mLru;	// most recently used first
+	QHash<DkImageContainerT*, LruList::iterator> mLruEntries;
+	QElapsedTimer mStepTimer;
+
+	int mLastIdx = -1;
+	int mDirection = 1;
+	int mStride = 1;
+	bool mDirectionChanged = false;
+	double mVelocity = 0.0;		// images per second
+	bool mSlideshow = false;
+
+	int mHits = 0;
+	int mFileHits = 0;
+	int mMisses = 0;
+
+private:
+	Q_DISABLE_COPY(DkPrefetcher)
+};
+
 /**
  * This class is a basic image loader class.
  * It takes care of the file watches for the current folder,
@@ -62,17 +127,28 @@ namespace nmc {
  * calls the load routines
  * and saves the image or the image metadata.
  **/ 
-class DllCoreExport DkImageLoader : public QObject {
+class DllCoreExport DkImageLoader : public QObject, public DkMemoryClient {
 	Q_OBJECT
 
 public:
+	enum {
+		max_incremental_changes = 1000,	// more file changes at once reload the whole folder
+		dir_update_interval = 250,		// ms between updates while a folder is listed
+	};
 
 	DkImageLoader(const QString& filePath = QString());
 	virtual ~DkImageLoader();
 
+	// DkMemoryClient
+	float memoryUsage(int subsystem) const override;
+	float releaseMemory(int subsystem, float mem) override;
+
 	static QStringList getFoldersRecursive(const QString& dirPath);
-	QFileInfoList updateSubFolders(const QString& rootDirPath);
-	QFileInfoList getFilteredFileInfoList(const QString& dirPath, QStringList ignoreKeywords = QStringList(), QStringList keywords = QStringList(), QString folderKeywords = QString());
+	QFileInfoList updateSubFolders(const QString& rootDirPath, QHash<QString, QStringList>* alternates = 0);
+	QFileInfoList getFilteredFileInfoList(const QString& dirPath, QStringList ignoreKeywords = QStringList(), QStringList keywords = QStringList(), QString folderKeywords = QString(), QHash<QString, QStringList>* alternates = 0);
+	static QStringList preferredExtensions();
+	QStringList filterKeywords(const QStringList& fileList, const QStringList& ignoreKeywords, const QStringList& keywords, const QString& folderKeywords);
+	static QStringList filterDuplicates(const QStringList& fileNames, const QStringList& preferredSuffixes, QHash<QString, QStringList>* alternates = 0);
 
 	void rotateImage(double angle);
 	QSharedPointer<DkImageContainerT> getCurrentImage() const;
@@ -80,8 +156,8 @@ public:
 	QString filePath() const;
 	QStringList getFileNames() const;
 
-	QVector<QSharedPointer<DkImageContainerT> > getImages();
-	void setImages(QVector<QSharedPointer<DkImageContainerT> > images);
+	QSharedPointer<DkFolderIndex> getImages();
+	void setImages(QSharedPointer<DkFolderIndex> images);
 	QSharedPointer<DkImageContainerT> setImage(const QImage& img, const QString& editName, const QString& editFilePath = QString());
 	QSharedPointer<DkImageContainerT> setImage(QSharedPointer<DkImageContainerT> img);
 	void setCurrentImage(QSharedPointer<DkImageContainerT> newImg);
@@ -101,12 +177,13 @@ public:
 	
 	QSharedPointer<DkImageContainerT> findOrCreateFile(const QString& filePath) const;
 	QSharedPointer<DkImageContainerT> findFile(const QString& filePath) const;
-	int findFileIdx(const QString& filePath, const QVector<QSharedPointer<DkImageContainerT> >& images) const;
+	int findFileIdx(const QString& filePath) const;
 	
 	bool hasFile() const;
 	bool hasMovie() const;
 	bool hasSvg() const;
 	QString fileName() const;
+	const DkPrefetcher& prefetcher() const;
 
 	void deactivate();
 	void activate(bool isActive = true);
@@ -139,7 +216,7 @@ signals:
 	void imageUpdatedSignal(int idx) const;	// folder scrollbar needs that
 	void imageLoadedSignal(QSharedPointer<DkImageContainerT> image, bool loaded = true) const;
 	void showInfoSignal(const QString& msg, int time = 3000, int position = 0) const;
-	void updateDirSignal(QVector<QSharedPointer<DkImageContainerT> > images) const;
+	void updateDirSignal(QSharedPointer<DkFolderIndex> images) const;
 	void imageHasGPSSignal(bool hasGPS) const;
 
 public slots:
@@ -147,6 +224,7 @@ public slots:
 	void redo();
 	void changeFile(int skipIdx);
 	void directoryChanged(const QString& path = QString());
+	void filesChanged(const QStringList& added, const QStringList& removed);
 	void saveFileWeb(const QImage& saveImg);
 	void saveUserFileAs(const QImage& saveImg, bool silent);
 	void saveFile(const QString& filename, const QImage& saveImg = QImage(), const QString& fileFilter = "", int compression = -1, bool threaded = true);
@@ -160,6 +238,7 @@ public slots:
 	QString getFolderFilter();
 	QStringList getFolderFilters();
 	bool loadDir(const QString& newDirPath, bool scanRecursive = true);
+	bool loadDirAsync(const QString& newDirPath);
 	void errorDialog(const QString& msg) const;
 	void loadFileAt(int idx);
 
@@ -170,35 +249,58 @@ public slots:
 	void imagesSorted();
 	bool unloadFile();
 	void reloadImage();
+	void setSlideshow(bool playing);
+
+protected slots:
+	void mergeDirBatches();
+	void dirScanned();
 
 protected:
 	// functions
 	void updateCacher(QSharedPointer<DkImageContainerT> imgC);
+	int currentIdx(QSharedPointer<DkImageContainerT> imgC) const;
 	int getNextFolderIdx(int folderIdx);
 	int getPrevFolderIdx(int folderIdx);
 	void updateHistory();
-	void sortImagesThreaded(QVector<QSharedPointer<DkImageContainerT > > images);
-	void createImages(const QFileInfoList& files, bool sort = true);
-	QVector<QSharedPointer<DkImageContainerT > > sortImages(QVector<QSharedPointer<DkImageContainerT > > images) const;
+	void sortImagesThreaded(QSharedPointer<DkFolderIndex> images);
+	void createImages(const QFileInfoList& files, bool sort = true, const QHash<QString, QStringList>& alternates = QHash<QString, QStringList>());
+	void clearImages();
+	static QVector<int> sortImages(QSharedPointer<DkFolderIndex> images);
+	QVector<QSharedPointer<DkImageContainerT > > releaseOrder() const;
+	void scanDirThreaded(const QString& dirPath, const QStringList& nameFilters, const DkKeywordFilter& filter, const QStringList& preferredSuffixes);
+	void publishDirBatch(const QString& dirPath, const QStringList& fileNames, const QHash<QString, QStringList>& duplicates = QHash<QString, QStringList>());
+	void finishDirScan();
+	void stopDirScan();
 
 	QStringList mIgnoreKeywords;
 	QStringList mKeywords;
 	QString mFolderFilterString;		// are deleted if a new folder is opened
+	DkKeywordFilter mKeywordFilter;		// compiled from the keywords above
 
 	QTimer mDelayedUpdateTimer;
 	bool mTimerBlockedUpdate = false;
 	QString mCurrentDir;
 	QString mSaveDir;
-	QFileSystemWatcher* mDirWatcher = 0;
-	QStringList mSubFolders;
-	QVector<QSharedPointer<DkImageContainerT > > mImages;
+	DkDirWatcher* mDirWatcher = 0;
+	DkFolderTree* mFolderTree = 0;		// sub folders if they are scanned
+	QSharedPointer<DkFolderIndex> mImages = QSharedPointer<DkFolderIndex>(new DkFolderIndex());
 	QSharedPointer<DkImageContainerT > mCurrentImage;
 	QSharedPointer<DkImageContainerT > mLastImageLoaded;
 	bool mFolderUpdated = false;
 	int mTmpFileIdx = 0;
 	bool mSortingImages = false;
 	bool mSortingIsDirty = false;
-	QFutureWatcher<QVector<QSharedPointer<DkImageContainerT > > > mCreateImageWatcher;
+	QFutureWatcher<QVector<int> > mCreateImageWatcher;
+	DkPrefetcher mPrefetcher;
+	int mCacheIdx = -1;		// index of the image that was cached last
+
+	// asynchronous folder listing
+	QFutureWatcher<void> mDirScanWatcher;
+	QAtomicInt mDirScanAbort;
+	QMutex mDirBatchMutex;
+	QList<QSharedPointer<DkFolderIndex> > mDirBatches;	// sorted batches that are not merged yet
+	bool mDirScanning = false;
+	QElapsedTimer mDirUpdateTimer;
 
 };
 
@@ -40,6 +40,10 @@
 #include <QBitmap>
 #include <qmath.h>
 #include <QSvgRenderer>
+#include <QImageReader>
+#include <QCoreApplication>
+#include <QtConcurrentRun>
+#include <QtConcurrentMap>
 #pragma warning(pop)		// no warnings from includes - end
 
 #if defined(Q_OS_WIN) && !defined(SOCK_STREAM)
@@ -844,9 +848,10 @@ uchar DkImage::findHistPeak(const int* hist, float quantile) {
 	return 255;
 }
 
-QPixmap DkImage::makeSquare(const QPixmap & pm) {
+// returns the centered square of an image
+static QRect squareRect(const QSize& size) {
 
-	QRect r(QPoint(), pm.size());
+	QRect r(QPoint(), size);
 
 	if (r.width() > r.height()) {
 		r.setX(qFloor((r.width()-r.height())*0.5f));
@@ -857,7 +862,17 @@ QPixmap DkImage::makeSquare(const QPixmap & pm) {
 		r.setHeight(r.width());
 	}
 
-	return pm.copy(r);
+	return r;
+}
+
+QPixmap DkImage::makeSquare(const QPixmap & pm) {
+
+	return pm.copy(squareRect(pm.size()));
+}
+
+QImage DkImage::makeSquare(const QImage & img) {
+
+	return img.copy(squareRect(img.size()));
 }
 
 QPixmap DkImage::merge(const QVector<QImage>& imgs) {
@@ -1537,21 +1552,90 @@ QColor DkImage::getMeanColor(const QImage& img) {
 
 
 // DkImageStorage --------------------------------------------------------------------
+/**
+ * sRGB <-> linear light lookup tables.
+ * Linear values are 16 bit, the inverse table is indexed with 12 bit.
+ **/
+class DkGammaLut {
+
+public:
+	DkGammaLut() {
+
+		for (int idx = 0; idx < 256; idx++) {
+			double c = idx / 255.0;
+			double l = (c <= 0.04045) ? c / 12.92 : qPow((c + 0.055) / 1.055, 2.4);
+			toLinear[idx] = (quint16)qRound(l * 65535.0);
+		}
+
+		for (int idx = 0; idx < 4096; idx++) {
+			double l = (idx + 0.5) / 4096.0;
+			double c = (l <= 0.0031308) ? l * 12.92 : 1.055 * qPow(l, 1.0 / 2.4) - 0.055;
+			toSRGB[idx] = (uchar)qBound(0, qRound(c * 255.0), 255);
+		}
+	}
+
+	quint16 toLinear[256];
+	uchar toSRGB[4096];
+};
+
 DkImageStorage::DkImageStorage(const QImage& img) {
 	mImg = img;
 
-	mComputeThread = new QThread;
-	mComputeThread->start();
-	moveToThread(mComputeThread);
-
 	connect(DkActionManager::instance().action(DkActionManager::menu_view_anti_aliasing), SIGNAL(toggled(bool)), this, SLOT(antiAliasingChanged(bool)));
+
+	DkMemoryManager::instance().registerClient(this, DkMemoryManager::mem_pyramid, DkMemoryManager::priority_medium);
+}
+
+DkImageStorage::~DkImageStorage() {
+
+	DkMemoryManager::instance().unregisterClient(this);
+	cancel();
+}
+
+float DkImageStorage::memoryUsage(int) const {
+
+	QMutexLocker locker(&mMutex);
+	float mem = 0;
+
+	for (const QImage& img : mImgs)
+		mem += DkImage::getBufferSizeFloat(img.size(), img.depth());
+
+	return mem;
+}
+
+/**
+ * Releases the pyramid.
+ * It is computed again if the image is painted the next time.
+ * Pinned pyramids are kept: they would be recomputed right away, and
+ * each new level balances the memory again - which releases them again.
+ **/
+float DkImageStorage::releaseMemory(int subsystem, float) {
+
+	if (mPinned)
+		return 0;
+
+	cancel();
+	float mem = memoryUsage(subsystem);
+	mImgs.clear();
+	mComputed = false;
+
+	return mem;
+}
+
+/**
+ * Pinned pyramids are never released by the memory manager.
+ * Viewports pin their pyramid while they are visible.
+ **/
+void DkImageStorage::setPinned(bool pinned) {
+	mPinned = pinned;
 }
 
 void DkImageStorage::setImage(const QImage& img) {
 
-	mStop = true;
-	mImgs.clear();	// is it save (if the thread is still working?)
+	cancel();
+	mImgs.clear();
 	mImg = img;
+	mComputed = false;
 }
 
 void DkImageStorage::antiAliasingChanged(bool antiAliasing) {
@@ -1559,8 +1643,9 @@ void DkImageStorage::antiAliasingChanged(bool antiAliasing) {
 	DkSettingsManager::param().display().antiAliasing = antiAliasing;
 
 	if (!antiAliasing) {
-		mStop = true;
+		cancel();
 		mImgs.clear();
+		mComputed = false;
 	}
 
 	emit infoSignal((antiAliasing) ? tr("Anti Aliasing Enabled") : tr("Anti Aliasing Disabled"));
@@ -1578,81 +1663,384 @@ QImage DkImageStorage::getImage(float factor) {
 	if (factor >= 0.5f || mImg.isNull() || !DkSettingsManager::param().display().antiAliasing)
 		return mImg;
 
-	// check if we have an image similar to that requested
-	for (int idx = 0; idx < mImgs.size(); idx++) {
+	computeImage();
+
+	return level(factor);
+}
+
+/**
+ * Returns the smallest pyramid level that is not smaller than size.
+ * Widgets such as the overview or the histogram should use this
+ * instead of rescaling the original image.
+ * The pyramid is computed if it does not exist yet.
+ * @param size the size needed (the aspect ratio is kept)
+ * @return QImage a pyramid level or the original image if no level is available (yet).
+ **/
+QImage DkImageStorage::image(const QSize& size) {
+
+	if (mImg.isNull() || size.isEmpty())
+		return mImg;
+
+	float factor = qMin((float)size.width() / mImg.width(), (float)size.height() / mImg.height());
+
+	if (factor >= 0.5f)
+		return mImg;
+
+	computeImage();
+
+	return level(factor);
+}
+
+QImage DkImageStorage::level(float factor) const {
+
+	QMutexLocker locker(&mMutex);
+
+	// levels are sorted by size - so take the smallest one that is large enough
+	for (int idx = mImgs.size()-1; idx >= 0; idx--) {
 
 		if ((float)mImgs.at(idx).height()/mImg.height() >= factor)
 			return mImgs.at(idx);
 	}
 
-	// if the image does not exist - create it
-	if (!mBusy && mImgs.empty() && /*img.colorTable().isEmpty() &&*/ mImg.width() > 32 && mImg.height() > 32) {
-		mStop = false;
-		// nobody is busy so start working
-		QMetaObject::invokeMethod(this, "computeImage", Qt::QueuedConnection);
-	}
-
 	// currently no alternative is available
 	return mImg;
 }
 
 void DkImageStorage::computeImage() {
 
-	// obviously, computeImage gets called multiple times in some wired cases...
-	if (!mImgs.empty())
+	// nobody is busy so start working
+	if (mComputed || mImg.isNull() || mImg.width() <= min_level_size*2 || mImg.height() <= min_level_size*2)
 		return;
 
-	DkTimer dt;
-	mBusy = true;
-	QImage resizedImg = mImg;
-	
+	mComputed = true;
+	mStop.store(0);
+	mComputeFuture = QtConcurrent::run(this, &nmc::DkImageStorage::computePyramid, mImg);
+}
+
+void DkImageStorage::cancel() {
 
-	// down sample the image until it is twice times full HD
-	QSize iSize = mImg.size();
-	while (iSize.width() > 2*1920 && iSize.height() > 2*1920)	// in general we need less than 200 ms for the whole downscaling if we start at 1500 x 1500
-		iSize *= 0.5;
+	// the workers check mStop for each row band - so we do not have to wait long
+	mStop.store(1);
+	mComputeFuture.waitForFinished();
+}
 
-	// for extreme panorama images the Qt scaling crashes (if we have a width > 30000) so we simply 
-	if (qMax(iSize.width(), iSize.height()) < 20000)
-		resizedImg = resizedImg.scaled(iSize, Qt::KeepAspectRatio, Qt::FastTransformation);
+void DkImageStorage::computePyramid(const QImage& img) {
+
+	DkTimer dt;
+	QImage resizedImg = img;
 
 	// it would be pretty strange if we needed more than 30 sub-images
 	for (int idx = 0; idx < 30; idx++) {
 
-		QSize s = resizedImg.size();
-		s *= 0.5;
-
-		if (s.width() < 32 || s.height() < 32)
+		if (resizedImg.width()/2 < min_level_size || resizedImg.height()/2 < min_level_size)
 			break;
 
-#ifdef WITH_OPENCV
-		cv::Mat rImgCv = DkImage::qImage2Mat(resizedImg);
-		cv::Mat tmp;
-		cv::resize(rImgCv, tmp, cv::Size(s.width(), s.height()), 0, 0, CV_INTER_AREA);
-		resizedImg = DkImage::mat2QImage(tmp);
-#else
-		resizedImg = resizedImg.scaled(s, Qt::KeepAspectRatio, Qt::SmoothTransformation);
-#endif
+		resizedImg = halve(resizedImg, &mStop);
 
 		// new image assigned?
-		if (mStop)
-			break;
+		if (mStop.load() || resizedImg.isNull())
+			return;
+
+		// large levels are just intermediate results (memory)
+		if (qMin(resizedImg.width(), resizedImg.height()) > max_level_size)
+			continue;
 
 		mMutex.lock();
-		mImgs.push_front(resizedImg);
+		mImgs.append(resizedImg);
 		mMutex.unlock();
+
+		// tell my caller I did something
+		emit imageUpdated();
 	}
 
-	mBusy = false;
+	qDebug() << "pyramid computation took me: " << dt << " layers: " << mImgs.size();
+}
 
-	// tell my caller I did something
-	emit imageUpdated();
+/**
+ * Halves the image using a 2x2 box filter in linear light.
+ * Row bands are processed in parallel. Colors of images with alpha
+ * are unpremultiplied, linearized and weighted by their alpha -
+ * otherwise semi-transparent edges darken at every level.
+ * The result is premultiplied (that is what QPainter draws fastest).
+ * @param img the image to be down-sampled
+ * @param stop if set to non-zero, the computation is canceled
+ * @return QImage the image with half the width & height (null if canceled).
+ **/
+QImage DkImageStorage::halve(const QImage& img, const QAtomicInt* stop) {
 
-	qDebug() << "pyramid computation took me: " << dt << " layers: " << mImgs.size();
+	static const DkGammaLut lut;
+
+	bool alpha = img.hasAlphaChannel();
+	QImage::Format sFormat = alpha ? QImage::Format_ARGB32 : QImage::Format_RGB32;
+	QImage::Format dFormat = alpha ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32;
+
+	QImage src = (img.format() == sFormat) ? img : img.convertToFormat(sFormat);
+	QImage dst(src.width()/2, src.height()/2, dFormat);
+
+	if (dst.isNull())
+		return dst;
+
+	// get the pointers here - QImage::scanLine() is not thread-safe
+	const uchar* sBits = src.constBits();
+	uchar* dBits = dst.bits();
+	int sBpl = src.bytesPerLine();
+	int dBpl = dst.bytesPerLine();
+	int dWidth = dst.width();
+	int dHeight = dst.height();
+
+	QVector<int> bands;
+	for (int rIdx = 0; rIdx < dHeight; rIdx += band_rows)
+		bands << rIdx;
+
+	QtConcurrent::blockingMap(bands, [&](int band) {
+
+		int end = qMin(band + (int)band_rows, dHeight);
+
+		for (int rIdx = band; rIdx < end; rIdx++) {
+
+			if (stop && stop->load())
+				return;
+
+			const QRgb* s0 = (const QRgb*)(sBits + 2*rIdx*sBpl);
+			const QRgb* s1 = (const QRgb*)(sBits + (2*rIdx+1)*sBpl);
+			QRgb* d = (QRgb*)(dBits + rIdx*dBpl);
+
+			if (!alpha) {
+
+				for (int cIdx = 0; cIdx < dWidth; cIdx++, s0 += 2, s1 += 2) {
+
+					// 4 x 16 bit >> 6 = 12 bit index
+					int r = (lut.toLinear[qRed(s0[0])] + lut.toLinear[qRed(s0[1])] + lut.toLinear[qRed(s1[0])] + lut.toLinear[qRed(s1[1])]) >> 6;
+					int g = (lut.toLinear[qGreen(s0[0])] + lut.toLinear[qGreen(s0[1])] + lut.toLinear[qGreen(s1[0])] + lut.toLinear[qGreen(s1[1])]) >> 6;
+					int b = (lut.toLinear[qBlue(s0[0])] + lut.toLinear[qBlue(s0[1])] + lut.toLinear[qBlue(s1[0])] + lut.toLinear[qBlue(s1[1])]) >> 6;
+
+					d[cIdx] = qRgb(lut.toSRGB[r], lut.toSRGB[g], lut.toSRGB[b]);
+				}
+				continue;
+			}
+
+			for (int cIdx = 0; cIdx < dWidth; cIdx++, s0 += 2, s1 += 2) {
+
+				int a00 = qAlpha(s0[0]), a01 = qAlpha(s0[1]), a10 = qAlpha(s1[0]), a11 = qAlpha(s1[1]);
+				int sumA = a00 + a01 + a10 + a11;
+
+				if (sumA == 0) {
+					d[cIdx] = 0;
+					continue;
+				}
+
+				// alpha weighted mean in linear light (16 bit) >> 4 = 12 bit index
+				int r = (lut.toLinear[qRed(s0[0])]*a00 + lut.toLinear[qRed(s0[1])]*a01 + lut.toLinear[qRed(s1[0])]*a10 + lut.toLinear[qRed(s1[1])]*a11) / sumA >> 4;
+				int g = (lut.toLinear[qGreen(s0[0])]*a00 + lut.toLinear[qGreen(s0[1])]*a01 + lut.toLinear[qGreen(s1[0])]*a10 + lut.toLinear[qGreen(s1[1])]*a11) / sumA >> 4;
+				int b = (lut.toLinear[qBlue(s0[0])]*a00 + lut.toLinear[qBlue(s0[1])]*a01 + lut.toLinear[qBlue(s1[0])]*a10 + lut.toLinear[qBlue(s1[1])]*a11) / sumA >> 4;
+				int a = (sumA + 2) >> 2;
+
+				// encode & premultiply
+				d[cIdx] = qRgba((lut.toSRGB[r]*a + 127) / 255, (lut.toSRGB[g]*a + 127) / 255, (lut.toSRGB[b]*a + 127) / 255, a);
+			}
+		}
+	});
+
+	if (stop && stop->load())
+		return QImage();
+
+	return dst;
+}
+
+// DkTiledImage --------------------------------------------------------------------
+DkTiledImage::DkTiledImage(const QString& filePath, const QSize& size) {
+
+	mFilePath = filePath;
+	mSize = size;
+
+	// cost is measured in KB
+	mCache.setMaxCost(qMax(qRound(DkSettingsManager::param().resources().tileCacheMemory*1024), 1));
+
+	// we are created by the loader thread - however, signals are sent to the GUI
+	moveToThread(QCoreApplication::instance()->thread());
+}
+
+DkTiledImage::~DkTiledImage() {
+
+	mMutex.lock();
+	mQueue.clear();
+	QVector<QFuture<void> > futures = mFutures;
+	mMutex.unlock();
+
+	// wait for tiles that are currently decoded
+	for (QFuture<void> f : futures)
+		f.waitForFinished();
+}
+
+/**
+ * Returns true if the image is large and can be decoded region-wise.
+ * Qt's jpg plugin supports clipping & scaling while decoding, for other
+ * formats Qt would decode the whole image for each tile.
+ * @param reader an image reader with the file or buffer set.
+ * @return bool true if the image should be tiled.
+ **/
+bool DkTiledImage::isTileable(const QImageReader& reader) {
+
+	if (!reader.supportsOption(QImageIOHandler::ClipRect) ||
+		!reader.supportsOption(QImageIOHandler::ScaledSize))
+		return false;
+
+	QSize s = reader.size();
+
+	return s.isValid() && qMax(s.width(), s.height()) > min_size;
+}
+
+QString DkTiledImage::filePath() const {
+	return mFilePath;
+}
+
+QSize DkTiledImage::size() const {
+	return mSize;
+}
+
+QSize DkTiledImage::previewSize() const {
+
+	QSize s = mSize.scaled(QSize(preview_size, preview_size), Qt::KeepAspectRatio);
+
+	return s.expandedTo(QSize(1, 1));
+}
+
+/**
+ * Returns the pyramid level for a given scale factor.
+ * @param scale the scale factor (screen pixel per full resolution pixel).
+ * @return int the level that has at least the resolution requested.
+ **/
+int DkTiledImage::level(double scale) const {
+
+	if (scale >= 1.0 || scale <= 0.0)
+		return 0;
+
+	int level = qFloor(log(1.0/scale)/log(2.0));
+	int maxLevel = qCeil(log(qMax(mSize.width(), mSize.height())/(double)tile_size)/log(2.0));
+
+	return qBound(0, level, qMax(maxLevel, 0));
+}
+
+/**
+ * Returns all decoded tiles that intersect rect.
+ * Missing tiles are decoded in the background. Tiles that were
+ * requested before but are not visible anymore are dropped.
+ * tileLoaded() is emitted if a new tile is available.
+ * @param rect the visible rectangle in full resolution coordinates.
+ * @param level the pyramid level.
+ * @return QVector<DkTile> the tiles which are ready to be rendered.
+ **/
+QVector<DkTile> DkTiledImage::tiles(const QRectF& rect, int level) {
+
+	QVector<DkTile> tiles;
+	QRect r = rect.toAlignedRect().intersected(QRect(QPoint(), mSize));
+
+	if (r.isEmpty())
+		return tiles;
+
+	int ts = tile_size << level;	// tile size in full resolution
+	QPointF c = QRectF(r).center();
+
+	QMutexLocker locker(&mMutex);
+	QVector<QPair<double, quint64> > missing;
+
+	for (int y = r.top()/ts; y <= r.bottom()/ts; y++) {
+		for (int x = r.left()/ts; x <= r.right()/ts; x++) {
+
+			quint64 key = tileKey(level, x, y);
+			QImage* img = mCache.object(key);
+
+			if (img) {
+				DkTile t;
+				t.rect = tileRect(level, x, y);
+				t.image = *img;
+				tiles << t;
+			}
+			else if (!mPending.contains(key)) {
+				QPointF d = QRectF(tileRect(level, x, y)).center() - c;
+				missing << qMakePair(d.x()*d.x() + d.y()*d.y(), key);
+			}
+		}
+	}
+
+	// decode the center first
+	qSort(missing.begin(), missing.end());
+
+	mQueue.clear();
+	for (const QPair<double, quint64>& m : missing)
+		mQueue << m.second;
+
+	startWorkers();
+
+	return tiles;
+}
+
+/**
+ * Starts decoding queued tiles.
+ * Note: the mutex must be locked when calling this function.
+ **/
+void DkTiledImage::startWorkers() {
+
+	// clean up
+	for (int idx = mFutures.size() - 1; idx >= 0; idx--) {
+		if (mFutures[idx].isFinished())
+			mFutures.remove(idx);
+	}
+
+	int maxThreads = qMax(QThread::idealThreadCount() - 1, 1);
+
+	while (mPending.size() < maxThreads && !mQueue.empty()) {
+
+		quint64 key = mQueue.takeFirst();
+		mPending.insert(key);
+		mFutures << QtConcurrent::run(this, &nmc::DkTiledImage::loadTile, key);
+	}
+}
+
+void DkTiledImage::loadTile(quint64 key) {
+
+	DkTimer dt;
+
+	int level = (int)(key >> 56);
+	int y = (int)((key >> 28) & 0xFFFFFFF);
+	int x = (int)(key & 0xFFFFFFF);
+
+	QRect r = tileRect(level, x, y);
+	int f = 1 << level;
+
+	// the jpg decoder clips the rect and uses DCT scaling - so only the tile is decoded
+	QImageReader reader(mFilePath);
+	reader.setClipRect(r);
+	reader.setScaledSize(QSize((r.width() + f - 1)/f, (r.height() + f - 1)/f));
+
+	QImage img = reader.read();
+
+	QMutexLocker locker(&mMutex);
+	mPending.remove(key);
+
+	if (!img.isNull()) {
+		int cost = qMax(img.byteCount()/1024, 1);
+		mCache.insert(key, new QImage(img), cost);
+	}
+	else
+		qWarning() << "could not decode tile" << r << "of" << mFilePath << reader.errorString();
+
+	startWorkers();
+	locker.unlock();
+
+	emit tileLoaded();
+}
+
+QRect DkTiledImage::tileRect(int level, int x, int y) const {
+
+	int ts = tile_size << level;
+
+	return QRect(x*ts, y*ts, ts, ts).intersected(QRect(QPoint(), mSize));
+}
 
-	if (mImgs.size() > 6)
-		qDebug() << "layer size > 6: " << mImg.size();
+quint64 DkTiledImage::tileKey(int level, int x, int y) {
 
+	return ((quint64)level << 56) | ((quint64)y << 28) | (quint64)x;
 }
 
 }
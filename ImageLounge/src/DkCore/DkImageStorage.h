@@ -33,6 +33,10 @@
 #include <QVector>
 #include <QObject>
 #include <QColor>
+#include <QCache>
+#include <QFuture>
+#include <QSet>
+#include <QAtomicInt>
 
 // opencv
 #ifdef WITH_OPENCV
@@ -47,6 +51,8 @@
 #pragma warning(disable: 4714)	// Qt's force inline
 #endif
 
+#include "DkMemoryManager.h"
+
 #ifndef DllCoreExport
 #ifdef DK_CORE_DLL_EXPORT
 #define DllCoreExport Q_DECL_EXPORT
@@ -62,6 +68,7 @@ class QPixmap;
 class QString;
 class QSize;
 class QColor;
+class QImageReader;
 
 namespace nmc {
 
@@ -128,6 +135,7 @@ public:
 	static QColor getMeanColor(const QImage& img);
 	static uchar findHistPeak(const int* hist, float quantile = 0.005f);
 	static QPixmap makeSquare(const QPixmap& pm);
+	static QImage makeSquare(const QImage& img);
 	static QPixmap merge(const QVector<QImage>& imgs);
 	static QImage cropToImage(const QImage& src, const DkRotatingRect& rect, const QColor& fillColor = QColor());
 	static QImage hueSaturation(const QImage& src, int hue, int sat, int brightness);
@@ -141,19 +149,41 @@ public:
 	
 };
 
-class DllCoreExport DkImageStorage : public QObject {
+/**
+ * DkImageStorage holds the current image and its down-sampled pyramid.
+ * The pyramid is computed in the background with a 2x2 box filter
+ * that averages in linear light. Each level is published as soon
+ * as it exists (imageUpdated is emitted) so that it can be used
+ * while smaller levels are still computed.
+ **/
+class DllCoreExport DkImageStorage : public QObject, public DkMemoryClient {
 	Q_OBJECT
 
 public:
 	DkImageStorage(const QImage& img = QImage());
+	virtual ~DkImageStorage();
+
+	// DkMemoryClient
+	float memoryUsage(int subsystem) const override;
+	float releaseMemory(int subsystem, float mem) override;
+
+	enum {
+		max_level_size = 2*1920,	// larger levels are not kept
+		min_level_size = 32,
+		band_rows = 32,				// rows per worker task
+	};
 
 	void setImage(const QImage& img);
+	void setPinned(bool pinned);
 	QImage getImageConst() const;
 	QImage getImage(float factor = 1.0f);
+	QImage image(const QSize& size);
 	bool hasImage() const {
 		return !mImg.isNull();
 	}
 
+	static QImage halve(const QImage& img, const QAtomicInt* stop = 0);
+
 public slots:
 	void computeImage();
 	void antiAliasingChanged(bool antiAliasing);
@@ -163,13 +193,74 @@ signals:
 	void infoSignal(const QString& msg) const;
 
 protected:
+	void cancel();
+	void computePyramid(const QImage& img);
+	QImage level(float factor) const;
+
 	QImage mImg;
-	QVector<QImage> mImgs;
+	QVector<QImage> mImgs;	// pyramid - largest level first
+
+	mutable QMutex mMutex;
+	QFuture<void> mComputeFuture;
+	QAtomicInt mStop;
+	bool mComputed = false;
+	bool mPinned = false;	// the pyramid is not released (e.g. if it is shown)
+};
+
+class DllCoreExport DkTile {
+
+public:
+	QRect rect;		// tile rectangle in full resolution coordinates
+	QImage image;	// decoded tile (might be down-scaled)
+};
+
+/**
+ * DkTiledImage decodes gigapixel images on demand.
+ * Only a preview is kept in the loader. If the user zooms in,
+ * the visible tiles are decoded (threaded) at the level needed.
+ * Level 0 is the full resolution, each level halves the size.
+ * Decoded tiles are kept in a cache which is bounded by
+ * resources().tileCacheMemory.
+ **/
+class DllCoreExport DkTiledImage : public QObject {
+	Q_OBJECT
+
+public:
+	DkTiledImage(const QString& filePath, const QSize& size);
+	virtual ~DkTiledImage();
+
+	enum {
+		tile_size = 512,		// tile size in pixels (at any level)
+		preview_size = 4096,	// maximal side of the preview
+		min_size = 16384,		// images with a larger side are tiled
+	};
+
+	static bool isTileable(const QImageReader& reader);
+
+	QString filePath() const;
+	QSize size() const;
+	QSize previewSize() const;
+	int level(double scale) const;
+
+	QVector<DkTile> tiles(const QRectF& rect, int level);
+
+signals:
+	void tileLoaded() const;
+
+protected:
+	void loadTile(quint64 key);
+	void startWorkers();
+	QRect tileRect(int level, int x, int y) const;
+	static quint64 tileKey(int level, int x, int y);
+
+	QString mFilePath;
+	QSize mSize;
 
 	QMutex mMutex;
-	QThread* mComputeThread = 0;
-	bool mBusy = false;
-	bool mStop = true;
+	QCache<quint64, QImage> mCache;
+	QList<quint64> mQueue;		// tiles requested - sorted by priority
+	QSet<quint64> mPending;		// tiles that are currently decoded
+	QVector<QFuture<void> > mFutures;
 };
 
 };
@@ -0,0 +1,273 @@
+/*******************************************************************************************************
+ DkKeywordFilter.cpp
+ Created on:	18.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#include "DkKeywordFilter.h"
+
+#pragma warning(push, 0)	// no warnings from includes - begin
+#include <QRegExp>
+#include <QVarLengthArray>
+#include <QQueue>
+#pragma warning(pop)		// no warnings from includes - end
+
+namespace nmc {
+
+// DkKeywordFilter --------------------------------------------------------------------
+/**
+ * Compiles a new filter.
+ * @param keywords strings must contain all keywords.
+ * @param ignoreKeywords strings must not contain any ignore keyword.
+ * @param query white space separated terms (like keywords) - see DkUtils::filterStringList.
+ **/
+DkKeywordFilter::DkKeywordFilter(const QStringList& keywords, const QStringList& ignoreKeywords, const QString& query) : 
+	mKeywords(keywords), mIgnoreKeywords(ignoreKeywords), mQuery(query) {
+
+	// root
+	mFailure << 0;
+	mOutputs << QVector<int>();
+
+	// the pattern index encodes the pattern's type - so keep this order
+	for (const QString& kw : keywords)
+		mNumKeywords += addPattern(kw);
+
+	for (const QString& term : queryTerms(query))
+		mNumQueryTerms += addPattern(term);
+
+	for (const QString& kw : ignoreKeywords)
+		mNumIgnoreKeywords += addPattern(kw);
+
+	compile();
+}
+
+bool DkKeywordFilter::isEmpty() const {
+	return mNumKeywords + mNumQueryTerms + mNumIgnoreKeywords == 0;
+}
+
+/**
+ * Returns true if the filter was compiled from these keywords.
+ * This allows for keeping the filter if the keywords did not change.
+ **/
+bool DkKeywordFilter::isCompiledFrom(const QStringList& keywords, const QStringList& ignoreKeywords, const QString& query) const {
+	return mKeywords == keywords && mIgnoreKeywords == ignoreKeywords && mQuery == query;
+}
+
+/**
+ * Returns true if str passes the keyword filters.
+ * The regular expression fallback of the query is not applied here.
+ **/
+bool DkKeywordFilter::accepts(const QString& str) const {
+
+	bool queryMatched = false;
+	return match(str, queryMatched) && queryMatched;
+}
+
+/**
+ * Filters a list of strings.
+ * If no string matches the query terms, the query is
+ * matched as regular expression (and then as wildcard) instead.
+ * @param list the strings.
+ * @return QStringList the accepted strings.
+ **/
+QStringList DkKeywordFilter::filter(const QStringList& list) const {
+
+	if (isEmpty())
+		return list;
+
+	QStringList resultList;
+	QStringList queryCandidates;	// strings that only fail the query terms
+
+	for (const QString& str : list) {
+
+		bool queryMatched = false;
+
+		if (!match(str, queryMatched))
+			continue;
+
+		if (queryMatched)
+			resultList << str;
+		else
+			queryCandidates << str;
+	}
+
+	// if string match returns nothing -> try a regexp
+	if (resultList.empty() && !mQuery.isEmpty()) {
+		QRegExp regExp(mQuery);
+		resultList = queryCandidates.filter(regExp);
+
+		if (resultList.empty()) {
+			regExp.setPatternSyntax(QRegExp::Wildcard);
+			resultList = queryCandidates.filter(regExp);
+		}
+	}
+
+	return resultList;
+}
+
+/**
+ * Splits a search query into its terms.
+ * White space separates terms, a leading or trailing space is significant
+ * (it is added to the first/last term - which is then matched with and without the space).
+ **/
+QStringList DkKeywordFilter::queryTerms(const QString& query) {
+
+	if (query.isEmpty())
+		return QStringList();
+
+	// white space is the magic thingy
+	QStringList queries = query.split(" ");
+
+	for (int idx = 0; idx < queries.size(); idx++) {
+		// Detect and correct special case where a space is leading or trailing the search term - this should be significant
+		if (idx == 0 && queries.size() > 1 && queries[idx].size() == 0) queries[idx] = " " + queries[idx + 1];
+		if (idx == queries.size() - 1 && queries.size() > 2 && queries[idx].size() == 0) queries[idx] = queries[idx - 1] + " ";
+	}
+
+	return queries;
+}
+
+/**
+ * Adds a pattern to the trie.
+ * @return int 1 if the pattern was added, 0 if it is empty (empty patterns match anything).
+ **/
+int DkKeywordFilter::addPattern(const QString& pattern) {
+
+	if (pattern.isEmpty())
+		return 0;
+
+	int state = 0;
+
+	for (const QChar& c : pattern) {
+
+		quint64 key = transitionKey(state, c.toCaseFolded().unicode());
+		int nextState = mTransitions.value(key, -1);
+
+		if (nextState == -1) {
+			nextState = mFailure.size();
+			mTransitions.insert(key, nextState);
+			mFailure << 0;
+			mOutputs << QVector<int>();
+		}
+
+		state = nextState;
+	}
+
+	mOutputs[state] << mNumKeywords + mNumQueryTerms + mNumIgnoreKeywords;
+
+	return 1;
+}
+
+/**
+ * Computes the failure links of the trie (breadth first).
+ **/
+void DkKeywordFilter::compile() {
+
+	// children of each state
+	QVector<QVector<QPair<ushort, int> > > children(mFailure.size());
+	for (auto it = mTransitions.constBegin(); it != mTransitions.constEnd(); ++it)
+		children[(int)(it.key() >> 16)] << qMakePair((ushort)(it.key() & 0xFFFF), it.value());
+
+	QQueue<int> queue;
+	for (const QPair<ushort, int>& child : children[0])
+		queue.enqueue(child.second);	// failure is the root
+
+	while (!queue.isEmpty()) {
+
+		int state = queue.dequeue();
+
+		for (const QPair<ushort, int>& child : children[state]) {
+
+			int failure = mFailure[state];
+			while (failure != 0 && mTransitions.value(transitionKey(failure, child.first), -1) == -1)
+				failure = mFailure[failure];
+
+			int target = mTransitions.value(transitionKey(failure, child.first), 0);
+			mFailure[child.second] = target;
+			mOutputs[child.second] += mOutputs[target];	// target was visited before (it is less deep)
+
+			queue.enqueue(child.second);
+		}
+	}
+}
+
+/**
+ * Scans str once and tracks all patterns found.
+ * @param str the string.
+ * @param queryMatched true if all query terms were found.
+ * @return bool false if an ignore keyword was found or a keyword is missing.
+ **/
+bool DkKeywordFilter::match(const QString& str, bool& queryMatched) const {
+
+	int numIncluded = mNumKeywords + mNumQueryTerms;
+
+	QVarLengthArray<bool, 64> found(numIncluded);
+	for (int idx = 0; idx < numIncluded; idx++)
+		found[idx] = false;
+
+	int numKeywordsFound = 0;
+	int numTermsFound = 0;
+	int state = 0;
+
+	for (const QChar& c : str) {
+
+		state = next(state, c.toCaseFolded().unicode());
+
+		for (int pIdx : mOutputs.at(state)) {
+
+			if (pIdx >= numIncluded)
+				return false;	// ignore keyword
+
+			if (!found[pIdx]) {
+				found[pIdx] = true;
+				pIdx < mNumKeywords ? numKeywordsFound++ : numTermsFound++;
+			}
+		}
+	}
+
+	queryMatched = numTermsFound == mNumQueryTerms;
+
+	return numKeywordsFound == mNumKeywords;
+}
+
+int DkKeywordFilter::next(int state, ushort c) const {
+
+	for (;;) {
+		int nextState = mTransitions.value(transitionKey(state, c), -1);
+
+		if (nextState != -1)
+			return nextState;
+
+		if (state == 0)
+			return 0;
+
+		state = mFailure.at(state);
+	}
+}
+
+quint64 DkKeywordFilter::transitionKey(int state, ushort c) {
+	return ((quint64)state << 16) | c;
+}
+
+}
@@ -0,0 +1,96 @@
+/*******************************************************************************************************
+ DkKeywordFilter.h
+ Created on:	18.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#pragma once
+
+#pragma warning(push, 0)	// no warnings from includes - begin
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+#pragma warning(pop)		// no warnings from includes - end
+
+#pragma warning(disable: 4251)	// TODO: remove
+
+#ifndef DllCoreExport
+#ifdef DK_CORE_DLL_EXPORT
+#define DllCoreExport Q_DECL_EXPORT
+#elif DK_DLL_IMPORT
+#define DllCoreExport Q_DECL_IMPORT
+#else
+#define DllCoreExport Q_DECL_IMPORT
+#endif
+#endif
+
+namespace nmc {
+
+/**
+ * Filters strings (e.g. file names) by keywords.
+ * A string is accepted if it contains all keywords and all terms of the
+ * query but none of the ignore keywords (case insensitive).
+ * All keywords are compiled into one Aho-Corasick automaton, so each string
+ * is scanned once - no matter how many keywords there are.
+ * If the query terms do not match any string, filter() falls back to
+ * interpreting the query as regular expression (and wildcard).
+ **/
+class DllCoreExport DkKeywordFilter {
+
+public:
+	DkKeywordFilter(const QStringList& keywords = QStringList(), const QStringList& ignoreKeywords = QStringList(), const QString& query = QString());
+
+	bool isEmpty() const;
+	bool isCompiledFrom(const QStringList& keywords, const QStringList& ignoreKeywords, const QString& query) const;
+
+	bool accepts(const QString& str) const;
+	QStringList filter(const QStringList& list) const;
+
+	static QStringList queryTerms(const QString& query);
+
+protected:
+	int addPattern(const QString& pattern);
+	void compile();
+	bool match(const QString& str, bool& queryMatched) const;
+	int next(int state, ushort c) const;
+
+	static quint64 transitionKey(int state, ushort c);
+
+	QStringList mKeywords;
+	QStringList mIgnoreKeywords;
+	QString mQuery;
+
+	// patterns: [keywords | query terms | ignore keywords]
+	int mNumKeywords = 0;
+	int mNumQueryTerms = 0;
+	int mNumIgnoreKeywords = 0;
+
+	// automaton
+	QHash<quint64, int> mTransitions;	// (state, case folded char) -> state
+	QVector<int> mFailure;				// longest suffix state
+	QVector<QVector<int> > mOutputs;	// patterns that end in a state
+};
+
+}
@@ -0,0 +1,244 @@
+/*******************************************************************************************************
+ DkMemoryManager.cpp
+ Created on:	18.10.2026
+ 
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+ 
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#include "DkMemoryManager.h"
+#include "DkSettings.h"
+#include "DkUtils.h"
+#include "DkTimer.h"
+
+#pragma warning(push, 0)	// no warnings from includes - begin
+#include <QDebug>
+#include <QStringList>
+#include <QObject>
+#include <QAtomicInt>
+#pragma warning(pop)		// no warnings from includes - end
+
+namespace nmc {
+
+// DkMemoryClient --------------------------------------------------------------------
+static QAtomicInt sNextClientId(1);
+
+DkMemoryClient::DkMemoryClient() : mMemoryClientId(sNextClientId.fetchAndAddRelaxed(1)) {
+}
+
+DkMemoryClient::~DkMemoryClient() {
+
+	// derived classes should unregister before their members are destroyed - this is our safety net
+	DkMemoryManager::instance().unregisterClient(this);
+}
+
+int DkMemoryClient::memoryClientId() const {
+	return mMemoryClientId;
+}
+
+// DkMemoryManager --------------------------------------------------------------------
+DkMemoryManager& DkMemoryManager::instance() {
+	static DkMemoryManager inst;
+	return inst;
+}
+
+void DkMemoryManager::registerClient(DkMemoryClient* client, int subsystem, int priority) {
+
+	if (!client || subsystem < 0 || subsystem >= mem_end)
+		return;
+
+	DkMemoryEntry e;
+	e.client = client;
+	e.clientId = client->memoryClientId();
+	e.subsystem = subsystem;
+	e.priority = priority;
+
+	QMutexLocker locker(&mMutex);
+	mEntries << e;
+}
+
+void DkMemoryManager::unregisterClient(DkMemoryClient* client) {
+
+	if (!client)
+		return;
+
+	int clientId = client->memoryClientId();
+	QMutexLocker locker(&mMutex);
+
+	for (int idx = mEntries.size()-1; idx >= 0; idx--) {
+		if (mEntries[idx].clientId == clientId)
+			mEntries.remove(idx);
+	}
+}
+
+/**
+ * Returns the memory budget in MB.
+ * If the budget is not set, half of the physical memory is used.
+ **/
+float DkMemoryManager::budget() const {
+
+	float budget = DkSettingsManager::param().resources().memoryBudget;
+
+	if (budget <= 0) {
+		double totalMem = DkMemory::getTotalMemory();
+		budget = (totalMem > 0) ? (float)(totalMem*0.5) : 2048.0f;
+	}
+
+	return budget;
+}
+
+float DkMemoryManager::usage() const {
+
+	float mem = 0;
+
+	for (int idx = 0; idx < mem_end; idx++)
+		mem += usage(idx);
+
+	return mem;
+}
+
+float DkMemoryManager::usage(int subsystem) const {
+
+	float mem = 0;
+
+	for (const DkMemoryEntry& e : entries()) {
+		if (e.subsystem == subsystem)
+			mem += e.client->memoryUsage(subsystem);
+	}
+
+	return mem;
+}
+
+/**
+ * Returns a human readable summary of the current memory usage.
+ **/
+QString DkMemoryManager::usageInfo() const {
+
+	QStringList info;
+
+	for (int idx = 0; idx < mem_end; idx++)
+		info << QObject::tr("%1: %2 MB").arg(subsystemName(idx)).arg(usage(idx), 0, 'f', 1);
+
+	info << QObject::tr("total: %1 MB of %2 MB").arg(usage(), 0, 'f', 1).arg(budget(), 0, 'f', 0);
+
+	return info.join(", ");
+}
+
+/**
+ * Returns a copy of the registered clients.
+ * Clients must never be called while the mutex is locked.
+ **/
+QVector<DkMemoryManager::DkMemoryEntry> DkMemoryManager::entries() const {
+
+	QMutexLocker locker(&mMutex);
+	return mEntries;
+}
+
+bool DkMemoryManager::isRegistered(const DkMemoryEntry& entry) const {
+
+	QMutexLocker locker(&mMutex);
+
+	for (const DkMemoryEntry& e : mEntries) {
+		if (e.clientId == entry.clientId && e.subsystem == entry.subsystem)
+			return true;
+	}
+
+	return false;
+}
+
+QString DkMemoryManager::subsystemName(int subsystem) {
+
+	switch (subsystem) {
+	case mem_cache:		return QObject::tr("cache");
+	case mem_history:	return QObject::tr("history");
+	case mem_scaled:	return QObject::tr("scaled images");
+	case mem_pyramid:	return QObject::tr("pyramid");
+	case mem_thumbs:	return QObject::tr("thumbnails");
+	}
+
+	return QObject::tr("unknown");
+}
+
+/**
+ * Releases memory if the budget is exceeded.
+ * Clients with low priority are asked first. Within
+ * one priority, the subsystem using most memory goes first.
+ * @return float the memory released in MB.
+ **/
+float DkMemoryManager::balance() {
+
+	// releasing memory might trigger another balance
+	if (mBalancing)
+		return 0;
+
+	DkTimer dt;
+	float limit = budget();
+
+	mBalancing = true;
+
+	// clients are called without the lock - they might (un)register or query the manager
+	QVector<DkMemoryEntry> cEntries = entries();
+	QVector<float> mem(cEntries.size());
+	float total = 0;
+
+	for (int idx = 0; idx < cEntries.size(); idx++) {
+		mem[idx] = cEntries[idx].client->memoryUsage(cEntries[idx].subsystem);
+		total += mem[idx];
+	}
+
+	float released = 0;
+
+	if (total > limit) {
+
+		QVector<int> order;
+		for (int idx = 0; idx < cEntries.size(); idx++)
+			order << idx;
+
+		qSort(order.begin(), order.end(), [&](int l, int r) {
+			if (cEntries[l].priority != cEntries[r].priority)
+				return cEntries[l].priority < cEntries[r].priority;
+			return mem[l] > mem[r];
+		});
+
+		for (int idx : order) {
+
+			if (total <= limit)
+				break;
+
+			// releasing memory of other clients might have destroyed this one
+			if (mem[idx] <= 0 || !isRegistered(cEntries[idx]))
+				continue;
+
+			float freed = cEntries[idx].client->releaseMemory(cEntries[idx].subsystem, total - limit);
+			total -= freed;
+			released += freed;
+		}
+
+		qInfo() << "[DkMemoryManager]" << released << "MB released in" << dt << "- now using" << total << "MB of" << limit << "MB";
+	}
+
+	mBalancing = false;
+
+	return released;
+}
+
+}
@@ -0,0 +1,133 @@
+/*******************************************************************************************************
+ DkMemoryManager.h
+ Created on:	18.10.2026
+ 
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+ 
+ Copyright (C) 2011-2016 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2016 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2016 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#pragma once
+
+#pragma warning(push, 0)	// no warnings from includes - begin
+#include <QVector>
+#include <QMutex>
+#include <QString>
+#pragma warning(pop)		// no warnings from includes - end
+
+#pragma warning(disable: 4251)	// TODO: remove
+
+#ifndef DllCoreExport
+#ifdef DK_CORE_DLL_EXPORT
+#define DllCoreExport Q_DECL_EXPORT
+#elif DK_DLL_IMPORT
+#define DllCoreExport Q_DECL_IMPORT
+#else
+#define DllCoreExport Q_DECL_IMPORT
+#endif
+#endif
+
+namespace nmc {
+
+/**
+ * Interface for objects that hold memory which can be released.
+ * Memory is measured in MB. Clients are identified by a unique id
+ * (addresses are reused) and unregistered when they are destroyed.
+ **/
+class DllCoreExport DkMemoryClient {
+
+public:
+	DkMemoryClient();
+	virtual ~DkMemoryClient();
+
+	int memoryClientId() const;
+
+	virtual float memoryUsage(int subsystem) const = 0;
+	virtual float releaseMemory(int subsystem, float mem) = 0;
+
+private:
+	int mMemoryClientId;
+};
+
+/**
+ * DkMemoryManager accounts the memory of all subsystems.
+ * Clients register the subsystems they hold memory for with a priority.
+ * If the total memory exceeds resources().memoryBudget, balance() asks
+ * the clients to release memory - lowest priority first.
+ * balance() must be called from the main thread.
+ **/
+class DllCoreExport DkMemoryManager {
+
+public:
+	static DkMemoryManager& instance();
+
+	// singleton
+	DkMemoryManager(DkMemoryManager const&)		= delete;
+	void operator=(DkMemoryManager const&)		= delete;
+
+	enum Subsystem {
+		mem_cache = 0,		// cached images of the current folder
+		mem_history,		// edit history (undo/redo)
+		mem_scaled,			// scaled copies of images
+		mem_pyramid,		// anti-aliasing pyramid of the viewports
+		mem_thumbs,			// thumbnails
+
+		mem_end
+	};
+
+	enum Priority {
+		priority_low = 0,
+		priority_medium,
+		priority_high,
+	};
+
+	void registerClient(DkMemoryClient* client, int subsystem, int priority = priority_medium);
+	void unregisterClient(DkMemoryClient* client);
+
+	float budget() const;
+	float usage() const;
+	float usage(int subsystem) const;
+	QString usageInfo() const;
+	static QString subsystemName(int subsystem);
+
+	float balance();
+
+private:
+	DkMemoryManager() {};
+
+	class DkMemoryEntry {
+
+	public:
+		DkMemoryClient* client;
+		int clientId;
+		int subsystem;
+		int priority;
+	};
+
+	QVector<DkMemoryEntry> entries() const;
+	bool isRegistered(const DkMemoryEntry& entry) const;
+
+	QVector<DkMemoryEntry> mEntries;
+	mutable QMutex mMutex;
+	bool mBalancing = false;
+};
+
+};
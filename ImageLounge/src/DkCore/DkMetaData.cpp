@@ -39,6 +39,7 @@
 #include <QBuffer>
 #include <QVector2D>
 #include <QApplication>
+#include <QMultiMap>
 #pragma warning(pop)		// no warnings from includes - end
 
 namespace nmc {
@@ -373,6 +374,30 @@ QSize DkMetaDataT::getImageSize() const {
 	return QSize(width, height);
 }
 
+/**
+ * Returns the image dimensions that exiv2 parsed from the file's header.
+ * In contrast to getImageSize(), these are not taken from the EXIF tags
+ * (which are not updated by all editors). Note that the header of RAW
+ * files might describe an embedded preview rather than the sensor data.
+ * @return QSize the image size or an empty size if it is unknown.
+ **/
+QSize DkMetaDataT::getPixelSize() const {
+
+	QSize size;
+
+	if (mExifState != loaded && mExifState != dirty)
+		return size;
+
+	try {
+		size = QSize(mExifImg->pixelWidth(), mExifImg->pixelHeight());
+	}
+	catch (...) {
+		qDebug() << "[Exiv2] could not read the pixel size";
+	}
+
+	return size;
+}
+
 QString DkMetaDataT::getNativeExifValue(const QString& key) const {
 
 	QString info;
@@ -715,6 +740,63 @@ QImage DkMetaDataT::getPreviewImage(int minPreviewWidth) const {
 	return qImg;
 }
 
+/**
+ * Returns the smallest embedded preview that covers size.
+ * RAW files and many JPGs carry several previews (e.g. the EXIF thumbnail, a screen
+ * sized and a full sized JPG). Decoding one of them is way cheaper than decoding the image.
+ * @param size the size in display orientation (e.g. the thumbnail or viewport size)
+ * @param mode Qt::KeepAspectRatio if the preview must not be up-scaled to fit into size,
+ * Qt::KeepAspectRatioByExpanding if it must not be up-scaled to fill size
+ * @return QImage the preview (not rotated) or a null image if no preview is large enough
+ **/
+QImage DkMetaDataT::getBestFitPreview(const QSize& size, Qt::AspectRatioMode mode) const {
+
+	QImage qImg;
+
+	if (size.isEmpty() || (mExifState != loaded && mExifState != dirty))
+		return qImg;
+
+	// previews are not rotated
+	QSize s = (qAbs(getOrientationDegree()) == 90) ? size.transposed() : size;
+	uint32_t w = (uint32_t)s.width();
+	uint32_t h = (uint32_t)s.height();
+
+	try {
+
+		Exiv2::PreviewManager loader(*mExifImg);
+		Exiv2::PreviewPropertiesList pList = loader.getPreviewProperties();
+
+		QMultiMap<quint64, int> candidates;	// area -> preview index
+
+		for (size_t idx = 0; idx < pList.size(); idx++) {
+
+			const Exiv2::PreviewProperties& p = pList[idx];
+
+			bool covers = (mode == Qt::KeepAspectRatioByExpanding) ? 
+				p.width_ >= w && p.height_ >= h : 
+				p.width_ >= w || p.height_ >= h;
+
+			if (covers)
+				candidates.insert((quint64)p.width_*p.height_, (int)idx);
+		}
+
+		// smallest first - previews that cannot be decoded are skipped
+		for (int idx : candidates) {
+
+			Exiv2::PreviewImage preview = loader.getPreviewImage(pList[idx]);
+			QByteArray ba = QByteArray::fromRawData((const char*)preview.pData(), preview.size());
+
+			if (qImg.loadFromData(ba))
+				break;
+		}
+	}
+	catch (...) {
+		qDebug() << "Sorry, I could not load a preview from the exif data...";
+	}
+
+	return qImg;
+}
+
 void DkMetaDataT::setUseSidecar(bool useSidecar) {
 	
 	mUseSidecar = useSidecar;
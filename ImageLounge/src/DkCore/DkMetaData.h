@@ -88,6 +88,7 @@ public:
 	ExifOrientationState checkExifOrientation() const;
 	int getRating() const;
 	QSize getImageSize() const;
+	QSize getPixelSize() const;
 	QString getDescription() const;
 	QVector2D getResolution() const;
 	QString getNativeExifValue(const QString& key) const;
@@ -97,6 +98,7 @@ public:
 	QString getQtValue(const QString& key) const;
 	QImage getThumbnail() const;
 	QImage getPreviewImage(int minPreviewWidth = 0) const;
+	QImage getBestFitPreview(const QSize& size, Qt::AspectRatioMode mode = Qt::KeepAspectRatio) const;
 	QStringList getExifKeys() const;
 	QStringList getExifValues() const;
 	QStringList getIptcKeys() const;
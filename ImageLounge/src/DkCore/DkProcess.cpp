@@ -282,6 +282,48 @@ bool DkBatchTransform::compute(QSharedPointer<DkImageContainer> container, QStri
 	return true;
 }
 
+/**
+ * Returns the size of the resized image if it does not depend on the original size.
+ * An image that is at least that large (e.g. an embedded preview) can then be
+ * processed instead of the decoded image.
+ * @param size the size that needs to be covered
+ * @param mode Qt::KeepAspectRatio if either side needs to be covered (long side),
+ * Qt::KeepAspectRatioByExpanding if both sides need to be covered
+ * @return bool true if the size is fixed
+ **/
+bool DkBatchTransform::targetSize(QSize& size, Qt::AspectRatioMode& mode) const {
+
+	// crop rects & upscaling refer to the original image
+	if (!isResizeActive() || mResizeMode == resize_mode_default || 
+		mCropFromMetadata || mResizeProperty == resize_prop_increase_only)
+		return false;
+
+	int side = qRound(mResizeScaleFactor);
+
+	switch (mResizeMode) {
+	case resize_mode_long_side:
+		size = QSize(side, side);
+		mode = Qt::KeepAspectRatio;
+		break;
+	case resize_mode_short_side:
+		size = QSize(side, side);
+		mode = Qt::KeepAspectRatioByExpanding;
+		break;
+	case resize_mode_width:
+		size = QSize(side, 1);
+		mode = Qt::KeepAspectRatioByExpanding;
+		break;
+	case resize_mode_height:
+		size = QSize(1, side);
+		mode = Qt::KeepAspectRatioByExpanding;
+		break;
+	default:
+		return false;
+	}
+
+	return !size.isEmpty();
+}
+
 bool DkBatchTransform::prepareProperties(const QSize& imgSize, QSize& size, float& scaleFactor, QStringList& logStrings) const {
 
 	float sf = 1.0f;
@@ -700,11 +742,31 @@ bool DkBatchProcess::process() {
 
 	QSharedPointer<DkImageContainer> imgC(new DkImageContainer(mSaveInfo.inputFilePath()));
 
-	if (!imgC->loadImage() || imgC->image().isNull()) {
+	// if the image is resized first, an embedded preview might be large enough
+	QSharedPointer<DkBatchTransform> transform;
+
+	for (QSharedPointer<DkAbstractBatch> batch : mProcessFunctions) {
+
+		if (batch && batch->isActive()) {
+			transform = qSharedPointerDynamicCast<DkBatchTransform>(batch);
+			break;
+		}
+	}
+
+	QSize previewSize;
+	Qt::AspectRatioMode previewMode = Qt::KeepAspectRatio;
+
+	if (transform && transform->targetSize(previewSize, previewMode) && 
+		imgC->loadEmbeddedPreview(previewSize, previewMode) && !imgC->image().isNull()) {
+		mLogStrings.append(QObject::tr("embedded preview loaded (%1 x %2)").arg(imgC->image().width()).arg(imgC->image().height()));
+	}
+	else if (!imgC->loadImage() || imgC->image().isNull()) {
 		mLogStrings.append(QObject::tr("Error while loading..."));
 		mFailure++;
 		return false;
 	}
+	else
+		mLogStrings.append(QObject::tr("image decoded (%1 x %2)").arg(imgC->image().width()).arg(imgC->image().height()));
 
 	for (QSharedPointer<DkAbstractBatch> batch : mProcessFunctions) {
 
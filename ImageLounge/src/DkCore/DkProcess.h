@@ -198,6 +198,7 @@ public:
 	int iplMethod() const;
 	float scaleFactor() const;
 	bool correctGamma() const;
+	bool targetSize(QSize& size, Qt::AspectRatioMode& mode) const;
 
 protected:
 	bool prepareProperties(const QSize& imgSize, QSize& size, float& scaleFactor, QStringList& logStrings) const;
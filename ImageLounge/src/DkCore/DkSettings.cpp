@@ -454,12 +454,15 @@ void DkSettings::load(QSettings& settings, bool defaults) {
 
 	resources_p.cacheMemory = settings.value("cacheMemory", resources_p.cacheMemory).toFloat();
 	resources_p.historyMemory = settings.value("historyMemory", resources_p.historyMemory).toFloat();
+	resources_p.tileCacheMemory = settings.value("tileCacheMemory", resources_p.tileCacheMemory).toFloat();
+	resources_p.thumbCacheMemory = settings.value("thumbCacheMemory", resources_p.thumbCacheMemory).toFloat();
+	resources_p.memoryBudget = settings.value("memoryBudget", resources_p.memoryBudget).toFloat();
 	resources_p.maxImagesCached = settings.value("maxImagesCached", resources_p.maxImagesCached).toInt();
 	resources_p.waitForLastImg = settings.value("waitForLastImg", resources_p.waitForLastImg).toBool();
 	resources_p.filterRawImages = settings.value("filterRawImages", resources_p.filterRawImages).toBool();	
 	resources_p.loadRawThumb = settings.value("loadRawThumb", resources_p.loadRawThumb).toInt();	
 	resources_p.filterDuplicats = settings.value("filterDuplicates", resources_p.filterDuplicats).toBool();
-	resources_p.preferredExtension = settings.value("preferredExtension", resources_p.preferredExtension).toString();	
+	resources_p.preferredExtension = normalizeExtensionChain(settings.value("preferredExtension", resources_p.preferredExtension).toString(), resources_p.preferredExtension);
 	resources_p.gammaCorrection = settings.value("gammaCorrection", resources_p.gammaCorrection).toBool();
 
 	if (sync_p.switchModifier) {
@@ -726,6 +729,12 @@ void DkSettings::save(QSettings& settings, bool force) {
 		settings.setValue("cacheMemory", resources_p.cacheMemory);
 	if (force ||resources_p.historyMemory != resources_d.historyMemory)
 		settings.setValue("historyMemory", resources_p.historyMemory);
+	if (force ||resources_p.tileCacheMemory != resources_d.tileCacheMemory)
+		settings.setValue("tileCacheMemory", resources_p.tileCacheMemory);
+	if (force ||resources_p.thumbCacheMemory != resources_d.thumbCacheMemory)
+		settings.setValue("thumbCacheMemory", resources_p.thumbCacheMemory);
+	if (force ||resources_p.memoryBudget != resources_d.memoryBudget)
+		settings.setValue("memoryBudget", resources_p.memoryBudget);
 	if (force ||resources_p.maxImagesCached != resources_d.maxImagesCached)
 		settings.setValue("maxImagesCached", resources_p.maxImagesCached);
 	if (force ||resources_p.waitForLastImg != resources_d.waitForLastImg)
@@ -871,6 +880,9 @@ void DkSettings::setToDefaultSettings() {
 
 	resources_p.cacheMemory = 0;
 	resources_p.historyMemory = 128;
+	resources_p.tileCacheMemory = 256;
+	resources_p.thumbCacheMemory = 512;
+	resources_p.memoryBudget = 0;	// 0: half of the physical memory
 	resources_p.maxImagesCached = 5;
 	resources_p.filterRawImages = true;
 	resources_p.loadRawThumb = raw_thumb_always;
@@ -893,6 +905,47 @@ void DkSettings::setNumThreads(int numThreads) {
 
 }
 
+/**
+ * Cleans a preference chain of file extensions (e.g. "*.JPG, dng;*.cr2").
+ * Entries may be separated by semicolons, commas or white spaces.
+ * Every entry is converted to "*.suffix" (lower case), entries
+ * that are no plain suffix and repeated entries are removed.
+ * @param chain the hand edited chain.
+ * @param fallback the chain that is returned if no valid entry is left.
+ * @return QString the normalized chain (e.g. "*.jpg; *.dng; *.cr2").
+ **/
+QString DkSettings::normalizeExtensionChain(const QString& chain, const QString& fallback) {
+
+	QStringList entries = chain.split(QRegExp("[;,\\s]+"), QString::SkipEmptyParts);
+	QStringList cleanEntries;
+	QRegExp validSuffix("[a-z0-9_\\-]+");
+
+	for (QString entry : entries) {
+
+		entry = entry.toLower();
+
+		if (entry.startsWith("*"))
+			entry.remove(0, 1);
+		if (entry.startsWith("."))
+			entry.remove(0, 1);
+
+		if (!validSuffix.exactMatch(entry)) {
+			qWarning() << "[DkSettings] illegal entry in preferredExtension ignored:" << entry;
+			continue;
+		}
+
+		entry = "*." + entry;
+
+		if (!cleanEntries.contains(entry))
+			cleanEntries << entry;
+	}
+
+	if (cleanEntries.empty())
+		return fallback;
+
+	return cleanEntries.join("; ");
+}
+
 bool DkSettings::isPortable() {
 
 	QFileInfo settingsFile(settingsPath());
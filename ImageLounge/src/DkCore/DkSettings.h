@@ -93,6 +93,7 @@ public:
 		sort_date_created,
 		sort_date_modified,
 		sort_random,
+		sort_file_size,
 		sort_end,
 	};
 
@@ -270,12 +271,15 @@ public:
 	struct Resources {
 		float cacheMemory;
 		float historyMemory;
+		float tileCacheMemory;
+		float thumbCacheMemory;
+		float memoryBudget;
 		int maxImagesCached;
 		bool waitForLastImg;
 		bool filterRawImages;
 		bool filterDuplicats;
 		int loadRawThumb;
-		QString preferredExtension;
+		QString preferredExtension;	// preference chain of duplicates e.g. "*.jpg; *.dng; *.cr2"
 		int numThumbsLoading;
 		int maxThumbsLoading;
 		bool gammaCorrection;
@@ -354,6 +358,7 @@ protected:
 	Resources resources_d;
 
 	void init();
+	static QString normalizeExtensionChain(const QString& chain, const QString& fallback);
 };
 
 class DllCoreExport DkSettingsManager {
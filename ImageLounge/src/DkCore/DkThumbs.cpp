@@ -41,6 +41,16 @@
 #include <QtConcurrentRun>
 #include <QTimer>
 #include <QBuffer>
+#include <QImageWriter>
+#include <QSaveFile>
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QDateTime>
+#include <QUrl>
+#include <QAtomicInt>
+#include <QPointer>
+#include <QRunnable>
+#include <QFile>
 #pragma warning(pop)		// no warnings from includes - end
 
 namespace nmc {
@@ -52,6 +62,7 @@ namespace nmc {
 **/ 
 DkThumbNail::DkThumbNail(const QString& filePath, const QImage& img) {
 	mImg = DkImage::createThumb(img);
+	mTiers = createTiers(mImg);
 	mFile = filePath;
 	mMaxThumbSize = qRound(max_thumb_size * DkSettingsManager::param().dPIScaleFactor());
 	mMinThumbSize = DkSettingsManager::param().effectiveThumbSize();
@@ -66,9 +77,20 @@ DkThumbNail::~DkThumbNail() {}
  **/ 
 void DkThumbNail::compute(int forceLoad) {
 
+	// the persistent store saves us from any decoding
+	if (forceLoad == do_not_force) {
+		mImg = DkThumbCache::load(mFile, mMinThumbSize, mMaxThumbSize);
+
+		if (!mImg.isNull()) {
+			mTiers = createTiers(mImg);
+			return;
+		}
+	}
+
 	// we do this that complicated to be thread-safe
 	// if we use member vars in the thread and the object gets deleted during thread execution we crash...
 	mImg = computeIntern(mFile, QSharedPointer<QByteArray>(), forceLoad, mMaxThumbSize, mMinThumbSize);
+	mTiers = createTiers(mImg);
 }
 
 /**
@@ -89,26 +111,39 @@ QImage DkThumbNail::computeIntern(const QString& filePath, const QSharedPointer<
 	DkTimer dt;
 	//qDebug() << "[thumb] file: " << file.absoluteFilePath();
 
-	// see if we can read the thumbnail from the exif data
-	QImage thumb;
-	DkMetaDataT metaData;
+	// NOTE: the thumbnail store is checked by the callers (compute() and the DkThumbScheduler)
+
+	// as found at: http://olliwang.com/2010/01/30/creating-thumbnail-images-in-qt/
+	QFileInfo fInfo(filePath);
+	QString lFilePath = fInfo.isSymLink() ? fInfo.symLinkTarget() : filePath;
+	fInfo = lFilePath;
+
+	// the file is fetched once: exiv2, the QImageReader and the DkBasicLoader parse the same bytes
+	QSharedPointer<QByteArray> fileBa = ba;
 
-	QSharedPointer<QByteArray> baZip = QSharedPointer<QByteArray>();
 #ifdef WITH_QUAZIP
 	if (QFileInfo(mFile).dir().path().contains(DkZipContainer::zipMarker())) 
-		baZip = DkZipContainer::extractImage(DkZipContainer::decodeZipFile(filePath), DkZipContainer::decodeImageFile(filePath));
+		fileBa = DkZipContainer::extractImage(DkZipContainer::decodeZipFile(filePath), DkZipContainer::decodeImageFile(filePath));
 #endif
+
+	if (!fileBa || fileBa->isEmpty())
+		fileBa = fileBuffer(lFilePath, forceLoad);
+
+	// see if we can read the thumbnail from the exif data
+	// NOTE: exiv2 references fileBa - so the metadata is declared (and destroyed) after it
+	QImage thumb;
+	DkMetaDataT metaData;
+
 	try {
 		// [DIEM] READ  build crashed here 09.06.2016
-		if (baZip && !baZip->isEmpty())	
-			metaData.readMetaData(filePath, baZip);
-		else if (!ba || ba->isEmpty())
-			metaData.readMetaData(filePath);
-		else
-			metaData.readMetaData(filePath, ba);
+		metaData.readMetaData(filePath, fileBa);
+
+		// the smallest embedded preview that is large enough saves us from decoding
+		if (forceLoad == do_not_force)
+			thumb = metaData.getBestFitPreview(QSize(maxThumbSize, maxThumbSize));
 
 		// read the full image if we want to create new thumbnails
-		if (forceLoad != force_save_thumb)
+		if (thumb.isNull() && forceLoad != force_save_thumb)
 			thumb = metaData.getThumbnail();
 	}
 	catch(...) {
@@ -126,27 +161,29 @@ QImage DkThumbNail::computeIntern(const QString& filePath, const QSharedPointer<
 	int imgH = thumb.height();
 	int tS = minThumbSize;
 
-	// as found at: http://olliwang.com/2010/01/30/creating-thumbnail-images-in-qt/
-	QFileInfo fInfo(filePath);
-	QString lFilePath = fInfo.isSymLink() ? fInfo.symLinkTarget() : filePath;
-	fInfo = lFilePath;
-
 	QImageReader* imageReader = 0;
+	QBuffer buffer;		// must live as long as the reader
 	
-	if (!ba || ba->isEmpty())
+	if (!fileBa || fileBa->isEmpty())
 		imageReader = new QImageReader(lFilePath);
 	else {
-		QBuffer buffer;
-		buffer.setData(ba->data());
+		buffer.setData(*fileBa);	// shallow copy - mapped files are not copied
 		buffer.open(QIODevice::ReadOnly);
 		imageReader = new QImageReader(&buffer, fInfo.suffix().toStdString().c_str());
-		buffer.close();
 	}
 
+	QSize imgSize;
 	if (thumb.isNull() || (thumb.width() < tS && thumb.height() < tS)) {
 
-		imgW = imageReader->size().width();		// crash detected: unhandled exception at 0x66850E9A (msvcr110d.dll) in nomacs.exe: 0xC0000005: Access violation reading location 0x0000C788.
-		imgH = imageReader->size().height();	// locks the file!
+		// exiv2 parsed the JPG header already (RAW headers might describe a preview)
+		if (metaData.isJpg())
+			imgSize = metaData.getPixelSize();
+
+		if (imgSize.isEmpty())
+			imgSize = imageReader->size();	// crash detected: unhandled exception at 0x66850E9A (msvcr110d.dll) in nomacs.exe: 0xC0000005: Access violation reading location 0x0000C788.
+
+		imgW = imgSize.width();
+		imgH = imgSize.height();
 	}
 	
 	if (forceLoad != DkThumbNailT::force_exif_thumb && (imgW > maxThumbSize || imgH > maxThumbSize)) {
@@ -166,6 +203,7 @@ QImage DkThumbNail::computeIntern(const QString& filePath, const QSharedPointer<
 
 	// diem: do_not_force is the generic load - so also rescale these
 	bool rescale = forceLoad == force_save_thumb || forceLoad == do_not_force;
+	bool decoded = false;	// true if the DkBasicLoader decoded the image
 
 	if (forceLoad != force_exif_thumb && 
 			(thumb.isNull() || 
@@ -181,22 +219,18 @@ QImage DkThumbNail::computeIntern(const QString& filePath, const QSharedPointer<
 			qDebug() << "EXIF size is flipped...";
 		}
 
-		QSize initialSize = imageReader->size();
-
 		imageReader->setScaledSize(QSize(imgW, imgH));
 		thumb = imageReader->read();
 
 		// try to read the image
 		if (thumb.isNull()) {
 			DkBasicLoader loader;
+			loader.setTargetSize(QSize(maxThumbSize, maxThumbSize));
 			
-			if (baZip && !baZip->isEmpty())	{
-				if (loader.loadGeneral(lFilePath, baZip, true, true))
+			// the metadata is parsed already - we rotate below
+			if (loader.loadGeneral(lFilePath, fileBa, false, true)) {
 				thumb = loader.image();
-			}
-			else {
-				if (loader.loadGeneral(lFilePath, ba, true, true))
-					thumb = loader.image();
+				decoded = true;
 			}
 		}
 
@@ -225,7 +259,8 @@ QImage DkThumbNail::computeIntern(const QString& filePath, const QSharedPointer<
 		}
 
 		// is there a nice solution to do so??
-		imageReader->setFileName("josef");	// image reader locks the file -> but there should not be one so we just set it to another file...
+		if (!fileBa || fileBa->isEmpty())
+			imageReader->setFileName("josef");	// image reader locks the file -> but there should not be one so we just set it to another file...
 	}
 	else if (rescale) {
 		thumb = thumb.scaled(QSize(imgW, imgH), Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
@@ -234,7 +269,7 @@ QImage DkThumbNail::computeIntern(const QString& filePath, const QSharedPointer<
 	if (imageReader)
 		delete imageReader;
 
-	if (orientation != -1 && orientation != 0 && (metaData.isJpg() || metaData.isRaw())) {
+	if (orientation != -1 && orientation != 0 && (metaData.isJpg() || metaData.isRaw() || (decoded && !metaData.isTiff()))) {
 		QTransform rotationMatrix;
 		rotationMatrix.rotate((double)orientation);
 		thumb = thumb.transformed(rotationMatrix);
@@ -266,12 +301,47 @@ QImage DkThumbNail::computeIntern(const QString& filePath, const QSharedPointer<
 		}
 	}
 
+	// exif-only thumbnails are requested for previews - we do not want them in the store
+	if (!thumb.isNull() && forceLoad != force_exif_thumb)
+		DkThumbCache::save(filePath, thumb, imgSize);
+
 	//if (!thumb.isNull())
 	//	qInfoClean() << "[thumb] " << fInfo.fileName() << " (" << thumb.width() << " x " << thumb.height() << ") loaded in " << dt << ((exifThumb) ? " from EXIV" : " from File");
 
 	return thumb;
 }
 
+/**
+ * Fetches the file's bytes so that the metadata and the image are parsed from one buffer.
+ * Files are mapped if possible. Thumbnails that are saved to the file are read to the heap
+ * since writing a mapped file would invalidate its pages.
+ * @param filePath the (resolved) file path
+ * @param forceLoad the loading flag
+ * @return QSharedPointer<QByteArray> the buffer or a null pointer if the file should be parsed from disk
+ **/
+QSharedPointer<QByteArray> DkThumbNail::fileBuffer(const QString& filePath, int forceLoad) {
+
+	bool saves = forceLoad == save_thumb || forceLoad == force_save_thumb;
+
+	if (!saves) {
+		QSharedPointer<QByteArray> ba = DkBasicLoader::mapFileToBuffer(filePath);
+
+		if (ba)
+			return ba;
+	}
+
+	// exif thumbnails just need the header
+	if (forceLoad == force_exif_thumb)
+		return QSharedPointer<QByteArray>();
+
+	QFile file(filePath);
+
+	if (file.size() > DkThumbScheduler::max_buffer_size || !file.open(QIODevice::ReadOnly))
+		return QSharedPointer<QByteArray>();
+
+	return QSharedPointer<QByteArray>(new QByteArray(file.readAll()));
+}
+
 /**
  * Removes potential black borders.
  * These borders can be found e.g. in Nikon One images (16:9 vs 4:3)
@@ -337,8 +407,346 @@ void DkThumbNail::removeBlackBorder(QImage& img) {
 void DkThumbNail::setImage(const QImage img) {
 	
 	mImg = DkImage::createThumb(img);
+	mTiers = createTiers(mImg);
+}
+
+/**
+ * Returns the smallest tier that covers the size requested.
+ * All tiers are downscaled from the same thumbnail, hence
+ * resizing thumbnails never needs to decode the image again.
+ * @param size the size of the thumbnail that is drawn
+ * @param mode KeepAspectRatio if the long side must cover size, 
+ * KeepAspectRatioByExpanding if the short side must cover it (e.g. squared thumbnails)
+ * @return QImage the tier or the thumbnail if no tier is large enough
+ **/
+QImage DkThumbNail::getImage(int size, Qt::AspectRatioMode mode) const {
+
+	// the smallest tier is last
+	for (int idx = mTiers.size()-1; idx >= 0; idx--) {
+
+		const QImage& tier = mTiers[idx];
+		int s = (mode == Qt::KeepAspectRatioByExpanding) ? 
+			qMin(tier.width(), tier.height()) : 
+			qMax(tier.width(), tier.height());
+
+		if (s >= size)
+			return tier;
+	}
+
+	return mImg;
+}
+
+/**
+ * Returns the memory of the thumbnail and its tiers.
+ * @return float the memory in MB
+ **/
+float DkThumbNail::memoryUsage() const {
+
+	float mem = DkImage::getBufferSizeFloat(mImg.size(), mImg.depth());
+
+	for (const QImage& tier : mTiers)
+		mem += DkImage::getBufferSizeFloat(tier.size(), tier.depth());
+
+	return mem;
+}
+
+/**
+ * Creates the power-of-two tiers (tier_max down to tier_min) of a thumbnail.
+ * Each tier is downscaled from the next larger one so that
+ * the tiers cost less than a third of the thumbnail's memory.
+ * Tiers that are not smaller than the thumbnail are omitted.
+ * @param img the thumbnail
+ * @return QVector<QImage> the tiers (largest first)
+ **/
+QVector<QImage> DkThumbNail::createTiers(const QImage& img) {
+
+	QVector<QImage> tiers;
+
+	if (img.isNull())
+		return tiers;
+
+	int maxSide = qMax(img.width(), img.height());
+	QImage src = img;
+
+	for (int tier = tier_max; tier >= tier_min; tier /= 2) {
+
+		if (tier >= maxSide)
+			continue;
+
+		src = src.scaled(tier, tier, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+		tiers << src;
+	}
+
+	return tiers;
 }
 
+// DkThumbScheduler --------------------------------------------------------------------
+/**
+ * A thumbnail request of the DkThumbScheduler.
+ * The thumb pointer and the state are only touched in the main thread.
+ * The stages only read the parameters and write the buffer and the result.
+ **/
+class DkThumbJob {
+
+public:
+	enum State {
+		pending,
+		reading,
+		decoding,
+	};
+
+	quint64 id = 0;
+	QPointer<DkThumbNailT> thumb;
+	State state = pending;
+	int priority = DkThumbScheduler::priority_default;
+	QAtomicInt cancelled;
+
+	QString filePath;
+	int forceLoad = DkThumbNail::do_not_force;
+	int maxThumbSize = max_thumb_size;
+	int minThumbSize = max_thumb_size;
+
+	QSharedPointer<QByteArray> ba;
+	QImage img;
+	QVector<QImage> tiers;
+	bool done = false;		// true if the I/O stage found the thumbnail in the store
+};
+
+/**
+ * Runs one stage of a DkThumbJob and reports back to the scheduler.
+ **/
+class DkThumbStage : public QRunnable {
+
+public:
+	DkThumbStage(DkThumbScheduler* scheduler, QSharedPointer<DkThumbJob> job, bool decode) : mScheduler(scheduler), mJob(job), mDecode(decode) {}
+
+	void run() override {
+
+		if (!mJob->cancelled.loadAcquire()) {
+			if (mDecode)
+				DkThumbScheduler::decode(*mJob);
+			else
+				DkThumbScheduler::readFile(*mJob);
+		}
+
+		QMetaObject::invokeMethod(mScheduler, mDecode ? "decodeFinished" : "readFinished", 
+			Qt::QueuedConnection, Q_ARG(quint64, mJob->id));
+	}
+
+protected:
+	DkThumbScheduler* mScheduler;
+	QSharedPointer<DkThumbJob> mJob;
+	bool mDecode;
+};
+
+DkThumbScheduler::DkThumbScheduler() {
+
+	// a few threads suffice to keep the disk busy - decoding gets all cores but one
+	mIoPool.setMaxThreadCount(qMax(1, DkSettingsManager::param().resources().maxThumbsLoading));
+	mDecodePool.setMaxThreadCount(qMax(1, QThread::idealThreadCount()-1));
+}
+
+DkThumbScheduler::~DkThumbScheduler() {
+
+	for (QSharedPointer<DkThumbJob> job : mJobs)
+		job->cancelled.storeRelease(1);
+
+	mPending.clear();
+	mIoPool.waitForDone();
+	mDecodePool.waitForDone();
+}
+
+DkThumbScheduler& DkThumbScheduler::instance() {
+
+	static DkThumbScheduler inst;
+	return inst;
+}
+
+/**
+ * Schedules a thumbnail.
+ * If the thumbnail is scheduled already, only its priority is updated.
+ * @param thumb the thumbnail which gets the result
+ * @param ba the file buffer (can be empty)
+ * @param forceLoad the loading flag (e.g. exiv only)
+ * @param priority jobs with lower values are started first
+ **/
+void DkThumbScheduler::schedule(DkThumbNailT* thumb, QSharedPointer<QByteArray> ba, int forceLoad, int priority) {
+
+	if (!thumb)
+		return;
+
+	if (mThumbJobs.contains(thumb)) {
+		setPriority(thumb, priority);
+		return;
+	}
+
+	QSharedPointer<DkThumbJob> job(new DkThumbJob());
+	job->id = mNextId++;
+	job->thumb = thumb;
+	job->priority = priority;
+	job->filePath = thumb->getFilePath();
+	job->forceLoad = forceLoad;
+	job->maxThumbSize = thumb->getMaxThumbSize();
+	job->minThumbSize = thumb->getMinThumbSize();
+	job->ba = ba;
+
+	mJobs.insert(job->id, job);
+	mThumbJobs.insert(thumb, job->id);
+	mPending.insert(qMakePair(priority, job->id), job);
+
+	startJobs();
+}
+
+/**
+ * Changes the priority of a pending job.
+ * Jobs that are started already are not affected.
+ * @param thumb the scheduled thumbnail
+ * @param priority the new priority
+ **/
+void DkThumbScheduler::setPriority(DkThumbNailT* thumb, int priority) {
+
+	if (!mThumbJobs.contains(thumb))
+		return;
+
+	QSharedPointer<DkThumbJob> job = mJobs.value(mThumbJobs.value(thumb));
+
+	if (!job || job->state != DkThumbJob::pending || job->priority == priority)
+		return;
+
+	mPending.remove(qMakePair(job->priority, job->id));
+	job->priority = priority;
+	mPending.insert(qMakePair(priority, job->id), job);
+}
+
+/**
+ * Cancels the job of a thumbnail.
+ * Pending jobs are removed, running jobs skip their remaining stages
+ * and the thumbnail is not notified anymore.
+ * @param thumb the scheduled thumbnail
+ **/
+void DkThumbScheduler::cancel(DkThumbNailT* thumb) {
+
+	if (!mThumbJobs.contains(thumb))
+		return;
+
+	QSharedPointer<DkThumbJob> job = mJobs.value(mThumbJobs.take(thumb));
+
+	if (!job)
+		return;
+
+	job->cancelled.storeRelease(1);
+
+	// running jobs are removed if their stage returns
+	if (job->state == DkThumbJob::pending) {
+		mPending.remove(qMakePair(job->priority, job->id));
+		mJobs.remove(job->id);
+	}
+}
+
+int DkThumbScheduler::numPending() const {
+	return mPending.size();
+}
+
+int DkThumbScheduler::numRunning() const {
+	return mNumReading + mNumDecoding;
+}
+
+void DkThumbScheduler::startJobs() {
+
+	// do not read more files than the decoders can handle
+	int maxRunning = mIoPool.maxThreadCount() + 2*mDecodePool.maxThreadCount();
+
+	while (!mPending.empty() && mNumReading < mIoPool.maxThreadCount() && numRunning() < maxRunning) {
+
+		QSharedPointer<DkThumbJob> job = mPending.begin().value();
+		mPending.erase(mPending.begin());
+
+		job->state = DkThumbJob::reading;
+		mNumReading++;
+		mIoPool.start(new DkThumbStage(this, job, false));
+	}
+}
+
+void DkThumbScheduler::readFinished(quint64 id) {
+
+	mNumReading--;
+
+	QSharedPointer<DkThumbJob> job = mJobs.value(id);
+
+	if (job && !job->cancelled.loadAcquire() && !job->done) {
+		job->state = DkThumbJob::decoding;
+		mNumDecoding++;
+		mDecodePool.start(new DkThumbStage(this, job, true), -job->priority);	// QThreadPool starts higher values first
+	}
+	else if (job)
+		finish(job);
+
+	startJobs();
+}
+
+void DkThumbScheduler::decodeFinished(quint64 id) {
+
+	mNumDecoding--;
+
+	QSharedPointer<DkThumbJob> job = mJobs.value(id);
+
+	if (job)
+		finish(job);
+
+	startJobs();
+}
+
+void DkThumbScheduler::finish(QSharedPointer<DkThumbJob> job) {
+
+	mJobs.remove(job->id);
+
+	if (job->cancelled.loadAcquire() || !job->thumb)
+		return;
+
+	mThumbJobs.remove(job->thumb.data());
+	job->thumb->thumbComputed(job->img, job->tiers);
+}
+
+/**
+ * The I/O stage.
+ * It checks the thumbnail store and reads (or maps) the file so that
+ * the decoders do not need to wait for the disk.
+ * @param job the job
+ **/
+void DkThumbScheduler::readFile(DkThumbJob& job) {
+
+	// the persistent store saves us from any decoding
+	if (job.forceLoad == DkThumbNail::do_not_force) {
+		job.img = DkThumbCache::load(job.filePath, job.minThumbSize, job.maxThumbSize);
+
+		if (!job.img.isNull()) {
+			job.tiers = DkThumbNail::createTiers(job.img);
+			job.done = true;
+			return;
+		}
+	}
+
+	// saving thumbs writes to the file on disk
+	if ((job.ba && !job.ba->isEmpty()) || 
+		job.forceLoad == DkThumbNail::save_thumb || job.forceLoad == DkThumbNail::force_save_thumb)
+		return;
+
+	QFileInfo fInfo(job.filePath);
+	job.ba = DkThumbNail::fileBuffer(fInfo.isSymLink() ? fInfo.symLinkTarget() : job.filePath, job.forceLoad);
+}
+
+/**
+ * The decode stage.
+ * @param job the job
+ **/
+void DkThumbScheduler::decode(DkThumbJob& job) {
+
+	DkThumbNail thumb(job.filePath);
+	job.img = thumb.computeIntern(job.filePath, job.ba, job.forceLoad, job.maxThumbSize, job.minThumbSize);
+	job.tiers = DkThumbNail::createTiers(job.img);
+}
+
+// DkThumbNailT --------------------------------------------------------------------
 /**
  * This class provides threaded access to image thumbnails.
  * @param file the thumbnail's file
@@ -353,52 +761,67 @@ DkThumbNailT::DkThumbNailT(const QString& filePath, const QImage& img) : DkThumb
 DkThumbNailT::~DkThumbNailT() {
 
 	// DESTRUCTOR: might be hot!
-	if (mFetching && DkSettingsManager::param().resources().numThumbsLoading > 0)
-		DkSettingsManager::param().resources().numThumbsLoading--;
-
-	thumbWatcher.blockSignals(true);
-	thumbWatcher.cancel();
+	cancelFetch();
 }
 
-bool DkThumbNailT::fetchThumb(int forceLoad /* = false */,  QSharedPointer<QByteArray> ba) {
+/**
+ * Schedules the thumbnail.
+ * @param forceLoad the loading flag (e.g. exiv only)
+ * @param ba the file buffer (can be empty)
+ * @param priority the scheduler priority (e.g. the distance to the viewport)
+ * @return bool true if the thumbnail was scheduled
+ **/
+bool DkThumbNailT::fetchThumb(int forceLoad /* = false */,  QSharedPointer<QByteArray> ba, int priority) {
 
 	if (forceLoad == force_full_thumb || forceLoad == force_save_thumb || forceLoad == save_thumb)
-		mImg = QImage();
+		clearImage();
 
 	if (!mImg.isNull() || !mImgExists || mFetching)
 		return false;
 
-	// we have to do our own bool here
-	// watcher.isRunning() returns false if the thread is waiting in the pool
 	mFetching = true;
 	mForceLoad = forceLoad;
 
-	connect(&thumbWatcher, SIGNAL(finished()), this, SLOT(thumbLoaded()));
-	thumbWatcher.setFuture(QtConcurrent::run(this, 
-		&nmc::DkThumbNailT::computeCall, mFile, ba, forceLoad, mMaxThumbSize, mMinThumbSize));
-
+	DkThumbScheduler::instance().schedule(this, ba, forceLoad, priority);
 	DkSettingsManager::param().resources().numThumbsLoading++;
 
 	return true;
 }
 
+void DkThumbNailT::setFetchPriority(int priority) {
 
-QImage DkThumbNailT::computeCall(const QString& filePath, QSharedPointer<QByteArray> ba, int forceLoad, int maxThumbSize, int minThumbSize) {
+	if (mFetching)
+		DkThumbScheduler::instance().setPriority(this, priority);
+}
+
+/**
+ * Cancels the thumbnail's job (e.g. if it is scrolled out of view).
+ **/
+void DkThumbNailT::cancelFetch() {
+
+	if (!mFetching)
+		return;
+
+	DkThumbScheduler::instance().cancel(this);
+	mFetching = false;
 
-	return DkThumbNail::computeIntern(filePath, ba, forceLoad, maxThumbSize, minThumbSize);
+	if (DkSettingsManager::param().resources().numThumbsLoading > 0)
+		DkSettingsManager::param().resources().numThumbsLoading--;
 }
 
-void DkThumbNailT::thumbLoaded() {
+void DkThumbNailT::thumbComputed(const QImage& img, const QVector<QImage>& tiers) {
 	
-	QFuture<QImage> future = thumbWatcher.future();
-
-	mImg = future.result();
+	mImg = img;
+	mTiers = tiers;
 	
 	if (mImg.isNull() && mForceLoad != force_exif_thumb)
 		mImgExists = false;
 
 	mFetching = false;
-	DkSettingsManager::param().resources().numThumbsLoading--;
+
+	if (DkSettingsManager::param().resources().numThumbsLoading > 0)
+		DkSettingsManager::param().resources().numThumbsLoading--;
+
 	emit thumbLoadedSignal(!mImg.isNull());
 }
 
@@ -602,4 +1025,263 @@ void DkThumbsLoader::stop() {
 	qDebug() << "stopping thread: " << this->thread()->currentThreadId();
 }
 
+// DkThumbCache --------------------------------------------------------------------
+/**
+ * Loads a thumbnail from the persistent store.
+ * The requested tier is searched first, then larger tiers (which are downscaled)
+ * and finally smaller ones. An entry is only accepted if its URI, mtime and
+ * file size match the current file and if it is large enough, i.e. it is
+ * at least minThumbSize or it holds the full image.
+ * @param filePath the image's file path
+ * @param minThumbSize the minimal thumbnail size accepted
+ * @param maxThumbSize the maximal thumbnail size
+ * @return QImage the cached thumbnail or a null image if there is none.
+ **/
+QImage DkThumbCache::load(const QString& filePath, int minThumbSize, int maxThumbSize) {
+
+	if (!isEnabled())
+		return QImage();
+
+	QFileInfo fInfo(filePath);
+	QString cPath = fInfo.canonicalFilePath();
+
+	// zipped files and removed files are not cached
+	if (cPath.isEmpty())
+		return QImage();
+
+	QString uri = QUrl::fromLocalFile(cPath).toString(QUrl::FullyEncoded);
+	QString mTime = QString::number(fInfo.lastModified().toMSecsSinceEpoch() / 1000);
+	QString size = QString::number(fInfo.size());
+
+	// requested tier, larger tiers and then the smaller ones
+	QList<int> t = tiers();
+	int tIdx = t.indexOf(tierFor(maxThumbSize));
+	QList<int> order = t.mid(tIdx);
+	for (int idx = tIdx-1; idx >= 0; idx--)
+		order << t[idx];
+
+	for (int tier : order) {
+
+		QImageReader reader(thumbPath(uri, tier), "png");
+
+		// validate the text chunks before decoding any pixels
+		if (!reader.canRead() ||
+			reader.text("Thumb::URI") != uri ||
+			reader.text("Thumb::MTime") != mTime ||
+			reader.text("Thumb::Size") != size)
+			continue;
+
+		QImage thumb = reader.read();
+
+		if (thumb.isNull())
+			continue;
+
+		int side = qMax(thumb.width(), thumb.height());
+		int imgSide = qMax(reader.text("Thumb::Image::Width").toInt(), reader.text("Thumb::Image::Height").toInt());
+
+		if (side < minThumbSize && side < imgSide)
+			continue;
+
+		if (side > maxThumbSize)
+			thumb = thumb.scaled(maxThumbSize, maxThumbSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+
+		touch(thumbPath(uri, tier));
+
+		return thumb;
+	}
+
+	return QImage();
+}
+
+/**
+ * Adds a thumbnail to the store.
+ * The thumbnail is put into the smallest tier it fits into and downscaled
+ * copies are put into all smaller tiers. The files are written to temporary
+ * files and renamed so that other instances see either the old or the new thumbnail.
+ * @param filePath the image's file path
+ * @param thumb the thumbnail
+ * @param imgSize the original image size (if known)
+ * @return bool true if the thumbnail was saved.
+ **/
+bool DkThumbCache::save(const QString& filePath, const QImage& thumb, const QSize& imgSize) {
+
+	if (!isEnabled() || thumb.isNull())
+		return false;
+
+	QFileInfo fInfo(filePath);
+	QString cPath = fInfo.canonicalFilePath();
+
+	// do not cache thumbnails of our own cache
+	if (cPath.isEmpty() || cPath.startsWith(cacheDir()))
+		return false;
+
+	QString uri = QUrl::fromLocalFile(cPath).toString(QUrl::FullyEncoded);
+
+	QImage img = thumb;
+	int tier = tierFor(qMax(img.width(), img.height()));
+	QList<int> t = tiers();
+
+	// largest tier first - each tier is downscaled from the previous one
+	for (int idx = t.indexOf(tier); idx >= 0; idx--) {
+
+		if (img.width() > t[idx] || img.height() > t[idx])
+			img = img.scaled(t[idx], t[idx], Qt::KeepAspectRatio, Qt::SmoothTransformation);
+
+		if (!saveTier(fInfo, uri, img, t[idx], imgSize))
+			return false;
+	}
+
+	// check the cache size every now and then
+	static QAtomicInt numSaved;
+	if (numSaved.fetchAndAddRelaxed(1) % 200 == 199)
+		evict();
+
+	return true;
+}
+
+bool DkThumbCache::saveTier(const QFileInfo& fInfo, const QString& uri, const QImage& img, int tier, const QSize& imgSize) {
+
+	QString tPath = thumbPath(uri, tier);
+	if (!QDir().mkpath(QFileInfo(tPath).absolutePath()))
+		return false;
+
+	QSaveFile file(tPath);
+	if (!file.open(QIODevice::WriteOnly))
+		return false;
+	file.setPermissions(QFileDevice::ReadOwner | QFileDevice::WriteOwner);
+
+	QImageWriter writer(&file, "png");
+	writer.setText("Thumb::URI", uri);
+	writer.setText("Thumb::MTime", QString::number(fInfo.lastModified().toMSecsSinceEpoch() / 1000));
+	writer.setText("Thumb::Size", QString::number(fInfo.size()));
+	writer.setText("Software", "nomacs");
+
+	if (imgSize.isValid()) {
+		writer.setText("Thumb::Image::Width", QString::number(imgSize.width()));
+		writer.setText("Thumb::Image::Height", QString::number(imgSize.height()));
+	}
+
+	if (!writer.write(img)) {
+		file.cancelWriting();
+		return false;
+	}
+
+	return file.commit();
+}
+
+/**
+ * Marks a thumbnail as used.
+ * The last access is kept in the PNG's mtime since the atime is
+ * not updated on relatime/noatime mounts (the default of most distros).
+ * @param thumbPath the thumbnail's path in the store
+ **/
+void DkThumbCache::touch(const QString& thumbPath) {
+
+#if QT_VERSION >= 0x050A00
+	QDateTime now = QDateTime::currentDateTime();
+
+	// an hour is accurate enough - do not write on every hit
+	if (QFileInfo(thumbPath).lastModified().secsTo(now) < 3600)
+		return;
+
+	QFile file(thumbPath);
+	if (file.open(QIODevice::ReadWrite))
+		file.setFileTime(now, QFileDevice::FileModificationTime);
+#else
+	Q_UNUSED(thumbPath);	// evicted by write time
+#endif
+}
+
+/**
+ * Removes the least recently used thumbnails if the store exceeds its budget.
+ * Several instances may evict concurrently, failing removals are ignored.
+ **/
+void DkThumbCache::evict() {
+
+	static QMutex mutex;
+	if (!mutex.tryLock())
+		return;
+
+	DkTimer dt;
+	qint64 limit = qRound64(DkSettingsManager::param().resources().thumbCacheMemory * 1024.0 * 1024.0);
+	qint64 total = 0;
+
+	QFileInfoList files;
+	for (int tier : tiers()) {
+		QDir tDir(cacheDir() + "/" + tierName(tier));
+		files << tDir.entryInfoList(QStringList() << "*.png", QDir::Files);
+	}
+
+	for (const QFileInfo& f : files)
+		total += f.size();
+
+	if (total > limit) {
+
+		qSort(files.begin(), files.end(), [](const QFileInfo& l, const QFileInfo& r) {
+			return l.lastModified() < r.lastModified();
+		});
+
+		// evict some more to not run again with the next thumbnail
+		qint64 target = qRound64(limit * 0.8);
+		int numRemoved = 0;
+
+		for (const QFileInfo& f : files) {
+
+			if (total <= target)
+				break;
+
+			if (QFile::remove(f.absoluteFilePath())) {
+				total -= f.size();
+				numRemoved++;
+			}
+		}
+
+		qInfo() << "[DkThumbCache]" << numRemoved << "thumbnails evicted in" << dt;
+	}
+
+	mutex.unlock();
+}
+
+bool DkThumbCache::isEnabled() {
+	return DkSettingsManager::param().resources().thumbCacheMemory > 0;
+}
+
+QString DkThumbCache::cacheDir() {
+	return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/thumbnails";
+}
+
+QList<int> DkThumbCache::tiers() {
+	return QList<int>() << tier_normal << tier_large << tier_x_large;
+}
+
+/**
+ * Returns the smallest tier that holds thumbnails of the given size.
+ * @param size the thumbnail's max side
+ * @return int the tier (the largest tier if size exceeds all tiers)
+ **/
+int DkThumbCache::tierFor(int size) {
+
+	for (int tier : tiers()) {
+		if (size <= tier)
+			return tier;
+	}
+
+	return tier_x_large;
+}
+
+QString DkThumbCache::tierName(int tier) {
+
+	switch (tier) {
+	case tier_normal:	return "normal";
+	case tier_large:	return "large";
+	default:			return "x-large";
+	}
+}
+
+QString DkThumbCache::thumbPath(const QString& uri, int tier) {
+
+	QString hash = QCryptographicHash::hash(uri.toUtf8(), QCryptographicHash::Md5).toHex();
+	return cacheDir() + "/" + tierName(tier) + "/" + hash + ".png";
+}
+
 }
@@ -33,7 +33,12 @@
 #include <QColor>
 #include <QDir>
 #include <QThread>
+#include <QThreadPool>
 #include <QImage>
+#include <QMap>
+#include <QHash>
+#include <QPair>
+#include <QVector>
 #pragma warning(pop)		// no warnings from includes - end
 
 #pragma warning(disable: 4251)	// TODO: remove
@@ -52,6 +57,44 @@ namespace nmc {
 
 #define max_thumb_size 160
 
+// nomacs defines
+class DkThumbNailT;
+class DkThumbJob;
+
+/**
+ * Persistent thumbnail store that is shared across sessions and nomacs instances.
+ * It follows the freedesktop thumbnail layout: each size tier is a folder
+ * of PNGs named by the MD5 of the file's URI. The file's mtime and size are
+ * stored as PNG text keys and validated before the pixels are decoded.
+ * Thumbnails are written atomically so that concurrent instances never
+ * read partial files. The store is capped by resources().thumbCacheMemory:
+ * the least recently used thumbnails are evicted (a hit touches the PNG's mtime).
+ **/
+class DllCoreExport DkThumbCache {
+
+public:
+	enum Tier {
+		tier_normal = 128,
+		tier_large = 256,
+		tier_x_large = 512,
+	};
+
+	static QImage load(const QString& filePath, int minThumbSize, int maxThumbSize);
+	static bool save(const QString& filePath, const QImage& thumb, const QSize& imgSize = QSize());
+	static void evict();
+
+	static bool isEnabled();
+	static QString cacheDir();
+
+protected:
+	static QList<int> tiers();
+	static int tierFor(int size);
+	static QString tierName(int tier);
+	static QString thumbPath(const QString& uri, int tier);
+	static bool saveTier(const QFileInfo& fInfo, const QString& uri, const QImage& img, int tier, const QSize& imgSize);
+	static void touch(const QString& thumbPath);
+};
+
 /**
  * This class holds thumbnails.
  **/ 
@@ -64,6 +107,11 @@ public:
 		not_loaded,
 		loaded,
 	};
+
+	enum {
+		tier_min = 64,		// smallest power-of-two tier
+		tier_max = 512,		// largest power-of-two tier
+	};
 	
 	/**
 	 * Default constructor.
@@ -89,6 +137,14 @@ public:
 	 **/ 
 	virtual void setImage(const QImage img);
 
+	/**
+	 * Releases the thumbnail image (e.g. if memory is low).
+	 **/
+	void clearImage() {
+		mImg = QImage();
+		mTiers.clear();
+	};
+
 	void removeBlackBorder(QImage& img);
 
 	/**
@@ -100,6 +156,9 @@ public:
 		return mImg;
 	};
 
+	QImage getImage(int size, Qt::AspectRatioMode mode = Qt::KeepAspectRatio) const;
+	float memoryUsage() const;
+
 	/**
 	 * Returns the file information.
 	 * @return QFileInfo the thumbnail file
@@ -148,6 +207,8 @@ public:
 		mImgExists = exists;
 	};
 
+	friend class DkThumbScheduler;
+
 	enum {
 		do_not_force,
 		force_exif_thumb,
@@ -158,8 +219,11 @@ public:
 
 protected:
 	QImage computeIntern(const QString& file, QSharedPointer<QByteArray> ba, int forceLoad, int maxThumbSize, int minThumbSize);
+	static QSharedPointer<QByteArray> fileBuffer(const QString& filePath, int forceLoad);
+	static QVector<QImage> createTiers(const QImage& img);
 
 	QImage mImg;
+	QVector<QImage> mTiers;		// power-of-two downscaled copies of mImg (largest first)
 	QString mFile;
 	//int s;
 	bool mImgExists;
@@ -167,6 +231,59 @@ protected:
 	int mMinThumbSize;
 };
 
+/**
+ * Schedules the thumbnail jobs of all DkThumbNailT.
+ * Pending jobs are started in the order of their priority (lower values first -
+ * e.g. the distance to the viewport) and they can be re-prioritized or cancelled
+ * until they are started. Each job has an I/O stage (thumbnail store, reading the file)
+ * and a decode stage. Both stages run on dedicated, bounded pools so that thumbnails
+ * never compete with image loading or batch processing for the global thread pool.
+ * The scheduler must only be used from the main thread.
+ **/
+class DllCoreExport DkThumbScheduler : public QObject {
+	Q_OBJECT
+
+public:
+	enum {
+		priority_visible = 0,
+		priority_default = 1000,
+		max_buffer_size = 32*1024*1024,	// larger files are decoded from disk
+	};
+
+	static DkThumbScheduler& instance();
+	~DkThumbScheduler();
+
+	void schedule(DkThumbNailT* thumb, QSharedPointer<QByteArray> ba, int forceLoad, int priority = priority_default);
+	void setPriority(DkThumbNailT* thumb, int priority);
+	void cancel(DkThumbNailT* thumb);
+
+	int numPending() const;
+	int numRunning() const;
+
+	friend class DkThumbStage;
+
+protected slots:
+	void readFinished(quint64 id);
+	void decodeFinished(quint64 id);
+
+protected:
+	DkThumbScheduler();
+
+	void startJobs();
+	void finish(QSharedPointer<DkThumbJob> job);
+	static void readFile(DkThumbJob& job);
+	static void decode(DkThumbJob& job);
+
+	QThreadPool mIoPool;
+	QThreadPool mDecodePool;
+	QMap<QPair<int, quint64>, QSharedPointer<DkThumbJob> > mPending;	// (priority, id) -> job
+	QHash<quint64, QSharedPointer<DkThumbJob> > mJobs;				// pending & running jobs
+	QHash<DkThumbNailT*, quint64> mThumbJobs;
+	quint64 mNextId = 0;
+	int mNumReading = 0;
+	int mNumDecoding = 0;	// queued or running in the decode pool
+};
+
 class DllCoreExport DkThumbNailT : public QObject, public DkThumbNail {
 	Q_OBJECT
 
@@ -174,7 +291,9 @@ public:
 	DkThumbNailT(const QString& mFile = QString(), const QImage& mImg = QImage());
 	~DkThumbNailT();
 
-	bool fetchThumb(int forceLoad = do_not_force, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>());
+	bool fetchThumb(int forceLoad = do_not_force, QSharedPointer<QByteArray> ba = QSharedPointer<QByteArray>(), int priority = DkThumbScheduler::priority_default);
+	void setFetchPriority(int priority);
+	void cancelFetch();
 
 	/**
 	 * Returns whether the thumbnail was loaded, or does not exist.
@@ -182,7 +301,7 @@ public:
 	 **/ 
 	int hasImage() const {
 		
-		if (thumbWatcher.isRunning())
+		if (mFetching)
 			return loading;
 		else
 			return DkThumbNail::hasImage();
@@ -193,16 +312,14 @@ public:
 		emit thumbLoadedSignal(true);
 	};
 
+	friend class DkThumbScheduler;
+
 signals:
 	void thumbLoadedSignal(bool loaded = true);
 
-protected slots:
-	void thumbLoaded();
-
 protected:
-	QImage computeCall(const QString& filePath, QSharedPointer<QByteArray> ba, int forceLoad, int maxThumbSize, int minThumbSize);
+	void thumbComputed(const QImage& img, const QVector<QImage>& tiers);
 
-	QFutureWatcher<QImage> thumbWatcher;
 	bool mFetching;
 	int mForceLoad;
 };
@@ -28,6 +28,7 @@
 #include "DkUtils.h"
 #include "DkMath.h"
 #include "DkSettings.h"
+#include "DkKeywordFilter.h"
 
 #if defined(Q_OS_LINUX) && !defined(Q_OS_OPENBSD)
 #include <sys/sysinfo.h>
@@ -292,6 +293,53 @@ QString DkUtils::getLongestNumber(const QString& str, int startIdx) {
 	return str.mid(startIdx, idx-startIdx);
 }
 
+QByteArray DkUtils::naturalSortKey(const QString& str) {
+
+	// the key consists of big endian UTF-16 code units of the case folded string
+	// numbers are encoded at the position of '0' (so that they sort like digits
+	// against other characters) followed by the number of significant digits and
+	// the digits - which is the same as zero-padding all numbers to the same width
+	// the original string is appended to make the order unique (e.g. a01 vs a1 or A vs a)
+	QString folded = str.toCaseFolded();
+
+	QByteArray key;
+	key.reserve(folded.size()*2 + str.size()*2 + 2);
+
+	auto appendCodeUnit = [&key](ushort c) {
+		key.append((char)(c >> 8));
+		key.append((char)(c & 0xff));
+	};
+
+	for (int idx = 0; idx < folded.size(); idx++) {
+
+		if (!folded[idx].isDigit()) {
+			appendCodeUnit(folded[idx].unicode());
+			continue;
+		}
+
+		// skip leading zeros
+		while (idx+1 < folded.size() && folded[idx].digitValue() == 0 && folded[idx+1].isDigit())
+			idx++;
+
+		int sIdx = idx;
+		while (idx+1 < folded.size() && folded[idx+1].isDigit())
+			idx++;
+
+		appendCodeUnit('0');
+		appendCodeUnit((ushort)qMin(idx-sIdx+1, 0xffff));
+
+		for (int dIdx = sIdx; dIdx <= idx; dIdx++)
+			key.append((char)('0' + folded[dIdx].digitValue()));
+	}
+
+	// tie-breaker
+	appendCodeUnit(0);
+	for (const QChar& c : str)
+		appendCodeUnit(c.unicode());
+
+	return key;
+}
+
 bool DkUtils::compDateCreated(const QFileInfo& lhf, const QFileInfo& rhf) {
 
 	return lhf.created() < rhf.created();
@@ -721,31 +769,7 @@ QString DkUtils::colorToString(const QColor& col) {
 
 QStringList DkUtils::filterStringList(const QString& query, const QStringList& list) {
 
-	// white space is the magic thingy
-	QStringList queries = query.split(" ");
-	QStringList resultList = list;
-
-	for (int idx = 0; idx < queries.size(); idx++) {
-		// Detect and correct special case where a space is leading or trailing the search term - this should be significant
-		if (idx == 0 && queries.size() > 1 && queries[idx].size() == 0) queries[idx] = " " + queries[idx + 1];
-		if (idx == queries.size() - 1 && queries.size() > 2 && queries[idx].size() == 0) queries[idx] = queries[idx - 1] + " ";
-		// The queries will be repeated, but this is okay - it will just be matched both with and without the space. 
-		resultList = resultList.filter(queries[idx], Qt::CaseInsensitive);
-		qDebug() << "query: " << queries[idx];
-	}
-
-	// if string match returns nothing -> try a regexp
-	if (resultList.empty()) {
-		QRegExp regExp(query);
-		resultList = list.filter(regExp);
-
-		if (resultList.empty()) {
-			regExp.setPatternSyntax(QRegExp::Wildcard);
-			resultList = list.filter(regExp);
-		}
-	}
-
-	return resultList;
+	return DkKeywordFilter(QStringList(), QStringList(), query).filter(list);
 }
 
 bool DkUtils::moveToTrash(const QString& filePath) {
@@ -33,6 +33,7 @@
 #pragma warning(push, 0)	// no warnings from includes - begin
 #include <QFileInfo>
 #include <QVector>
+#include <QByteArray>
 #include <QDebug>
 #pragma warning(pop)		// no warnings from includes - end
 
@@ -146,6 +147,18 @@ public:
 
 	static QString getLongestNumber(const QString& str, int startIdx = 0);
 
+	/**
+	 * Creates a binary collation key for natural sorting.
+	 * Comparing two keys byte-wise (memcmp) sorts the strings
+	 * case insensitive with numbers sorted by their value:
+	 * a1.png < A2.png < a10.png
+	 * The key is computed once per string, so sorting does not
+	 * need to tokenize the strings for every comparison.
+	 * @param str the string (e.g. a file name)
+	 * @return QByteArray the collation key
+	 **/
+	static QByteArray naturalSortKey(const QString& str);
+
 	static void addLanguages(QComboBox* langCombo, QStringList& languages);
 
 	static void registerFileVersion();
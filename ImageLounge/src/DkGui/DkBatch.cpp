@@ -367,7 +367,7 @@ void DkBatchInput::createLayout() {
 	connect(mDirectoryEdit, SIGNAL(textChanged(const QString&)), this, SLOT(parameterChanged()));
 	connect(mDirectoryEdit, SIGNAL(directoryChanged(const QString&)), this, SLOT(setDir(const QString&)));
 	connect(mExplorer, SIGNAL(openDir(const QString&)), this, SLOT(setDir(const QString&)));
-	connect(mLoader.data(), SIGNAL(updateDirSignal(QVector<QSharedPointer<DkImageContainerT> >)), mThumbScrollWidget, SLOT(updateThumbs(QVector<QSharedPointer<DkImageContainerT> >)));
+	connect(mLoader.data(), SIGNAL(updateDirSignal(QSharedPointer<DkFolderIndex>)), mThumbScrollWidget, SLOT(updateThumbs(QSharedPointer<DkFolderIndex>)));
 
 }
 
@@ -385,7 +385,7 @@ void DkBatchInput::changeTab(int tabIdx) const {
 	mInputTabs->setCurrentIndex(tabIdx);
 }
 
-void DkBatchInput::updateDir(QVector<QSharedPointer<DkImageContainerT> > thumbs) {
+void DkBatchInput::updateDir(QSharedPointer<DkFolderIndex> thumbs) {
 	emit updateDirSignal(thumbs);
 }
 
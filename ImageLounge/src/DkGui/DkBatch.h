@@ -209,14 +209,14 @@ public:
 public slots:
 	void setDir(const QString& dirPath);
 	void browse();
-	void updateDir(QVector<QSharedPointer<DkImageContainerT> >);
+	void updateDir(QSharedPointer<DkFolderIndex>);
 	void setVisible(bool visible);
 	void parameterChanged();
 	void selectionChanged();
 	void setFileInfo(QFileInfo file);
 
 signals:
-	void updateDirSignal(QVector<QSharedPointer<DkImageContainerT> >) const;
+	void updateDirSignal(QSharedPointer<DkFolderIndex>) const;
 	void newHeaderText(const QString&) const;
 	void updateInputDir(const QString&) const;
 	void changed() const;
@@ -805,7 +805,7 @@ void DkCentralWidget::showViewPort(bool show /* = true */) {
 	if (show) {
 		switchWidget(mWidgets[viewport_widget]);
 		if (getCurrentImage())
-			mViewport->setImage(getCurrentImage()->image());
+			mViewport->setImage(getCurrentImage()->displayImage());
 	}
 	else 
 		mViewport->deactivate();
@@ -471,7 +471,7 @@ void DkControlWidget::showHistogram(bool visible) {
 
 	if (visible && !mHistogram->isVisible()) {
 		mHistogram->show();
-		if(!mViewport->getImage().isNull()) mHistogram->drawHistogram(mViewport->getImage());
+		if(!mViewport->getImage().isNull()) mHistogram->drawHistogram(mViewport->getImageStorage()->image(QSize(DkHistogram::max_image_size, DkHistogram::max_image_size)));
 		else  mHistogram->clearHistogram();
 	}
 	else if (!visible && mHistogram->isVisible()) {
@@ -35,6 +35,7 @@
 #include "DkBasicWidgets.h"
 #include "DkThumbs.h"
 #include "DkUtils.h"
+#include "DkKeywordFilter.h"
 #include "DkActionManager.h"
 #include "DkPluginManager.h"
 
@@ -677,8 +678,10 @@ void DkSearchDialog::on_searchBar_textChanged(const QString& text) {
 	if (text == mCurrentSearch)
 		return;
 	
-	mResultList = DkUtils::filterStringList(text, mFileList);
-	qDebug() << "searching [" << text << "] - converted to individual keywords [" << text.split(" ") << "] takes: " << dt;
+	// the same filter is used if the folder is filtered
+	DkKeywordFilter filter(QStringList(), QStringList(), text);
+	mResultList = filter.filter(mFileList);
+	qDebug() << "searching [" << text << "] - converted to individual keywords [" << DkKeywordFilter::queryTerms(text) << "] takes: " << dt;
 	mCurrentSearch = text;
 
 	if (mResultList.empty()) {
@@ -391,6 +391,7 @@ void DkNoMacs::createActions() {
 	connect(am.action(DkActionManager::menu_sort_date_created), SIGNAL(triggered(bool)), this, SLOT(changeSorting(bool)));
 	connect(am.action(DkActionManager::menu_sort_date_modified), SIGNAL(triggered(bool)), this, SLOT(changeSorting(bool)));
 	connect(am.action(DkActionManager::menu_sort_random), SIGNAL(triggered(bool)), this, SLOT(changeSorting(bool)));
+	connect(am.action(DkActionManager::menu_sort_file_size), SIGNAL(triggered(bool)), this, SLOT(changeSorting(bool)));
 	connect(am.action(DkActionManager::menu_sort_ascending), SIGNAL(triggered(bool)), this, SLOT(changeSorting(bool)));
 	connect(am.action(DkActionManager::menu_sort_descending), SIGNAL(triggered(bool)), this, SLOT(changeSorting(bool)));
 
@@ -1529,6 +1530,8 @@ void DkNoMacs::changeSorting(bool change) {
 			DkSettingsManager::param().global().sortMode = DkSettings::sort_date_modified;
 		else if (senderName == "menu_sort_random")
 			DkSettingsManager::param().global().sortMode = DkSettings::sort_random;
+		else if (senderName == "menu_sort_file_size")
+			DkSettingsManager::param().global().sortMode = DkSettings::sort_file_size;
 		else if (senderName == "menu_sort_ascending")
 			DkSettingsManager::param().global().sortDir = DkSettings::sort_ascending;
 		else if (senderName == "menu_sort_descending")
@@ -1624,7 +1627,7 @@ void DkNoMacs::resizeImage() {
 	qDebug() << "resize image: " << viewport()->getImage().size();
 
 
-	mResizeDialog->setImage(viewport()->getImage());
+	mResizeDialog->setImage(viewport()->getFullImage());
 
 	if (!mResizeDialog->exec())
 		return;
@@ -1757,7 +1760,7 @@ void DkNoMacs::printDialog() {
 		res = imgC->getMetaData()->getResolution();
 
 	//QPrintPreviewDialog* previewDialog = new QPrintPreviewDialog();
-	QImage img = viewport()->getImage();
+	QImage img = viewport()->getFullImage();
 	if (!mPrintPreviewDialog)
 		mPrintPreviewDialog = new DkPrintPreviewDialog(img, (float)res.x(), 0, this);
 	else
@@ -2148,7 +2151,7 @@ void DkNoMacs::setWindowTitle(QSharedPointer<DkImageContainerT> imgC) {
 		return;
 	}
 
-	setWindowTitle(imgC->filePath(), imgC->image().size(), imgC->isEdited(), imgC->getTitleAttribute());
+	setWindowTitle(imgC->filePath(), imgC->imageSize(), imgC->isEdited(), imgC->getTitleAttribute());
 }
 
 void DkNoMacs::setWindowTitle(const QString& filePath, const QSize& size, bool edited, const QString& attr) {
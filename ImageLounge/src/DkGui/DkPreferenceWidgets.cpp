@@ -28,6 +28,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "DkPreferenceWidgets.h"
 
 #include "DkImageStorage.h"
+#include "DkMemoryManager.h"
 #include "DkWidgets.h"
 #include "DkSettings.h"
 #include "DkUtils.h"
@@ -938,6 +939,25 @@ void DkFilePreference::createLayout() {
 	historyGroup->addWidget(historyBox);
 	historyGroup->addWidget(hLabel);
 
+	// memory budget
+	QSpinBox* memoryBox = new QSpinBox(this);
+	memoryBox->setObjectName("memoryBox");
+	memoryBox->setMinimum(0);
+	memoryBox->setMaximum(qMax(qRound(DkMemory::getTotalMemory()), 1024));
+	memoryBox->setSuffix(" MB");
+	memoryBox->setSpecialValueText(tr("Automatic"));
+	memoryBox->setMaximumWidth(200);
+	memoryBox->setValue(qRound(DkSettingsManager::param().resources().memoryBudget));
+
+	QLabel* mLabel = new QLabel(tr("Cache, history, thumbnails and scaled images are released if they exceed this value."), this);
+	QLabel* uLabel = new QLabel(tr("Currently used: %1").arg(DkMemoryManager::instance().usageInfo()), this);
+	uLabel->setWordWrap(true);
+
+	DkGroupWidget* memoryGroup = new DkGroupWidget(tr("Memory Budget"), this);
+	memoryGroup->addWidget(memoryBox);
+	memoryGroup->addWidget(mLabel);
+	memoryGroup->addWidget(uLabel);
+
 
 	// loading policy
 	QVector<QRadioButton*> loadButtons;
@@ -976,6 +996,7 @@ void DkFilePreference::createLayout() {
 	leftLayout->addWidget(tempFolderGroup);
 	leftLayout->addWidget(cacheGroup);
 	leftLayout->addWidget(historyGroup);
+	leftLayout->addWidget(memoryGroup);
 	leftLayout->addWidget(loadGroup);
 	leftLayout->addWidget(skipGroup);
 
@@ -1025,6 +1046,14 @@ void DkFilePreference::on_historyBox_valueChanged(int value) const {
 	}
 }
 
+void DkFilePreference::on_memoryBox_valueChanged(int value) const {
+
+	if (DkSettingsManager::param().resources().memoryBudget != value) {
+		DkSettingsManager::param().resources().memoryBudget = (float)value;
+		DkMemoryManager::instance().balance();
+	}
+}
+
 void DkFilePreference::paintEvent(QPaintEvent *event) {
 
 	// fixes stylesheets which are not applied to custom widgets
@@ -56,10 +56,281 @@
 #include <QMessageBox>
 #include <QInputDialog>
 #include <QMimeData>
+#include <QtConcurrentRun>
 #pragma warning(pop)		// no warnings from includes - end
 
+#include <algorithm>
+
 namespace nmc {
 
+// DkThumbAtlas --------------------------------------------------------------------
+DkThumbAtlas::DkThumbAtlas() {
+
+	// pixmaps must not outlive the application
+	connect(QCoreApplication::instance(), SIGNAL(aboutToQuit()), this, SLOT(clear()));
+
+	DkMemoryManager::instance().registerClient(this, DkMemoryManager::mem_thumbs, DkMemoryManager::priority_medium);
+}
+
+DkThumbAtlas::~DkThumbAtlas() {
+
+	DkMemoryManager::instance().unregisterClient(this);
+}
+
+DkThumbAtlas& DkThumbAtlas::instance() {
+
+	static DkThumbAtlas inst;
+	return inst;
+}
+
+/**
+ * Adds a thumbnail that is already in the atlas to the batch.
+ * @param batch the fragments of the current frame
+ * @param key the thumbnail's key (e.g. its file path)
+ * @param version the thumbnail's cache key - changed thumbnails must be inserted again
+ * @param cellSize the thumbnail size
+ * @param target the thumbnail is fit into this rect
+ * @return bool false if the thumbnail needs to be inserted
+ **/
+bool DkThumbAtlas::add(Batch& batch, const QString& key, qint64 version, int cellSize, const QRectF& target) {
+
+	QHash<Key, DkAtlasEntry>::const_iterator it = mEntries.constFind(Key(cellSize, key));
+
+	if (it == mEntries.constEnd() || it.value().version != version)
+		return false;
+
+	addFragment(batch, it.value(), target);
+
+	return true;
+}
+
+/**
+ * Uploads a thumbnail to the atlas and adds it to the batch.
+ * The image is scaled down if it is larger than the cell.
+ * Pages that are referenced by the batch are never evicted.
+ * @param batch the fragments of the current frame
+ * @param key the thumbnail's key (e.g. its file path)
+ * @param version the thumbnail's cache key
+ * @param img the thumbnail
+ * @param cellSize the thumbnail size
+ * @param target the thumbnail is fit into this rect
+ * @return bool false if no page is available - the thumbnail must be drawn directly then
+ **/
+bool DkThumbAtlas::insert(Batch& batch, const QString& key, qint64 version, const QImage& img, int cellSize, const QRectF& target) {
+
+	if (img.isNull() || cellSize <= 0 || cellSize > page_size)
+		return false;
+
+	Key k(cellSize, key);
+	DkAtlasEntry entry = mEntries.value(k);
+
+	if (entry.page == -1) {
+
+		entry.page = allocateCell(cellSize, batch, entry.cell);
+
+		if (entry.page == -1)
+			return false;
+
+		mPages[entry.page].cells[entry.cell] = key;
+	}
+
+	QImage thumb = img;
+
+	if (thumb.width() > cellSize || thumb.height() > cellSize)
+		thumb = thumb.scaled(cellSize, cellSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+
+	QRect r = cellRect(mPages[entry.page], entry.cell);
+
+	QPainter p(&mPages[entry.page].pixmap);
+	p.setCompositionMode(QPainter::CompositionMode_Source);
+	p.fillRect(r, Qt::transparent);
+	p.drawImage(r.topLeft(), thumb);
+	p.end();
+
+	entry.version = version;
+	entry.size = thumb.size();
+	mEntries.insert(k, entry);
+
+	addFragment(batch, entry, target);
+
+	return true;
+}
+
+/**
+ * Draws the batch - one call per atlas page.
+ * @param painter the painter
+ * @param batch the fragments of the current frame
+ **/
+void DkThumbAtlas::draw(QPainter* painter, const Batch& batch) const {
+
+	for (Batch::const_iterator it = batch.constBegin(); it != batch.constEnd(); it++) {
+
+		const QVector<QPainter::PixmapFragment>& fragments = it.value();
+		painter->drawPixmapFragments(fragments.constData(), fragments.size(), mPages[it.key()].pixmap);
+	}
+}
+
+/**
+ * Returns a rect with the aspect ratio of size that is centered in target.
+ **/
+QRectF DkThumbAtlas::fitRect(const QSizeF& size, const QRectF& target) {
+
+	QSizeF s = size.scaled(target.size(), Qt::KeepAspectRatio);
+	QRectF r(QPointF(), s);
+	r.moveCenter(target.center());
+
+	return r;
+}
+
+float DkThumbAtlas::memoryUsage(int) const {
+
+	float mem = 0;
+
+	for (const DkAtlasPage& page : mPages) {
+
+		if (!page.pixmap.isNull())
+			mem += DkImage::getBufferSizeFloat(page.pixmap.size(), page.pixmap.depth());
+	}
+
+	return mem;
+}
+
+/**
+ * Releases the least recently used pages.
+ * Released thumbnails are uploaded again when they are drawn.
+ **/
+float DkThumbAtlas::releaseMemory(int, float mem) {
+
+	float released = 0;
+
+	while (released < mem) {
+
+		int pageIdx = -1;
+
+		for (int idx = 0; idx < mPages.size(); idx++) {
+
+			if (!mPages[idx].pixmap.isNull() && (pageIdx == -1 || mPages[idx].lastUsed < mPages[pageIdx].lastUsed))
+				pageIdx = idx;
+		}
+
+		if (pageIdx == -1)
+			break;
+
+		DkAtlasPage& page = mPages[pageIdx];
+		released += DkImage::getBufferSizeFloat(page.pixmap.size(), page.pixmap.depth());
+		evictPage(pageIdx);
+		page.pixmap = QPixmap();
+	}
+
+	return released;
+}
+
+void DkThumbAtlas::clear() {
+
+	mPages.clear();
+	mEntries.clear();
+}
+
+/**
+ * Returns a free cell of the given size.
+ * If all pages are used, the least recently drawn page is recycled.
+ * @param cellSize the thumbnail size
+ * @param batch pages of the current frame are not recycled
+ * @param cell the free cell
+ * @return int the page index or -1 if no page is available
+ **/
+int DkThumbAtlas::allocateCell(int cellSize, const Batch& batch, int& cell) {
+
+	int pageIdx = -1;
+
+	for (int idx = 0; idx < mPages.size(); idx++) {
+
+		if (mPages[idx].cellSize == cellSize && !mPages[idx].freeCells.empty()) {
+			cell = mPages[idx].freeCells.takeLast();
+			return idx;
+		}
+		else if (mPages[idx].cellSize == 0 && pageIdx == -1)
+			pageIdx = idx;
+	}
+
+	if (pageIdx == -1 && mPages.size() < max_pages) {
+		mPages.append(DkAtlasPage());
+		pageIdx = mPages.size()-1;
+	}
+	else if (pageIdx == -1) {
+
+		for (int idx = 0; idx < mPages.size(); idx++) {
+
+			if (!batch.contains(idx) && (pageIdx == -1 || mPages[idx].lastUsed < mPages[pageIdx].lastUsed))
+				pageIdx = idx;
+		}
+
+		if (pageIdx == -1)
+			return -1;
+
+		evictPage(pageIdx);
+	}
+
+	initPage(pageIdx, cellSize);
+	cell = mPages[pageIdx].freeCells.takeLast();
+
+	return pageIdx;
+}
+
+void DkThumbAtlas::initPage(int pageIdx, int cellSize) {
+
+	DkAtlasPage& page = mPages[pageIdx];
+
+	if (page.pixmap.isNull())
+		page.pixmap = QPixmap(page_size, page_size);
+	page.pixmap.fill(Qt::transparent);
+
+	int numCols = page_size / cellSize;
+	int numCells = numCols*numCols;
+
+	page.cellSize = cellSize;
+	page.cells.fill(QString(), numCells);
+	page.freeCells.resize(numCells);
+
+	// the first cell is taken first
+	for (int idx = 0; idx < numCells; idx++)
+		page.freeCells[idx] = numCells-1-idx;
+}
+
+void DkThumbAtlas::evictPage(int pageIdx) {
+
+	DkAtlasPage& page = mPages[pageIdx];
+
+	for (const QString& key : page.cells) {
+
+		if (!key.isEmpty())
+			mEntries.remove(Key(page.cellSize, key));
+	}
+
+	page.cellSize = 0;
+	page.cells.clear();
+	page.freeCells.clear();
+	page.lastUsed = 0;
+}
+
+QRect DkThumbAtlas::cellRect(const DkAtlasPage& page, int cell) const {
+
+	int numCols = page_size / page.cellSize;
+
+	return QRect((cell % numCols)*page.cellSize, (cell / numCols)*page.cellSize, page.cellSize, page.cellSize);
+}
+
+void DkThumbAtlas::addFragment(Batch& batch, const DkAtlasEntry& entry, const QRectF& target) {
+
+	DkAtlasPage& page = mPages[entry.page];
+	page.lastUsed = ++mClock;
+
+	QRectF src(cellRect(page, entry.cell).topLeft(), entry.size);
+	QRectF r = fitRect(entry.size, target);
+
+	batch[entry.page] << QPainter::PixmapFragment::create(r.center(), src, r.width()/src.width(), r.height()/src.height());
+}
+
 // DkFilePreview --------------------------------------------------------------------
 DkFilePreview::DkFilePreview(QWidget* parent, Qt::WindowFlags flags) : DkWidget(parent, flags) {
 
@@ -100,6 +371,7 @@ void DkFilePreview::init() {
 	moveImageTimer = new QTimer(this);
 	moveImageTimer->setInterval(5);	// reduce cpu utilization
 	connect(moveImageTimer, SIGNAL(timeout()), this, SLOT(moveImages()));
+	connect(&mScaleWatcher, SIGNAL(finished()), this, SLOT(imageScaled()));
 
 	int borderTriggerI = qRound(borderTrigger);
 	leftGradient = (orientation == Qt::Horizontal) ? QLinearGradient(QPoint(0, 0), QPoint(borderTriggerI, 0)) : QLinearGradient(QPoint(0, 0), QPoint(0, borderTriggerI));
@@ -163,6 +435,7 @@ void DkFilePreview::initOrientations() {
 	worldMatrix.reset();
 	currentDx = 0;
 	scrollToCurrentImage = true;
+	invalidateThumbOffsets();
 	update();
 
 }
@@ -225,6 +498,7 @@ void DkFilePreview::paintEvent(QPaintEvent*) {
 		yOffset = qCeil(DkSettingsManager::param().effectiveThumbSize(this)*0.1f);
 
 		minHeight = DkSettingsManager::param().effectiveThumbSize(this) + yOffset;
+		invalidateThumbOffsets();
 		
 		if (orientation == Qt::Horizontal)
 			setMaximumSize(QWIDGETSIZE_MAX, minHeight);
@@ -254,10 +528,8 @@ void DkFilePreview::paintEvent(QPaintEvent*) {
 	painter.setWorldTransform(worldMatrix);
 	painter.setWorldMatrixEnabled(true);
 
-	if (mThumbs.empty()) {
-		thumbRects.clear();
+	if (mThumbs->empty())
 		return;
-	}
 
 	painter.setRenderHint(QPainter::SmoothPixmapTransform);
 	drawThumbs(&painter);
@@ -275,104 +547,379 @@ void DkFilePreview::drawThumbs(QPainter* painter) {
 
 	//qDebug() << "drawing thumbs: " << worldMatrix.dx();
 
-	bufferDim = (orientation == Qt::Horizontal) ? QRectF(QPointF(0, yOffset/2), QSize(xOffset, 0)) : QRectF(QPointF(yOffset/2, 0), QSize(0, xOffset));
-	thumbRects.clear();
+	updateThumbOffsets();
 
-	DkTimer dt;
+	int limit = orientation == Qt::Horizontal ? width() : height();
+	float translation = orientation == Qt::Horizontal ? (float)worldMatrix.dx() : (float)worldMatrix.dy();
+	bufferDim = (orientation == Qt::Horizontal) ? QRectF(QPointF(0, yOffset/2), QSizeF(thumbOffset(mThumbExtents.size()), 0)) : QRectF(QPointF(yOffset/2, 0), QSizeF(0, thumbOffset(mThumbExtents.size())));
 
-	// mouse over effect
-	QPoint p = worldMatrix.inverted().map(mapFromGlobal(QCursor::pos()));
+	// update file rect for move to current file timer
+	if (scrollToCurrentImage) {
+		QRectF r = thumbRect(currentFileIdx);
 
-	for (int idx = 0; idx < mThumbs.size(); idx++) {
+		if (!r.isNull())
+			newFileRect = worldMatrix.mapRect(r);
+	}
 
-		QSharedPointer<DkThumbNailT> thumb = mThumbs.at(idx)->getThumb();
-		QImage img;
-		
-		// if the image is loaded draw that (it might be edited)
-		if (mThumbs.at(idx)->hasImage()) {
-			img = mThumbs.at(idx)->imageScaledToHeight(DkSettingsManager::param().effectiveThumbSize(this));
-		}
-		else {
+	// only the thumbnails within the canvas are drawn
+	int firstIdx = thumbIdxAt(-translation);
+	int lastIdx = thumbIdxAt(limit - translation);
 
-			if (thumb->hasImage() == DkThumbNail::exists_not) {
-				thumbRects.push_back(QRectF());
-				continue;
-			}
+	if (firstIdx == -1)
+		firstIdx = 0;
 
-			if (thumb->hasImage() == DkThumbNail::loaded)
-				img = thumb->getImage();
-		}
+	// mouse over effect
+	QPoint p = worldMatrix.inverted().map(mapFromGlobal(QCursor::pos()));
+	int ts = DkSettingsManager::param().effectiveThumbSize(this);
 
-		if (img.width() > max_thumb_size * DkSettingsManager::param().dPIScaleFactor())
-			qDebug() << thumb->getFilePath() << "size:" << img.size();
+	QVector<QSharedPointer<DkThumbNailT> > fetchedThumbs;
 
-		QPointF anchor = orientation == Qt::Horizontal ? bufferDim.topRight() : bufferDim.bottomLeft();
-		QRectF r = !img.isNull() ? QRectF(anchor, img.size()) : QRectF(anchor, QSize(DkSettingsManager::param().effectiveThumbSize(this), DkSettingsManager::param().effectiveThumbSize(this)));
-		if (orientation == Qt::Horizontal && height()-yOffset < r.height()*2)
-			r.setSize(QSizeF(qFloor(r.width()*(float)(height()-yOffset)/r.height()), height()-yOffset));
-		else if (orientation == Qt::Vertical && width()-yOffset < r.width()*2)
-			r.setSize(QSizeF(width()-yOffset, qFloor(r.height()*(float)(width()-yOffset)/r.width())));
+	// thumbnails are blitted from the atlas after the loop (one call per page)
+	DkThumbAtlas& atlas = DkThumbAtlas::instance();
+	DkThumbAtlas::Batch batch;
+	QRectF currentRect;
+	QRectF selectedRect;
 
-		// check if the size is still valid
-		if (r.width() < 1 || r.height() < 1) 
-			continue;	// this brings us in serious problems with the selection
+	for (int idx = firstIdx; idx <= lastIdx && idx < mThumbs->size(); idx++) {
 
-		// center vertically
-		if (orientation == Qt::Horizontal)
-			r.moveCenter(QPoint(qFloor(r.center().x()), height()/2));
-		else
-			r.moveCenter(QPoint(width()/2, qFloor(r.center().y())));
+		QRectF r = thumbRect(idx);
 
-		// update the buffer dim
-		if (orientation == Qt::Horizontal)
-			bufferDim.setRight(qFloor(bufferDim.right() + r.width()) + qCeil(xOffset/2.0f));
-		else
-			bufferDim.setBottom(qFloor(bufferDim.bottom() + r.height()) + qCeil(xOffset/2.0f));
-		thumbRects.push_back(r);
+		// check if the size is still valid
+		if (r.isNull())
+			continue;
 
-		QRectF imgWorldRect = worldMatrix.mapRect(r);
+		QSharedPointer<DkImageContainerT> imgC = mThumbs->at(idx);
+		QSharedPointer<DkThumbNailT> thumb = imgC->getThumb();
+		QImage img;
+		bool isThumb = false;
+		
+		// if the image is loaded draw that (it might be edited)
+		if (imgC->hasImage())
+			img = scaledImage(imgC, ts);
 
-		// update file rect for move to current file timer
-		if (scrollToCurrentImage && idx == currentFileIdx)
-			newFileRect = imgWorldRect;
+		if (img.isNull() && thumb->hasImage() == DkThumbNail::loaded) {
+			img = thumb->getImage(qCeil(qMax(r.width(), r.height())));
+			isThumb = true;
+		}
 
-		// is the current image within the canvas?
-		if (orientation == Qt::Horizontal && imgWorldRect.right() < 0 || orientation == Qt::Vertical && imgWorldRect.bottom() < 0)
-			continue;
-		if ((orientation == Qt::Horizontal && imgWorldRect.left() > width() || orientation == Qt::Vertical && imgWorldRect.top() > height()) && scrollToCurrentImage) 
-			continue;
-		else if (orientation == Qt::Horizontal && imgWorldRect.left() > width() || orientation == Qt::Vertical && imgWorldRect.top() > height())
-			break;
+		QRectF imgWorldRect = worldMatrix.mapRect(r);
 
+		// the scheduler bounds the workers - so we can request all visible thumbs
 		if (thumb->hasImage() == DkThumbNail::not_loaded && 
-			DkSettingsManager::param().resources().numThumbsLoading < DkSettingsManager::param().resources().maxThumbsLoading) {
-				thumb->fetchThumb();
-				connect(thumb.data(), SIGNAL(thumbLoadedSignal()), this, SLOT(update()));
+			thumb->fetchThumb(DkThumbNail::do_not_force, QSharedPointer<QByteArray>(), DkThumbScheduler::priority_visible)) {
+				fetchedThumbs << thumb;
 		}
+		else if (thumb->hasImage() == DkThumbNail::loading && mFetchedThumbs.contains(thumb))
+			fetchedThumbs << thumb;
+
+		// thumbnails change their size if they are loaded
+		connect(thumb.data(), SIGNAL(thumbLoadedSignal()), this, SLOT(thumbLoaded()), Qt::UniqueConnection);
 
 		bool isLeftGradient = (orientation == Qt::Horizontal && worldMatrix.dx() < 0 && imgWorldRect.left() < leftGradient.finalStop().x()) ||
 			(orientation == Qt::Vertical && worldMatrix.dy() < 0 && imgWorldRect.top() < leftGradient.finalStop().y());
 		bool isRightGradient = orientation == Qt::Horizontal && imgWorldRect.right() > rightGradient.start().x() ||
 			orientation == Qt::Vertical && imgWorldRect.bottom() > rightGradient.start().y();
+		// faded thumbnails are modified - so they are drawn directly
+		bool inAtlas = false;
+
+		if (isThumb && !isLeftGradient && !isRightGradient) {
+			int cellSize = thumb->getMaxThumbSize();
+			inAtlas = atlas.add(batch, thumb->getFilePath(), img.cacheKey(), cellSize, r) || 
+				atlas.insert(batch, thumb->getFilePath(), img.cacheKey(), img, cellSize, r);
+		}
+
 		// show that there are more images...
 		if (isLeftGradient && !img.isNull())
 			drawFadeOut(leftGradient, imgWorldRect, &img);
 		if (isRightGradient && !img.isNull())
 			drawFadeOut(rightGradient, imgWorldRect, &img);
 
-		if (!img.isNull())
-			painter->drawImage(r, img, QRect(QPoint(), img.size()));
-		else 
+		if (img.isNull())
 			drawNoImgEffect(painter, r);
+		else if (!inAtlas)
+			painter->drawImage(r, img, QRect(QPoint(), img.size()));
 				
+		// effects are drawn on top of the atlas
 		if (idx == currentFileIdx)
-			drawCurrentImgEffect(painter, r);
+			currentRect = r;
 		else if (idx == selected && r.contains(p))
-			drawSelectedEffect(painter, r);
+			selectedRect = r;
 
 
 		//painter->fillRect(QRect(0,0,200, 110), leftGradient);
 	}
+
+	atlas.draw(painter, batch);
+
+	if (!currentRect.isNull())
+		drawCurrentImgEffect(painter, currentRect);
+	if (!selectedRect.isNull())
+		drawSelectedEffect(painter, selectedRect);
+
+	// cancel the thumbs that were scrolled out of view
+	for (QSharedPointer<DkThumbNailT> thumb : mFetchedThumbs) {
+		if (!fetchedThumbs.contains(thumb))
+			thumb->cancelFetch();
+	}
+	mFetchedThumbs = fetchedThumbs;
+}
+
+/**
+ * Returns the size of a thumbnail in the strip.
+ * Only materialized images can have a thumbnail - all others are drawn as placeholders.
+ * @param idx the thumbnail's index
+ * @param ts the thumbnail size
+ * @return QSizeF the size or an empty size if the thumbnail is not drawn
+ **/
+QSizeF DkFilePreview::thumbSize(int idx, int ts) const {
+
+	QSizeF s(ts, ts);
+	QSharedPointer<DkImageContainerT> imgC = mThumbs->materialized(idx);
+
+	if (imgC) {
+
+		QSharedPointer<DkThumbNailT> thumb = imgC->getThumb();
+
+		// if the image is loaded draw that (it might be edited)
+		// the size is known without waiting for the full (or tiled) image
+		if (imgC->hasImage()) {
+			QSize is = imgC->imageSize();
+
+			if (!is.isEmpty())
+				s = QSizeF(qRound((double)is.width()*ts/is.height()), ts);
+		}
+		else if (thumb->hasImage() == DkThumbNail::exists_not)
+			return QSizeF();
+		else if (thumb->hasImage() == DkThumbNail::loaded)
+			s = thumb->getImage().size();
+	}
+
+	if (orientation == Qt::Horizontal && height()-yOffset < s.height()*2)
+		s = QSizeF(qFloor(s.width()*(float)(height()-yOffset)/s.height()), height()-yOffset);
+	else if (orientation == Qt::Vertical && width()-yOffset < s.width()*2)
+		s = QSizeF(width()-yOffset, qFloor(s.height()*(float)(width()-yOffset)/s.width()));
+
+	if (s.width() < 1 || s.height() < 1)
+		return QSizeF();
+
+	return s;
+}
+
+/**
+ * Returns the thumbnail's rect in world coordinates.
+ * @param idx the thumbnail's index
+ * @return QRectF the rect or a null rect if the thumbnail is not drawn
+ **/
+QRectF DkFilePreview::thumbRect(int idx) const {
+
+	if (idx < 0 || idx >= mThumbExtents.size())
+		return QRectF();
+
+	QSizeF s = thumbSize(idx, DkSettingsManager::param().effectiveThumbSize(this));
+
+	if (s.isEmpty())
+		return QRectF();
+
+	float offset = (float)thumbOffset(idx);
+	QPointF anchor = orientation == Qt::Horizontal ? QPointF(offset, yOffset/2) : QPointF(yOffset/2, offset);
+	QRectF r(anchor, s);
+
+	// center vertically
+	if (orientation == Qt::Horizontal)
+		r.moveCenter(QPoint(qFloor(r.center().x()), height()/2));
+	else
+		r.moveCenter(QPoint(width()/2, qFloor(r.center().y())));
+
+	return r;
+}
+
+/**
+ * Returns the thumbnail at a position along the strip.
+ * @param pos the position in world coordinates
+ * @return int the thumbnail's index or -1 if the position is before the first thumbnail
+ **/
+int DkFilePreview::thumbIdxAt(float pos) const {
+
+	int numThumbs = mThumbExtents.size();
+
+	if (numThumbs == 0 || pos < xOffset)
+		return -1;
+
+	// the last thumbnail that starts before pos: descend the Fenwick tree
+	float rem = pos - xOffset;
+	int idx = 0;
+
+	for (int step = highestBit(numThumbs); step > 0; step >>= 1) {
+
+		if (idx + step <= numThumbs && mExtentTree[idx + step] <= rem) {
+			idx += step;
+			rem -= mExtentTree[idx];
+		}
+	}
+
+	return qMin(idx, numThumbs-1);
+}
+
+/**
+ * Returns the thumbnail below a widget position.
+ * @param pos the widget position
+ * @return int the thumbnail's index or -1 if there is no thumbnail
+ **/
+int DkFilePreview::thumbIdxAt(const QPoint& pos) const {
+
+	QPointF wp = worldMatrix.inverted().map(QPointF(pos));
+	int idx = thumbIdxAt(orientation == Qt::Horizontal ? (float)wp.x() : (float)wp.y());
+
+	if (idx == -1 || idx >= mThumbs->size() || !thumbRect(idx).contains(wp))
+		return -1;
+
+	return idx;
+}
+
+/**
+ * Updates the thumbnail extents before painting.
+ * The extents are kept in a Fenwick tree: a loaded thumbnail
+ * updates its own extent in O(log n) instead of shifting all offsets after it.
+ **/
+void DkFilePreview::updateThumbOffsets() {
+
+	int numThumbs = mThumbs->size();
+
+	if (mThumbExtents.size() != numThumbs)
+		mThumbOffsetsValid = false;
+
+	int ts = DkSettingsManager::param().effectiveThumbSize(this);
+	int gap = qCeil(xOffset/2.0f);
+
+	if (!mThumbOffsetsValid) {
+
+		mThumbExtents.resize(numThumbs);
+		mExtentTree.fill(0, numThumbs+1);
+
+		for (int idx = 0; idx < numThumbs; idx++) {
+			mThumbExtents[idx] = thumbExtent(idx, ts, gap);
+			mExtentTree[idx+1] += mThumbExtents[idx];
+
+			// build the tree in O(n)
+			int parent = (idx+1) + ((idx+1) & -(idx+1));
+			if (parent <= numThumbs)
+				mExtentTree[parent] += mExtentTree[idx+1];
+		}
+
+		mThumbOffsetsValid = true;
+	}
+	else {
+
+		for (int idx : mDirtyThumbs) {
+
+			if (idx < 0 || idx >= numThumbs)
+				continue;
+
+			int extent = thumbExtent(idx, ts, gap);
+			int delta = extent - mThumbExtents[idx];
+			mThumbExtents[idx] = extent;
+
+			for (int tIdx = idx+1; delta != 0 && tIdx <= numThumbs; tIdx += tIdx & -tIdx)
+				mExtentTree[tIdx] += delta;
+		}
+	}
+
+	mDirtyThumbs.clear();
+}
+
+/**
+ * Returns the space a thumbnail takes along the strip (including the gap).
+ **/
+int DkFilePreview::thumbExtent(int idx, int ts, int gap) const {
+
+	QSizeF s = thumbSize(idx, ts);
+
+	if (s.isEmpty())
+		return 0;
+
+	return qFloor(orientation == Qt::Horizontal ? s.width() : s.height()) + gap;
+}
+
+/**
+ * Returns the start of a thumbnail along the strip in O(log n).
+ * @param idx the thumbnail's index (the number of thumbnails returns the strip's end)
+ **/
+int DkFilePreview::thumbOffset(int idx) const {
+
+	int offset = xOffset;
+
+	for (int tIdx = qMin(idx, mExtentTree.size()-1); tIdx > 0; tIdx -= tIdx & -tIdx)
+		offset += mExtentTree[tIdx];
+
+	return offset;
+}
+
+int DkFilePreview::highestBit(int val) {
+
+	int bit = 1;
+	while (bit <= val/2)
+		bit <<= 1;
+
+	return val > 0 ? bit : 0;
+}
+
+void DkFilePreview::invalidateThumbOffsets() {
+
+	mThumbOffsetsValid = false;
+	mDirtyThumbs.clear();
+}
+
+void DkFilePreview::thumbLoaded() {
+
+	DkThumbNailT* thumb = qobject_cast<DkThumbNailT*>(sender());
+	int idx = thumb ? mThumbs->indexOf(thumb->getFilePath()) : -1;
+
+	// the thumbnail's size is known now - its extent is updated on the next paint
+	if (idx == -1)
+		invalidateThumbOffsets();
+	else if (mThumbOffsetsValid)
+		mDirtyThumbs << idx;
+
+	update();
+}
+
+/**
+ * Returns a scaled copy of a loaded image.
+ * The copy is computed in a thread - a null image is returned until it is ready.
+ * @param imgC the loaded image
+ * @param height the thumbnail size
+ * @return QImage the scaled copy or a null image
+ **/
+QImage DkFilePreview::scaledImage(QSharedPointer<DkImageContainerT> imgC, int height) {
+
+	QImage img = imgC->cachedImageScaledToHeight(height);
+
+	if (img.isNull() && !mScaleWatcher.isRunning()) {
+		mScalingImage = imgC;
+		// scale the displayed image - image() would block on previews and gigapixel images
+		QImage dImg = imgC->displayImage();
+		mScalingKey = dImg.cacheKey();
+		mScaleWatcher.setFuture(QtConcurrent::run(&nmc::DkFilePreview::scaleToHeight, dImg, height));
+	}
+
+	return img;
+}
+
+QImage DkFilePreview::scaleToHeight(const QImage& img, int height) {
+
+	return img.scaledToHeight(height, Qt::SmoothTransformation);
+}
+
+void DkFilePreview::imageScaled() {
+
+	QImage img = mScaleWatcher.result();
+
+	// the image might be edited in the meantime
+	if (mScalingImage && !img.isNull() && mScalingImage->hasImage() && mScalingImage->displayImage().cacheKey() == mScalingKey)
+		mScalingImage->cacheScaledImage(img);
+
+	mScalingImage.clear();
+	update();
 }
 
 void DkFilePreview::drawNoImgEffect(QPainter* painter, const QRectF& r) {
@@ -482,6 +1029,9 @@ void DkFilePreview::resizeEvent(QResizeEvent *event) {
 		moveImageTimer->start();
 	}
 
+	// the thumbnails are scaled to the strip
+	invalidateThumbOffsets();
+
 	// now update...
 	borderTrigger = (orientation == Qt::Horizontal) ? (float)width()*winPercent : (float)height()*winPercent;
 	int borderTriggerI = qRound(borderTrigger);
@@ -559,30 +1109,32 @@ void DkFilePreview::mouseMoveEvent(QMouseEvent *event) {
 	if (dx > borderTrigger*0.5) {
 
 		int oldSelection = selected;
-		selected = -1;
 
 		// find out where the mouse is
-		for (int idx = 0; idx < thumbRects.size(); idx++) {
-
-			if (worldMatrix.mapRect(thumbRects.at(idx)).contains(event->pos())) {
-				selected = idx;
-
-				if (selected <= mThumbs.size() && selected >= 0) {
-					QSharedPointer<DkThumbNailT> thumb = mThumbs.at(selected)->getThumb();
-					//selectedImg = DkImage::colorizePixmap(QPixmap::fromImage(thumb->getImage()), DkSettingsManager::param().display().highlightColor, 0.3f);
-
-					// important: setText shows the label - if you then hide it here again you'll get a stack overflow
-					//if (fileLabel->height() < height())
-					//	fileLabel->setText(thumbs.at(selected).getFile().fileName(), -1);
-					QFileInfo fileInfo(thumb->getFilePath());
-					QString toolTipInfo = tr("Name: ") + fileInfo.fileName() + 
-						"\n" + tr("Size: ") + DkUtils::readableByte((float)fileInfo.size()) + 
-						"\n" + tr("Created: ") + fileInfo.created().toString(Qt::SystemLocaleDate);
-					setToolTip(toolTipInfo);
-					setStatusTip(fileInfo.fileName());
-				}
-				break;
+		selected = thumbIdxAt(event->pos());
+
+		if (selected < mThumbs->size() && selected >= 0) {
+			//selectedImg = DkImage::colorizePixmap(QPixmap::fromImage(thumb->getImage()), DkSettingsManager::param().display().highlightColor, 0.3f);
+
+			// important: setText shows the label - if you then hide it here again you'll get a stack overflow
+			//if (fileLabel->height() < height())
+			//	fileLabel->setText(thumbs.at(selected).getFile().fileName(), -1);
+
+			// the folder index already knows the file attributes
+			QString toolTipInfo = tr("Name: ") + mThumbs->fileName(selected) + 
+				"\n" + tr("Size: ") + DkUtils::readableByte((float)mThumbs->fileSize(selected)) + 
+				"\n" + tr("Created: ") + mThumbs->created(selected).toString(Qt::SystemLocaleDate);
+
+			QStringList alternates = mThumbs->alternates(selected);
+			if (!alternates.empty()) {
+				QStringList alternateNames;
+				for (const QString& filePath : alternates)
+					alternateNames << QFileInfo(filePath).fileName();
+				toolTipInfo += "\n" + tr("Alternates: ") + alternateNames.join(", ");
 			}
+
+			setToolTip(toolTipInfo);
+			setStatusTip(mThumbs->fileName(selected));
 		}
 
 		if (selected != -1 || selected != oldSelection)
@@ -631,14 +1183,13 @@ void DkFilePreview::mouseReleaseEvent(QMouseEvent *event) {
 	if (mouseTrace < 20) {
 
 		// find out where the mouse did click
-		for (int idx = 0; idx < thumbRects.size(); idx++) {
+		int idx = thumbIdxAt(event->pos());
 
-			if (idx < mThumbs.size() && worldMatrix.mapRect(thumbRects.at(idx)).contains(event->pos())) {
-				if (mThumbs.at(idx)->isFromZip()) 
-					emit changeFileSignal(idx - currentFileIdx);
-				else 
-					emit loadFileSignal(mThumbs.at(idx)->filePath());
-			}
+		if (idx != -1) {
+			if (mThumbs->at(idx)->isFromZip()) 
+				emit changeFileSignal(idx - currentFileIdx);
+			else 
+				emit loadFileSignal(mThumbs->filePath(idx));
 		}
 	}
 	else
@@ -664,6 +1215,7 @@ void DkFilePreview::wheelEvent(QWheelEvent *event) {
 
 		if (newSize != DkSettingsManager::param().display().thumbSize) {
 			DkSettingsManager::param().display().thumbSize = newSize;
+			invalidateThumbOffsets();
 			update();
 		}
 	}
@@ -815,14 +1367,7 @@ void DkFilePreview::setFileInfo(QSharedPointer<DkImageContainerT> cImage) {
 	if (!cImage)
 		return;
 
-	int tIdx = -1;
-
-	for (int idx = 0; idx < mThumbs.size(); idx++) {
-		if (mThumbs.at(idx)->filePath() == cImage->filePath()) {
-			tIdx = idx;
-			break;
-		}
-	}
+	int tIdx = mThumbs->indexOf(cImage);
 
 	//// don't know why we needed this statement
 	//// however, if we break here, the file preview
@@ -834,16 +1379,27 @@ void DkFilePreview::setFileInfo(QSharedPointer<DkImageContainerT> cImage) {
 	currentFileIdx = tIdx;
 	if (currentFileIdx >= 0)
 		scrollToCurrentImage = true;
+
+	// loaded images are drawn instead of their thumbnails
+	invalidateThumbOffsets();
 	update();
 
 }
 
-void DkFilePreview::updateThumbs(QVector<QSharedPointer<DkImageContainerT> > thumbs) {
+void DkFilePreview::updateThumbs(QSharedPointer<DkFolderIndex> thumbs) {
+
+	if (!thumbs)
+		thumbs = QSharedPointer<DkFolderIndex>(new DkFolderIndex());
 
 	this->mThumbs = thumbs;
+	invalidateThumbOffsets();
+
+	// only materialized images can be selected
+	for (int idx = 0; idx < thumbs->size(); idx++) {
 
-	for (int idx = 0; idx < thumbs.size(); idx++) {
-		if (thumbs.at(idx)->isSelected()) {
+		QSharedPointer<DkImageContainerT> imgC = thumbs->materialized(idx);
+
+		if (imgC && imgC->isSelected()) {
 			currentFileIdx = idx;
 			break;
 		}
@@ -887,21 +1443,39 @@ DkThumbLabel::DkThumbLabel(QSharedPointer<DkThumbNailT> thumb, QGraphicsItem* pa
 
 DkThumbLabel::~DkThumbLabel() {}
 
-void DkThumbLabel::setThumb(QSharedPointer<DkThumbNailT> thumb) {
+/**
+ * Assigns a thumbnail to the label.
+ * Labels are recycled by the DkThumbScene, so the state of the previous thumbnail is reset.
+ * @param thumb the thumbnail (null if the label is released)
+ * @param thumbIdx the thumbnail's index in the scene's folder
+ **/
+void DkThumbLabel::setThumb(QSharedPointer<DkThumbNailT> thumb, int thumbIdx) {
+
+	if (mThumb) {
+		disconnect(mThumb.data(), SIGNAL(thumbLoadedSignal()), this, SLOT(updateLabel()));
+
+		// nobody needs the thumbnail if it is scrolled out of view
+		if (mFetchingThumb && mThumb->hasImage() == DkThumbNail::loading)
+			mThumb->cancelFetch();
+	}
 
 	this->mThumb = thumb;
+	mThumbIdx = thumbIdx;
+	mThumbInitialized = false;
+	mFetchingThumb = false;
+	mIsHovered = false;
+	setFlag(ItemIsSelectable, true);
+	setToolTip(QString());	// the file is not touched before the label is hovered
 
 	if (thumb.isNull())
 		return;
 
 	connect(thumb.data(), SIGNAL(thumbLoadedSignal()), this, SLOT(updateLabel()));
-	//setStatusTip(thumb->getFile().fileName());
-	QFileInfo fileInfo(thumb->getFilePath());
-	QString toolTipInfo = tr("Name: ") + fileInfo.fileName() + 
-		"\n" + tr("Size: ") + DkUtils::readableByte((float)fileInfo.size()) + 
-		"\n" + tr("Created: ") + fileInfo.created().toString(Qt::SystemLocaleDate);
 
-	setToolTip(toolTipInfo);
+	if (thumb->hasImage() == DkThumbNail::loaded || thumb->hasImage() == DkThumbNail::exists_not) {
+		updateLabel();
+		mThumbInitialized = true;
+	}
 
 	// style dummy
 	mNoImagePen.setColor(QColor(150,150,150));
@@ -914,9 +1488,48 @@ void DkThumbLabel::setThumb(QSharedPointer<DkThumbNailT> thumb) {
 	//selectPen.setWidth(2);
 }
 
-QPixmap DkThumbLabel::pixmap() const {
+int DkThumbLabel::thumbIdx() const {
+
+	return mThumbIdx;
+}
+
+/**
+ * Returns true if the thumbnail is loaded and can be drawn.
+ **/
+bool DkThumbLabel::hasIcon() const {
+
+	return mThumbInitialized && mThumb && !mThumb->getImage().isNull();
+}
+
+/**
+ * Adds the thumbnail to the atlas batch of the scene.
+ * Thumbnails are only uploaded to the atlas if they are not there yet.
+ * If the atlas is full, the thumbnail is painted directly.
+ * @param painter the scene's painter
+ * @param batch the fragments of the current frame
+ **/
+void DkThumbLabel::paintIcon(QPainter* painter, DkThumbAtlas::Batch& batch) const {
+
+	if (!hasIcon())
+		return;
+
+	QRectF r = sceneBoundingRect();
+	int ps = qRound(r.width());
+	bool squared = DkSettingsManager::param().display().displaySquaredThumbs;
+	QImage img = mThumb->getImage(ps, squared ? Qt::KeepAspectRatioByExpanding : Qt::KeepAspectRatio);
+	QString key = squared ? mThumb->getFilePath() + "|square" : mThumb->getFilePath();
+	qint64 version = img.cacheKey();
+
+	DkThumbAtlas& atlas = DkThumbAtlas::instance();
 
-	return mIcon.pixmap();
+	if (atlas.add(batch, key, version, ps, r))
+		return;
+
+	if (squared)
+		img = DkImage::makeSquare(img);
+
+	if (!atlas.insert(batch, key, version, img, ps, r))
+		painter->drawImage(DkThumbAtlas::fitRect(img.size(), r), img);
 }
 
 QRectF DkThumbLabel::boundingRect() const {
@@ -938,31 +1551,12 @@ void DkThumbLabel::updateLabel() {
 	if (mThumb.isNull())
 		return;
 
-	QPixmap pm;
-
-	if (!mThumb->getImage().isNull()) {
-
-		pm = QPixmap::fromImage(mThumb->getImage());
-
-		if (DkSettingsManager::param().display().displaySquaredThumbs) {
-
-			pm = DkImage::makeSquare(pm);
-		}
-	}
-	else
+	if (mThumb->getImage().isNull()) {
 		qDebug() << "update called on empty thumb label!";
-
-	if (!pm.isNull()) {
-		mIcon.setTransformationMode(Qt::SmoothTransformation);
-		mIcon.setPixmap(pm);
-		mIcon.setFlag(ItemIsSelectable, true);
-		//QFlags<enum> f;
-	}
-	if (pm.isNull())
 		setFlag(ItemIsSelectable, false);	// if we cannot load it -> disable selection
+	}
 
 	// update label
-	mText.setPos(0, pm.height());
 	mText.setDefaultTextColor(QColor(255,255,255));
 	//text.setTextWidth(icon.boundingRect().width());
 	QFont font;
@@ -972,30 +1566,14 @@ void DkThumbLabel::updateLabel() {
 	mText.setPlainText(QFileInfo(mThumb->getFilePath()).fileName());
 	mText.hide();
 
-	prepareGeometryChange();
 	updateSize();
 }
 
 void DkThumbLabel::updateSize() {
 
-	if (mIcon.pixmap().isNull())
-		return;
-
+	// the thumbnail is fit to the bounding rect when it is drawn
 	prepareGeometryChange();
-
-	// resize pixmap label
-	int maxSize = qMax(mIcon.pixmap().width(), mIcon.pixmap().height());
-	int ps = DkSettingsManager::param().effectiveThumbPreviewSize();
-
-	if ((float)ps/maxSize != mIcon.scale()) {
-		mIcon.setScale(1.0f);
-		mIcon.setPos(0,0);
-
-		mIcon.setScale((float)ps/maxSize);
-		mIcon.moveBy((ps-mIcon.pixmap().width()*mIcon.scale())*0.5f, (ps-mIcon.pixmap().height()*mIcon.scale())*0.5);
-	}
-
-	//update();
+	update();
 }	
 
 void DkThumbLabel::mouseDoubleClickEvent(QGraphicsSceneMouseEvent *event) {
@@ -1019,8 +1597,55 @@ void DkThumbLabel::mouseDoubleClickEvent(QGraphicsSceneMouseEvent *event) {
 	}
 }
 
+void DkThumbLabel::mousePressEvent(QGraphicsSceneMouseEvent *event) {
+
+	DkThumbScene* thumbScene = qobject_cast<DkThumbScene*>(scene());
+
+	// the scene keeps the selection - labels only exist for visible thumbnails
+	if (!thumbScene || event->button() != Qt::LeftButton || !(flags() & ItemIsSelectable)) {
+		QGraphicsObject::mousePressEvent(event);
+		return;
+	}
+
+	mWasSelected = isSelected();
+
+	if (event->modifiers() & Qt::ControlModifier)
+		thumbScene->selectThumb(mThumbIdx, !mWasSelected);
+	else if (!mWasSelected)
+		thumbScene->selectThumb(mThumbIdx, true, true);
+
+	event->accept();
+}
+
+void DkThumbLabel::mouseReleaseEvent(QGraphicsSceneMouseEvent *event) {
+
+	DkThumbScene* thumbScene = qobject_cast<DkThumbScene*>(scene());
+
+	if (!thumbScene || event->button() != Qt::LeftButton) {
+		QGraphicsObject::mouseReleaseEvent(event);
+		return;
+	}
+
+	// a click on a selection that is not dragged selects this thumbnail only
+	int dist = qRound((event->scenePos() - event->buttonDownScenePos(Qt::LeftButton)).manhattanLength());
+
+	if (mWasSelected && !(event->modifiers() & Qt::ControlModifier) && dist < QApplication::startDragDistance())
+		thumbScene->selectThumb(mThumbIdx, true, true);
+
+	mWasSelected = false;
+}
+
 void DkThumbLabel::hoverEnterEvent(QGraphicsSceneHoverEvent*) {
 
+	if (mThumb && toolTip().isEmpty()) {
+		QFileInfo fileInfo(mThumb->getFilePath());
+		QString toolTipInfo = tr("Name: ") + fileInfo.fileName() + 
+			"\n" + tr("Size: ") + DkUtils::readableByte((float)fileInfo.size()) + 
+			"\n" + tr("Created: ") + fileInfo.created().toString(Qt::SystemLocaleDate);
+
+		setToolTip(toolTipInfo);
+	}
+
 	mIsHovered = true;
 	emit showFileSignal(mThumb->getFilePath());
 	update();
@@ -1033,17 +1658,41 @@ void DkThumbLabel::hoverLeaveEvent(QGraphicsSceneHoverEvent*) {
 	update();
 }
 
+/**
+ * Updates the priority of a pending thumbnail.
+ * @param visibleRect the viewport in scene coordinates
+ * @param keepRect thumbnails outside this rect are cancelled
+ **/
+void DkThumbLabel::prioritizeThumb(const QRectF& visibleRect, const QRectF& keepRect) {
+
+	if (!mThumb || !mFetchingThumb || mThumb->hasImage() != DkThumbNail::loading)
+		return;
+
+	QRectF r = sceneBoundingRect();
+
+	if (!keepRect.intersects(r)) {
+		mThumb->cancelFetch();
+		mFetchingThumb = false;
+	}
+	else if (visibleRect.intersects(r))
+		mThumb->setFetchPriority(DkThumbScheduler::priority_visible);
+	else {
+		// distance to the viewport
+		double dist = r.bottom() < visibleRect.top() ? visibleRect.top() - r.bottom() : r.top() - visibleRect.bottom();
+		mThumb->setFetchPriority(qRound(dist));
+	}
+}
+
 void DkThumbLabel::setVisible(bool visible) {
 
-	mIcon.setVisible(visible);
 	mText.setVisible(visible);
 }
 
 void DkThumbLabel::paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* widget) {
 	
-	if (!mFetchingThumb && mThumb->hasImage() == DkThumbNail::not_loaded && 
-		DkSettingsManager::param().resources().numThumbsLoading < DkSettingsManager::param().resources().maxThumbsLoading*2) {
-			mThumb->fetchThumb();
+	// we are painted - so we are visible
+	if (mThumb->hasImage() == DkThumbNail::not_loaded) {
+			mThumb->fetchThumb(DkThumbNail::do_not_force, QSharedPointer<QByteArray>(), DkThumbScheduler::priority_visible);
 			mFetchingThumb = true;
 	}
 	else if (!mThumbInitialized && (mThumb->hasImage() == DkThumbNail::loaded || mThumb->hasImage() == DkThumbNail::exists_not)) {
@@ -1052,16 +1701,13 @@ void DkThumbLabel::paint(QPainter* painter, const QStyleOptionGraphicsItem* opti
 		return;		// exit - otherwise we get paint errors
 	}
 
-	//if (!pixmap().isNull()) {
-	//	painter->setRenderHint(QPainter::SmoothPixmapTransform);
-	//	painter->drawPixmap(boundingRect(), pixmap(), QRectF(QPoint(), pixmap().size()));
-	//}
-	if (mIcon.pixmap().isNull() && mThumb->hasImage() == DkThumbNail::exists_not) {
+	// the thumbnail itself is drawn by the scene (see DkThumbScene::drawBackground)
+	if (!hasIcon() && mThumb->hasImage() == DkThumbNail::exists_not) {
 		painter->setPen(mNoImagePen);
 		painter->setBrush(mNoImageBrush);
 		painter->drawRect(boundingRect());
 	}
-	else if (mIcon.pixmap().isNull()) {
+	else if (!hasIcon()) {
 		QColor c = DkSettingsManager::param().display().highlightColor;
 		c.setAlpha(30);
 		painter->setPen(mNoImagePen);
@@ -1083,13 +1729,6 @@ void DkThumbLabel::paint(QPainter* painter, const QStyleOptionGraphicsItem* opti
 	//painter->setRenderHints(QPainter::SmoothPixmapTransform | QPainter::Antialiasing);
 
 	QTransform mt = painter->worldTransform();
-	QTransform it = mt;
-	it.translate(mIcon.pos().x(), mIcon.pos().y());
-	it.scale(mIcon.scale(), mIcon.scale());
-
-	painter->setTransform(it);
-	mIcon.paint(painter, &noSelOption, widget);
-	painter->setTransform(mt);
 
 	// draw text
 	if (boundingRect().width() > 50 && DkSettingsManager::param().display().showThumbLabel) {
@@ -1133,7 +1772,7 @@ DkThumbScene::DkThumbScene(QWidget* parent /* = 0 */) : QGraphicsScene(parent) {
 
 void DkThumbScene::updateLayout() {
 
-	if (mThumbLabels.empty())
+	if (mThumbs->empty())
 		return;
 
 	QSize pSize;
@@ -1141,84 +1780,211 @@ void DkThumbScene::updateLayout() {
 	if (!views().empty())
 		pSize = QSize(views().first()->viewport()->size());
 
-    int psz = DkSettingsManager::param().effectiveThumbPreviewSize();
+	int psz = DkSettingsManager::param().effectiveThumbPreviewSize();
 	mXOffset = qCeil(psz*0.1f);
 	mNumCols = qMax(qFloor(((float)pSize.width()-mXOffset)/(psz + mXOffset)), 1);
-	mNumCols = qMin(mThumbLabels.size(), mNumCols);
-	mNumRows = qCeil((float)mThumbLabels.size()/mNumCols);
+	mNumCols = qMin(mThumbs->size(), mNumCols);
+	mNumRows = qCeil((float)mThumbs->size()/mNumCols);
 
 	int tso = psz+mXOffset;
 	setSceneRect(0, 0, mNumCols*tso+mXOffset, mNumRows*tso+mXOffset);
-	//int fileIdx = thumbPool->getCurrentFileIdx();
 
-	DkTimer dt;
-	int cYOffset = mXOffset;
+	// the layout is a grid - so we just move the labels that exist
+	for (QHash<int, DkThumbLabel*>::const_iterator it = mVisibleLabels.constBegin(); it != mVisibleLabels.constEnd(); it++) {
+		it.value()->setPos(thumbRect(it.key()).topLeft());
+		it.value()->updateSize();
+	}
 
-	for (int rIdx = 0; rIdx < mNumRows; rIdx++) {
+	// show the first selected thumbnail
+	for (int idx = 0; idx < mSelected.size(); idx++) {
 
-		int cXOffset = mXOffset;
+		if (mSelected.testBit(idx)) {
+			ensureVisible(idx);
+			break;
+		}
+	}
 
-		for (int cIdx = 0; cIdx < mNumCols; cIdx++) {
+	updateVisibleLabels(visibleSceneRect());
 
-			int tIdx = rIdx*mNumCols+cIdx;
+	mFirstLayout = false;
+}
 
-			if (tIdx < 0 || tIdx >= mThumbLabels.size())
-				break;
+/**
+ * Returns the thumbnail's rect in scene coordinates.
+ * The grid is not stored - it is computed from the current layout.
+ * @param thumbIdx the thumbnail's index in the folder
+ * @return QRectF the thumbnail's rect
+ **/
+QRectF DkThumbScene::thumbRect(int thumbIdx) const {
 
-			DkThumbLabel* cLabel = mThumbLabels.at(tIdx);
-			cLabel->setPos(cXOffset, cYOffset);
-			cLabel->updateSize();
+	if (mNumCols <= 0 || thumbIdx < 0)
+		return QRectF();
 
-			cXOffset += psz + mXOffset;
-		}
+	int psz = DkSettingsManager::param().effectiveThumbPreviewSize();
+	int tso = psz+mXOffset;
+
+	return QRectF(mXOffset + (thumbIdx % mNumCols)*tso, mXOffset + (thumbIdx / mNumCols)*tso, psz, psz);
+}
+
+/**
+ * Draws the thumbnails below the labels.
+ * All thumbnails are blitted from the DkThumbAtlas in one pass per atlas page.
+ * The labels just draw the file name, hover and selection effects on top.
+ * @param painter the view's painter
+ * @param rect the exposed rect in scene coordinates
+ **/
+void DkThumbScene::drawBackground(QPainter* painter, const QRectF& rect) {
+
+	QGraphicsScene::drawBackground(painter, rect);
+
+	DkThumbAtlas::Batch batch;
 
-		// update ypos
-		cYOffset += psz + mXOffset;	// 20 for label 
+	painter->save();
+	painter->setRenderHint(QPainter::SmoothPixmapTransform);
+
+	for (DkThumbLabel* label : mVisibleLabels) {
+
+		if (label->isVisible() && rect.intersects(label->sceneBoundingRect()))
+			label->paintIcon(painter, batch);
 	}
 
-	for (int idx = 0; idx < mThumbLabels.size(); idx++) {
+	DkThumbAtlas::instance().draw(painter, batch);
+	painter->restore();
+}
+
+QRectF DkThumbScene::visibleSceneRect() const {
+
+	if (views().empty())
+		return sceneRect();
+
+	QGraphicsView* view = views().first();
+	return view->mapToScene(view->viewport()->rect()).boundingRect();
+}
+
+/**
+ * Assigns labels to the thumbnails within the visible rows plus a margin
+ * of one viewport. Labels that leave this range are recycled.
+ * @param visibleRect the viewport in scene coordinates
+ **/
+void DkThumbScene::updateVisibleLabels(const QRectF& visibleRect) {
 
-		if (mThumbLabels.at(idx)->isSelected())
-			mThumbLabels.at(idx)->ensureVisible();
+	if (mThumbs->empty() || mNumCols <= 0) {
+		releaseLabels();
+		return;
 	}
 
-	//update();
+	int tso = DkSettingsManager::param().effectiveThumbPreviewSize()+mXOffset;
+	int marginRows = qCeil(visibleRect.height()/tso);
+	int firstRow = qMax(qFloor((visibleRect.top()-mXOffset)/tso) - marginRows, 0);
+	int lastRow = qFloor((visibleRect.bottom()-mXOffset)/tso) + marginRows;
 
-	//if (verticalScrollBar()->isVisible())
-	//	verticalScrollBar()->update();
+	int firstIdx = firstRow*mNumCols;
+	int lastIdx = qMin((lastRow+1)*mNumCols, mThumbs->size())-1;
 
-	mFirstLayout = false;
+	// recycle the labels that left the range
+	for (QHash<int, DkThumbLabel*>::iterator it = mVisibleLabels.begin(); it != mVisibleLabels.end();) {
+
+		if (it.key() < firstIdx || it.key() > lastIdx) {
+			releaseLabel(it.value());
+			it = mVisibleLabels.erase(it);
+		}
+		else
+			it++;
+	}
+
+	blockSignals(true);	// do not emit selection changed while labels are assigned
+	for (int idx = firstIdx; idx <= lastIdx; idx++) {
+
+		if (!mVisibleLabels.contains(idx))
+			mVisibleLabels.insert(idx, createLabel(idx));
+	}
+	blockSignals(false);
+
+	prioritizeThumbs(visibleRect);
 }
 
-void DkThumbScene::updateThumbs(QVector<QSharedPointer<DkImageContainerT> > thumbs) {
+DkThumbLabel* DkThumbScene::createLabel(int thumbIdx) {
 
-	this->mThumbs = thumbs;
-	updateThumbLabels();
+	DkThumbLabel* label = 0;
+
+	if (!mFreeLabels.empty()) {
+		label = mFreeLabels.takeLast();
+	}
+	else {
+		label = new DkThumbLabel();
+		connect(label, SIGNAL(loadFileSignal(const QString&)), this, SLOT(loadFile(const QString&)));
+		connect(label, SIGNAL(showFileSignal(const QString&)), this, SLOT(showFile(const QString&)));
+		addItem(label);
+		mThumbLabels.append(label);
+	}
+
+	QSharedPointer<DkThumbNailT> thumb = mThumbs->at(thumbIdx)->getThumb();
+	connect(thumb.data(), SIGNAL(thumbLoadedSignal()), this, SIGNAL(thumbLoadedSignal()), Qt::UniqueConnection);
+
+	label->setThumb(thumb, thumbIdx);
+	label->setPos(thumbRect(thumbIdx).topLeft());
+	label->updateSize();
+	label->setSelected(mSelected.testBit(thumbIdx));
+	label->show();
+
+	return label;
 }
 
-void DkThumbScene::updateThumbLabels() {
+void DkThumbScene::releaseLabel(DkThumbLabel* label) {
 
-	blockSignals(true);	// do not emit selection changed while clearing!
-	clear();	// deletes the thumbLabels
+	if (label->getThumb())
+		disconnect(label->getThumb().data(), SIGNAL(thumbLoadedSignal()), this, SIGNAL(thumbLoadedSignal()));
+
+	blockSignals(true);
+	label->setSelected(false);
 	blockSignals(false);
 
-	mThumbLabels.clear();
+	label->hide();
+	label->setThumb(QSharedPointer<DkThumbNailT>());
+	mFreeLabels.append(label);
+}
+
+void DkThumbScene::releaseLabels() {
+
+	for (DkThumbLabel* label : mVisibleLabels)
+		releaseLabel(label);
+
+	mVisibleLabels.clear();
+}
+
+void DkThumbScene::updateThumbs(QSharedPointer<DkFolderIndex> thumbs) {
+
+	if (!thumbs)
+		thumbs = QSharedPointer<DkFolderIndex>(new DkFolderIndex());
+
+	// keep the selection if the folder is updated
+	QStringList selectedFiles = getSelectedFiles();
+
+	this->mThumbs = thumbs;
+	mSelected = QBitArray(mThumbs->size());
 
-	for (int idx = 0; idx < mThumbs.size(); idx++) {
-		DkThumbLabel* thumb = new DkThumbLabel(mThumbs.at(idx)->getThumb());
-		connect(thumb, SIGNAL(loadFileSignal(const QString&)), this, SLOT(loadFile(const QString&)));
-		connect(thumb, SIGNAL(showFileSignal(const QString&)), this, SLOT(showFile(const QString&)));
-		connect(mThumbs.at(idx).data(), SIGNAL(thumbLoadedSignal()), this, SIGNAL(thumbLoadedSignal()));
+	for (const QString& filePath : selectedFiles) {
 
-		//thumb->show();
-		addItem(thumb);
-		mThumbLabels.append(thumb);
-		//thumbsNotLoaded.append(thumb);
+		int idx = mThumbs->indexOf(filePath);
+
+		if (idx != -1)
+			mSelected.setBit(idx);
 	}
 
+	updateThumbLabels();
+}
+
+void DkThumbScene::updateThumbLabels() {
+
+	// labels are assigned by the layout
+	releaseLabels();
+
+	if (mSelected.size() != mThumbs->size())
+		mSelected = QBitArray(mThumbs->size());
+
 	showFile();
 
-	if (!mThumbs.empty())
+	if (!mThumbs->empty())
 		updateLayout();
 
 	emit selectionChanged();
@@ -1237,10 +2003,10 @@ void DkThumbScene::connectLoader(QSharedPointer<DkImageLoader> loader, bool conn
 		return;
 
 	if (connectSignals) {
-		connect(loader.data(), SIGNAL(updateDirSignal(QVector<QSharedPointer<DkImageContainerT> >)), this, SLOT(updateThumbs(QVector<QSharedPointer<DkImageContainerT> >)), Qt::UniqueConnection);
+		connect(loader.data(), SIGNAL(updateDirSignal(QSharedPointer<DkFolderIndex>)), this, SLOT(updateThumbs(QSharedPointer<DkFolderIndex>)), Qt::UniqueConnection);
 	}
 	else {
-		disconnect(loader.data(), SIGNAL(updateDirSignal(QVector<QSharedPointer<DkImageContainerT> >)), this, SLOT(updateThumbs(QVector<QSharedPointer<DkImageContainerT> >)));
+		disconnect(loader.data(), SIGNAL(updateDirSignal(QSharedPointer<DkFolderIndex>)), this, SLOT(updateThumbs(QSharedPointer<DkFolderIndex>)));
 	}
 }
 
@@ -1252,7 +2018,7 @@ void DkThumbScene::showFile(const QString& filePath) {
 		if (sf > 1)
 			DkStatusBarManager::instance().setMessage(tr("%1 selected").arg(QString::number(sf)));
 		else
-			DkStatusBarManager::instance().setMessage(tr("%1 images").arg(QString::number(mThumbLabels.size())));
+			DkStatusBarManager::instance().setMessage(tr("%1 images").arg(QString::number(mThumbs->size())));
 	}
 	else
 		DkStatusBarManager::instance().setMessage(QFileInfo(filePath).fileName());
@@ -1264,22 +2030,26 @@ void DkThumbScene::ensureVisible(QSharedPointer<DkImageContainerT> img) const {
 	if (!img)
 		return;
 
-	for (DkThumbLabel* label : mThumbLabels) {
+	ensureVisible(mThumbs->indexOf(img->filePath()));
+}
 
-		if (label->getThumb()->getFilePath() == img->filePath()) {
-			label->ensureVisible();
-			break;
-		}
-	}
+void DkThumbScene::ensureVisible(int thumbIdx) const {
+
+	QRectF r = thumbRect(thumbIdx);
+
+	if (r.isNull())
+		return;
 
+	for (QGraphicsView* view : views())
+		view->ensureVisible(r);
 }
 
 void DkThumbScene::toggleThumbLabels(bool show) {
 
 	DkSettingsManager::param().display().showThumbLabel = show;
 
-	for (int idx = 0; idx < mThumbLabels.size(); idx++)
-		mThumbLabels.at(idx)->updateLabel();
+	for (DkThumbLabel* label : mVisibleLabels)
+		label->updateLabel();
 
 	//// well, that's not too beautiful
 	//if (DkSettingsManager::param().display().displaySquaredThumbs)
@@ -1290,12 +2060,14 @@ void DkThumbScene::toggleSquaredThumbs(bool squares) {
 
 	DkSettingsManager::param().display().displaySquaredThumbs = squares;
 
-	for (int idx = 0; idx < mThumbLabels.size(); idx++)
-		mThumbLabels.at(idx)->updateLabel();
+	for (DkThumbLabel* label : mVisibleLabels)
+		label->updateLabel();
 
 	// well, that's not too beautiful
 	if (DkSettingsManager::param().display().displaySquaredThumbs)
 		updateLayout();
+
+	update();	// the thumbnails are drawn in the background
 }
 
 void DkThumbScene::increaseThumbs() {
@@ -1335,11 +2107,11 @@ void DkThumbScene::selectAllThumbs(bool selected) {
 
 void DkThumbScene::selectThumbs(bool selected /* = true */, int from /* = 0 */, int to /* = -1 */) {
 
-	if (mThumbLabels.empty())
+	if (mSelected.isEmpty())
 		return;
 
 	if (to == -1)
-		to = mThumbLabels.size()-1;
+		to = mSelected.size()-1;
 
 	if (from > to) {
 		int tmp = to;
@@ -1347,15 +2119,51 @@ void DkThumbScene::selectThumbs(bool selected /* = true */, int from /* = 0 */,
 		from = tmp;
 	}
 
-	blockSignals(true);
-	for (int idx = from; idx <= to && idx < mThumbLabels.size(); idx++) {
-		mThumbLabels.at(idx)->setSelected(selected);
-	}
-	blockSignals(false);
+	from = qMax(from, 0);
+	to = qMin(to, mSelected.size()-1);
+
+	if (from <= to)
+		mSelected.fill(selected, from, to+1);
+
+	updateLabelSelection();
 	emit selectionChanged();
 	showFile();	// update selection label
 }
 
+/**
+ * Selects a single thumbnail.
+ * @param thumbIdx the thumbnail's index in the folder
+ * @param select if false, the thumbnail is deselected
+ * @param exclusive if true, all other thumbnails are deselected
+ **/
+void DkThumbScene::selectThumb(int thumbIdx, bool select, bool exclusive) {
+
+	if (thumbIdx < 0 || thumbIdx >= mSelected.size())
+		return;
+
+	if (exclusive)
+		mSelected.fill(false);
+
+	mSelected.setBit(thumbIdx, select);
+
+	updateLabelSelection();
+	emit selectionChanged();
+	showFile();
+}
+
+bool DkThumbScene::isSelected(int thumbIdx) const {
+
+	return thumbIdx >= 0 && thumbIdx < mSelected.size() && mSelected.testBit(thumbIdx);
+}
+
+void DkThumbScene::updateLabelSelection() {
+
+	blockSignals(true);
+	for (QHash<int, DkThumbLabel*>::const_iterator it = mVisibleLabels.constBegin(); it != mVisibleLabels.constEnd(); it++)
+		it.value()->setSelected(mSelected.testBit(it.key()));
+	blockSignals(false);
+}
+
 void DkThumbScene::copySelected() const {
 
 	QStringList fileList = getSelectedFiles();
@@ -1512,21 +2320,25 @@ QStringList DkThumbScene::getSelectedFiles() const {
 
 	QStringList fileList;
 
-	for (int idx = 0; idx < mThumbLabels.size(); idx++) {
+	for (int idx = 0; idx < mSelected.size() && idx < mThumbs->size(); idx++) {
 
-		if (mThumbLabels.at(idx) && mThumbLabels.at(idx)->isSelected()) {
-			fileList.append(mThumbLabels.at(idx)->getThumb()->getFilePath());
-		}
+		if (mSelected.testBit(idx))
+			fileList.append(mThumbs->filePath(idx));
 	}
 
 	return fileList;
 }
 
+/**
+ * Returns the labels of selected thumbnails.
+ * Only thumbnails that are close to the viewport have a label.
+ * @return QVector<DkThumbLabel*> the selected labels
+ **/
 QVector<DkThumbLabel*> DkThumbScene::getSelectedThumbs() const {
 
 	QVector<DkThumbLabel*> selected;
 
-	for (DkThumbLabel* label : mThumbLabels) {
+	for (DkThumbLabel* label : mVisibleLabels) {
 		if (label->isSelected())
 			selected << label;
 	}
@@ -1536,25 +2348,25 @@ QVector<DkThumbLabel*> DkThumbScene::getSelectedThumbs() const {
 
 int DkThumbScene::findThumb(DkThumbLabel* thumb) const {
 
-	int thumbIdx = -1;
+	return thumb ? thumb->thumbIdx() : -1;
+}
 
-	for (int idx = 0; idx < mThumbLabels.size(); idx++) {
-		if (thumb == mThumbLabels.at(idx)) {
-			thumbIdx = idx;
-			break;
-		}
-	}
+/**
+ * Reorders the pending thumbnails by their distance to the viewport.
+ * Thumbnails that are more than one viewport away are cancelled.
+ * @param visibleRect the viewport in scene coordinates
+ **/
+void DkThumbScene::prioritizeThumbs(const QRectF& visibleRect) const {
+
+	QRectF keepRect = visibleRect.adjusted(0, -visibleRect.height(), 0, visibleRect.height());
 
-	return thumbIdx;
+	for (DkThumbLabel* label : mVisibleLabels)
+		label->prioritizeThumb(visibleRect, keepRect);
 }
 
 bool DkThumbScene::allThumbsSelected() const {
 
-	for (DkThumbLabel* label : mThumbLabels)
-		if (label->flags() & QGraphicsItem::ItemIsSelectable && !label->isSelected())
-			return false;
-
-	return true;
+	return !mSelected.isEmpty() && mSelected.count(true) == mSelected.size();
 }
 
 // DkThumbView --------------------------------------------------------------------
@@ -1563,6 +2375,7 @@ DkThumbsView::DkThumbsView(DkThumbScene* scene, QWidget* parent /* = 0 */) : QGr
 	setObjectName("DkThumbsView");
 	this->scene = scene;
 	connect(scene, SIGNAL(thumbLoadedSignal()), this, SLOT(fetchThumbs()));
+	connect(verticalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(updateVisibleThumbs()));
 
 	//setDragMode(QGraphicsView::RubberBandDrag);
 
@@ -1590,6 +2403,14 @@ void DkThumbsView::wheelEvent(QWheelEvent *event) {
 	//QWidget::wheelEvent(event);
 }
 
+void DkThumbsView::resizeEvent(QResizeEvent *event) {
+
+	QGraphicsView::resizeEvent(event);
+
+	// more rows might be visible now
+	updateVisibleThumbs();
+}
+
 void DkThumbsView::mousePressEvent(QMouseEvent *event) {
 
 	if (event->buttons() == Qt::LeftButton) {
@@ -1599,9 +2420,9 @@ void DkThumbsView::mousePressEvent(QMouseEvent *event) {
 	qDebug() << "mouse pressed";
 
 #if QT_VERSION < 0x050000
-	DkThumbLabel* itemClicked = static_cast<DkThumbLabel*>(scene->itemAt(mapToScene(event->pos())));
+	DkThumbLabel* itemClicked = dynamic_cast<DkThumbLabel*>(scene->itemAt(mapToScene(event->pos())));
 #else
-	DkThumbLabel* itemClicked = static_cast<DkThumbLabel*>(scene->itemAt(mapToScene(event->pos()), QTransform()));
+	DkThumbLabel* itemClicked = dynamic_cast<DkThumbLabel*>(scene->itemAt(mapToScene(event->pos()), QTransform()));
 #endif
 
 	// this is a bit of a hack
@@ -1610,6 +2431,10 @@ void DkThumbsView::mousePressEvent(QMouseEvent *event) {
 	// otherwise so we just don't propagate this event
 	if (itemClicked || event->modifiers() == Qt::NoModifier)	
 		QGraphicsView::mousePressEvent(event);
+
+	// the scene only clears the labels - but the selection is kept by the scene
+	if (!itemClicked && event->button() == Qt::LeftButton && event->modifiers() == Qt::NoModifier)
+		scene->selectThumbs(false);
 }
 
 void DkThumbsView::mouseMoveEvent(QMouseEvent *event) {
@@ -1658,9 +2483,9 @@ void DkThumbsView::mouseReleaseEvent(QMouseEvent *event) {
 	QGraphicsView::mouseReleaseEvent(event);
 	
 #if QT_VERSION < 0x050000
-	DkThumbLabel* itemClicked = static_cast<DkThumbLabel*>(scene->itemAt(mapToScene(event->pos())));
+	DkThumbLabel* itemClicked = dynamic_cast<DkThumbLabel*>(scene->itemAt(mapToScene(event->pos())));
 #else
-	DkThumbLabel* itemClicked = static_cast<DkThumbLabel*>(scene->itemAt(mapToScene(event->pos()), QTransform()));
+	DkThumbLabel* itemClicked = dynamic_cast<DkThumbLabel*>(scene->itemAt(mapToScene(event->pos()), QTransform()));
 #endif
 
 	if (lastShiftIdx != -1 && event->modifiers() & Qt::ShiftModifier && itemClicked != 0) {
@@ -1802,6 +2627,11 @@ void DkThumbsView::dropEvent(QDropEvent *event) {
 	qDebug() << "drop event...";
 }
 
+void DkThumbsView::updateVisibleThumbs() {
+
+	scene->updateVisibleLabels(mapToScene(viewport()->rect()).boundingRect());
+}
+
 void DkThumbsView::fetchThumbs() {
 
 	int maxThreads = DkSettingsManager::param().resources().maxThumbsLoading*2;
@@ -1825,7 +2655,7 @@ void DkThumbsView::fetchThumbs() {
 			continue;
 		}
 
-		if (th->pixmap().isNull()) {
+		if (!th->hasIcon()) {
 			th->update();
 			maxThreads--;
 		}
@@ -1939,14 +2769,14 @@ void DkThumbScrollWidget::batchProcessFiles() const {
 	emit batchProcessFilesSignal(fileList);
 }
 
-void DkThumbScrollWidget::updateThumbs(QVector<QSharedPointer<DkImageContainerT> > thumbs) {
+void DkThumbScrollWidget::updateThumbs(QSharedPointer<DkFolderIndex> thumbs) {
 
 	mThumbsScene->updateThumbs(thumbs);
 }
 
 void DkThumbScrollWidget::clear() {
 
-	mThumbsScene->updateThumbs(QVector<QSharedPointer<DkImageContainerT> > ());
+	mThumbsScene->updateThumbs(QSharedPointer<DkFolderIndex>(new DkFolderIndex()));
 }
 
 void DkThumbScrollWidget::setDir(const QString& dirPath) {
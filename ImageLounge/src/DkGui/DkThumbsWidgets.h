@@ -36,10 +36,16 @@
 #include <QPen>
 #include <QGraphicsScene>
 #include <QGraphicsView>
+#include <QBitArray>
+#include <QFutureWatcher>
+#include <QPainter>
+#include <QMap>
 #pragma warning(pop)		// no warnings from includes - end
 
 #include "DkBaseWidgets.h"
 #include "DkImageContainer.h"
+#include "DkFolderIndex.h"
+#include "DkMemoryManager.h"
 
 #ifndef DllCoreExport
 #ifdef DK_CORE_DLL_EXPORT
@@ -61,6 +67,75 @@ namespace nmc {
 // nomacs defines
 class DkImageLoader;
 
+/**
+ * Packs thumbnails into large shared pixmaps (pages).
+ * A page is split into cells of one thumbnail size, so a thumbnail
+ * is uploaded once and all thumbnails of a page are drawn with a single
+ * drawPixmapFragments() call. If the page budget is exhausted, the page
+ * that was drawn least recently is cleared and reused.
+ * The atlas must only be used from the main thread.
+ **/
+class DkThumbAtlas : public QObject, public DkMemoryClient {
+	Q_OBJECT
+
+public:
+	enum {
+		page_size = 2048,	// width & height of a page in px
+		max_pages = 8,
+	};
+
+	typedef QMap<int, QVector<QPainter::PixmapFragment> > Batch;	// page -> fragments
+
+	static DkThumbAtlas& instance();
+
+	bool add(Batch& batch, const QString& key, qint64 version, int cellSize, const QRectF& target);
+	bool insert(Batch& batch, const QString& key, qint64 version, const QImage& img, int cellSize, const QRectF& target);
+	void draw(QPainter* painter, const Batch& batch) const;
+	static QRectF fitRect(const QSizeF& size, const QRectF& target);
+
+	// DkMemoryClient
+	float memoryUsage(int subsystem) const override;
+	float releaseMemory(int subsystem, float mem) override;
+
+public slots:
+	void clear();
+
+protected:
+	DkThumbAtlas();
+	~DkThumbAtlas();
+
+	class DkAtlasPage {
+
+	public:
+		QPixmap pixmap;
+		int cellSize = 0;		// 0 if the page is not used
+		QVector<QString> cells;	// the key of each cell (empty if free)
+		QVector<int> freeCells;
+		quint64 lastUsed = 0;
+	};
+
+	class DkAtlasEntry {
+
+	public:
+		int page = -1;
+		int cell = -1;
+		qint64 version = 0;		// cache key of the thumbnail
+		QSize size;
+	};
+
+	typedef QPair<int, QString> Key;	// cell size, thumbnail key
+
+	int allocateCell(int cellSize, const Batch& batch, int& cell);
+	void initPage(int pageIdx, int cellSize);
+	void evictPage(int pageIdx);
+	QRect cellRect(const DkAtlasPage& page, int cell) const;
+	void addFragment(Batch& batch, const DkAtlasEntry& entry, const QRectF& target);
+
+	QVector<DkAtlasPage> mPages;
+	QHash<Key, DkAtlasEntry> mEntries;
+	quint64 mClock = 0;
+};
+
 class DkFilePreview : public DkWidget {
 	Q_OBJECT
 
@@ -108,9 +183,11 @@ public:
 public slots:
 	void moveImages();
 	void updateFileIdx(int fileIdx);
-	void updateThumbs(QVector<QSharedPointer<DkImageContainerT> > thumbs);
+	void updateThumbs(QSharedPointer<DkFolderIndex> thumbs);
 	void setFileInfo(QSharedPointer<DkImageContainerT> cImage);
 	void newPosition();
+	void thumbLoaded();
+	void imageScaled();
 
 signals:
 	void loadFileSignal(const QString& filePath) const;
@@ -131,7 +208,7 @@ protected:
 	void saveSettings();
 
 private:
-	QVector<QSharedPointer<DkImageContainerT> > mThumbs;
+	QSharedPointer<DkFolderIndex> mThumbs = QSharedPointer<DkFolderIndex>(new DkFolderIndex());
 	QTransform worldMatrix;
 
 	QPoint lastMousePos;
@@ -140,7 +217,16 @@ private:
 	QTimer* moveImageTimer;
 
 	QRectF bufferDim;
-	QVector<QRectF> thumbRects;
+	QVector<int> mThumbExtents;		// space of each thumbnail along the strip
+	QVector<int> mExtentTree;		// Fenwick tree of the extents (size + 1)
+	QVector<int> mDirtyThumbs;		// thumbnails loaded since the last paint
+	bool mThumbOffsetsValid = false;
+	QVector<QSharedPointer<DkThumbNailT> > mFetchedThumbs;	// visible thumbs that we requested
+
+	// scaled copies of loaded images are computed in a thread
+	QFutureWatcher<QImage> mScaleWatcher;
+	QSharedPointer<DkImageContainerT> mScalingImage;
+	qint64 mScalingKey = 0;
 
 	QLinearGradient leftGradient;
 	QLinearGradient rightGradient;
@@ -174,6 +260,17 @@ private:
 	void init();
 	void initOrientations();
 	void drawThumbs(QPainter* painter);
+	void updateThumbOffsets();
+	void invalidateThumbOffsets();
+	int thumbExtent(int idx, int ts, int gap) const;
+	int thumbOffset(int idx) const;
+	static int highestBit(int val);
+	QSizeF thumbSize(int idx, int ts) const;
+	QRectF thumbRect(int idx) const;
+	int thumbIdxAt(float pos) const;
+	int thumbIdxAt(const QPoint& pos) const;
+	QImage scaledImage(QSharedPointer<DkImageContainerT> imgC, int height);
+	static QImage scaleToHeight(const QImage& img, int height);
 	void drawFadeOut(QLinearGradient gradient, QRectF imgRect, QImage *img);
 	void drawSelectedEffect(QPainter* painter, const QRectF& r);
 	void drawCurrentImgEffect(QPainter* painter, const QRectF& r);
@@ -189,13 +286,16 @@ public:
 	DkThumbLabel(QSharedPointer<DkThumbNailT> thumb = QSharedPointer<DkThumbNailT>(), QGraphicsItem* parent = 0);
 	~DkThumbLabel();
 
-	void setThumb(QSharedPointer<DkThumbNailT> thumb);
+	void setThumb(QSharedPointer<DkThumbNailT> thumb, int thumbIdx = -1);
 	QSharedPointer<DkThumbNailT> getThumb() {return mThumb;};
+	int thumbIdx() const;
 	QRectF boundingRect() const;
 	QPainterPath shape() const;
 	void updateSize();
 	void setVisible(bool visible);
-	QPixmap pixmap() const;
+	bool hasIcon() const;
+	void paintIcon(QPainter* painter, DkThumbAtlas::Batch& batch) const;
+	void prioritizeThumb(const QRectF& visibleRect, const QRectF& keepRect);
 
 public slots:
 	void updateLabel();
@@ -206,13 +306,15 @@ signals:
 
 protected:
 	void mouseDoubleClickEvent(QGraphicsSceneMouseEvent *event);
+	void mousePressEvent(QGraphicsSceneMouseEvent *event);
+	void mouseReleaseEvent(QGraphicsSceneMouseEvent *event);
 	void paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget * widget = 0);
 	void hoverEnterEvent(QGraphicsSceneHoverEvent *event);
 	void hoverLeaveEvent(QGraphicsSceneHoverEvent *event);
 
 	QSharedPointer<DkThumbNailT> mThumb;
-	QGraphicsPixmapItem mIcon;
-	QGraphicsTextItem mText;
+	int mThumbIdx = -1;		// index in the scene's folder
+	QGraphicsTextItem mText;	// the thumbnail is drawn by the scene
 	bool mThumbInitialized = false;
 	bool mFetchingThumb = false;
 	QPen mNoImagePen;
@@ -220,6 +322,7 @@ protected:
 	QPen mSelectPen;
 	QBrush mSelectBrush;
 	bool mIsHovered = false;
+	bool mWasSelected = false;	// selected when the mouse was pressed
 	QPointF mLastMove;
 };
 
@@ -236,7 +339,11 @@ public:
 	void copyImages(const QMimeData* mimeData) const;
 	int findThumb(DkThumbLabel* thumb) const;
 	bool allThumbsSelected() const;
+	bool isSelected(int thumbIdx) const;
+	void prioritizeThumbs(const QRectF& visibleRect) const;
+	void updateVisibleLabels(const QRectF& visibleRect);
 	void ensureVisible(QSharedPointer<DkImageContainerT> img) const;
+	QRectF thumbRect(int thumbIdx) const;
 
 public slots:
 	void updateThumbLabels();
@@ -248,8 +355,9 @@ public slots:
 	void resizeThumbs(float dx);
 	void showFile(const QString& filePath = QString());
 	void selectThumbs(bool select = true, int from = 0, int to = -1);
+	void selectThumb(int thumbIdx, bool select = true, bool exclusive = false);
 	void selectAllThumbs(bool select = true);
-	void updateThumbs(QVector<QSharedPointer<DkImageContainerT> > thumbs);
+	void updateThumbs(QSharedPointer<DkFolderIndex> thumbs);
 	void deleteSelected() const;
 	void copySelected() const;
 	void pasteImages() const;
@@ -262,15 +370,26 @@ signals:
 
 protected:
 	void connectLoader(QSharedPointer<DkImageLoader> loader, bool connectSignals = true);
+	void drawBackground(QPainter* painter, const QRectF& rect);
+	QRectF visibleSceneRect() const;
+	void ensureVisible(int thumbIdx) const;
+	void updateLabelSelection();
+	DkThumbLabel* createLabel(int thumbIdx);
+	void releaseLabel(DkThumbLabel* label);
+	void releaseLabels();
 	
 	int mXOffset = 0;
 	int mNumRows = 0;
 	int mNumCols = 0;
 	bool mFirstLayout = true;
 
-	QVector<DkThumbLabel* > mThumbLabels;
+	// only the visible rows (plus a margin) have a label
+	QVector<DkThumbLabel* > mThumbLabels;		// all labels (visible & recycled)
+	QVector<DkThumbLabel* > mFreeLabels;		// hidden labels that can be recycled
+	QHash<int, DkThumbLabel*> mVisibleLabels;	// thumb index -> label
+	QBitArray mSelected;						// selection of the current folder
 	QSharedPointer<DkImageLoader> mLoader;
-	QVector<QSharedPointer<DkImageContainerT> > mThumbs;
+	QSharedPointer<DkFolderIndex> mThumbs = QSharedPointer<DkFolderIndex>(new DkFolderIndex());
 };
 
 class DkThumbsView : public QGraphicsView {
@@ -284,9 +403,11 @@ signals:
 
 public slots:
 	void fetchThumbs();
+	void updateVisibleThumbs();
 
 protected:
 	void wheelEvent(QWheelEvent *event);
+	void resizeEvent(QResizeEvent *event);
 	void dragEnterEvent(QDragEnterEvent *event);
 	void dropEvent(QDropEvent *event);
 	void dragMoveEvent(QDragMoveEvent *event);
@@ -314,7 +435,7 @@ public:
 
 public slots:
 	virtual void setVisible(bool visible);
-	void updateThumbs(QVector<QSharedPointer<DkImageContainerT> > thumbs);
+	void updateThumbs(QSharedPointer<DkFolderIndex> thumbs);
 	void setDir(const QString& dirPath);
 	void enableSelectionActions();
 	void setFilterFocus() const;
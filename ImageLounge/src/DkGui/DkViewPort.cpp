@@ -57,6 +57,8 @@
 #include <QSvgRenderer>
 #include <QMenu>
 #include <QtConcurrentRun>
+#include <QProgressDialog>
+#include <QEventLoop>
 
 #include <qmath.h>
 #pragma warning(pop)		// no warnings from includes - end
@@ -125,6 +127,7 @@ DkViewPort::DkViewPort(QWidget *parent, Qt::WindowFlags flags) : DkBaseViewPort(
 
 	connect(this, SIGNAL(enableNoImageSignal(bool)), mController, SLOT(imageLoaded(bool)));
 	connect(&mImgStorage, SIGNAL(infoSignal(const QString&)), this, SIGNAL(infoSignal(const QString&)));
+	connect(&mImgStorage, SIGNAL(imageUpdated()), this, SLOT(pyramidUpdated()));
 
 	connect(am.pluginActionManager(), SIGNAL(runPlugin(DkPluginContainer*, const QString&)), this, SLOT(applyPlugin(DkPluginContainer*, const QString&)));
 
@@ -222,7 +225,7 @@ void DkViewPort::updateImage(QSharedPointer<DkImageContainerT> image, bool loade
 		return;
 
 	if (mLoader->hasImage()) {
-		setImage(mLoader->getImage());
+		setImage(mLoader->getCurrentImage()->displayImage());
 	}
 }
 
@@ -250,7 +253,7 @@ void DkViewPort::loadImage(QSharedPointer<DkImageContainerT> img) {
 
 		if (img->hasImage()) {
 			mLoader->setCurrentImage(img);
-			setImage(img->image());
+			setImage(img->displayImage());
 		}
 		mLoader->load(img);
 	}
@@ -273,6 +276,13 @@ void DkViewPort::setImage(QImage newImg) {
 
 	mImgStorage.setImage(newImg);
 
+	// gigapixel images are rendered tile-wise if we zoom in
+	QSharedPointer<DkTiledImage> tiledImage;
+	QSharedPointer<DkImageContainerT> imgC = mLoader->getCurrentImage();
+	if (imgC && imgC->hasImage())
+		tiledImage = imgC->getLoader()->tiledImage();
+	setTiledImage(tiledImage && tiledImage->previewSize() == newImg.size() ? tiledImage : QSharedPointer<DkTiledImage>());
+
 	if (mLoader->hasMovie() && !mLoader->isEdited())
 		loadMovie();
 	if (mLoader->hasSvg() && !mLoader->isEdited())
@@ -301,7 +311,7 @@ void DkViewPort::setImage(QImage newImg) {
 	}
 
 	mController->getPlayer()->startTimer();
-	mController->getOverview()->setImage(newImg);	// TODO: maybe we could make use of the image pyramid here
+	mController->getOverview()->setImage(newImg);
 	mController->stopLabels();
 
 	mOldImgRect = mImgRect;
@@ -327,18 +337,49 @@ void DkViewPort::setImage(QImage newImg) {
 	update();
 
 	// draw a histogram from the image -> does nothing if the histogram is invisible
-	if (mController->getHistogram()) 
-		mController->getHistogram()->drawHistogram(newImg);
+	// large images are drawn as soon as the pyramid level exists
+	QImage hImg = mImgStorage.image(QSize(DkHistogram::max_image_size, DkHistogram::max_image_size));
+	if (mController->getHistogram() && qMax(hImg.width(), hImg.height()) <= 2*DkHistogram::max_image_size)
+		mController->getHistogram()->drawHistogram(hImg);
 	if (DkSettingsManager::param().sync().syncMode == DkSettings::sync_mode_remote_display)
 		tcpSendImage(true);
 
 	emit newImageSignal(&newImg);
-	emit zoomSignal((float)(mWorldMatrix.m11()*mImgMatrix.m11()*100));
+	emit zoomSignal((float)(mWorldMatrix.m11()*mImgMatrix.m11()/tileScale()*100));
 
 	// status info
-	DkStatusBarManager::instance().setMessage(QString::number(qRound((float)(mWorldMatrix.m11()*mImgMatrix.m11() * 100))) + "%", DkStatusBar::status_zoom_info);
+	QSize imgSize = mTiledImage ? mTiledImage->size() : newImg.size();
+	DkStatusBarManager::instance().setMessage(QString::number(qRound((float)(mWorldMatrix.m11()*mImgMatrix.m11()/tileScale() * 100))) + "%", DkStatusBar::status_zoom_info);
 	DkStatusBarManager::instance().setMessage(DkUtils::formatToString(newImg.format()), DkStatusBar::status_format_info);
-	DkStatusBarManager::instance().setMessage(QString::number(newImg.width()) + " x " + QString::number(newImg.height()), DkStatusBar::status_dimension_info);
+	DkStatusBarManager::instance().setMessage(QString::number(imgSize.width()) + " x " + QString::number(imgSize.height()), DkStatusBar::status_dimension_info);
+}
+
+/**
+ * A new pyramid level is available.
+ * The overview, the histogram and the thumbnail use
+ * pyramid levels rather than the full resolution image.
+ **/
+void DkViewPort::pyramidUpdated() {
+
+	QImage img = mImgStorage.image(mController->getOverview()->maximumSize()*2);
+	if (img.size() != mImgStorage.getImageConst().size())
+		mController->getOverview()->setPreview(img);
+
+	// the histogram does not need more than max_image_size
+	QImage hImg = mImgStorage.image(QSize(DkHistogram::max_image_size, DkHistogram::max_image_size));
+	if (mController->getHistogram() && hImg.size() != mImgStorage.getImageConst().size() && 
+		qMax(hImg.width(), hImg.height()) <= 2*DkHistogram::max_image_size)
+		mController->getHistogram()->drawHistogram(hImg);
+
+	QSharedPointer<DkImageContainerT> imgC = mLoader ? mLoader->getCurrentImage() : QSharedPointer<DkImageContainerT>();
+	int ts = qRound(max_thumb_size * DkSettingsManager::param().dPIScaleFactor());
+	if (imgC && imgC->getThumb()->hasImage() == DkThumbNail::not_loaded) {
+		QImage tImg = mImgStorage.image(QSize(ts*2, ts*2));
+		if (qMax(tImg.width(), tImg.height()) <= 4*ts)
+			imgC->getThumb()->setImage(tImg);
+	}
+
+	DkMemoryManager::instance().balance();
 }
 
 void DkViewPort::setThumbImage(QImage newImg) {
@@ -425,7 +466,7 @@ void DkViewPort::zoom(float factor, QPointF center) {
 
 
 	//limit zoom in ---
-	if (mWorldMatrix.m11()*mImgMatrix.m11() > mMaxZoom && factor > 1)
+	if (mWorldMatrix.m11()*mImgMatrix.m11() > mMaxZoom*tileScale() && factor > 1)
 		return;
 
 	bool blackBorder = false;
@@ -463,14 +504,14 @@ void DkViewPort::zoom(float factor, QPointF center) {
 
 	tcpSynchronize();
 
-	emit zoomSignal((float)(mWorldMatrix.m11()*mImgMatrix.m11()*100));
-	DkStatusBarManager::instance().setMessage(QString::number(qRound((float)(mWorldMatrix.m11()*mImgMatrix.m11() * 100))) + "%", DkStatusBar::status_zoom_info);
+	emit zoomSignal((float)(mWorldMatrix.m11()*mImgMatrix.m11()/tileScale()*100));
+	DkStatusBarManager::instance().setMessage(QString::number(qRound((float)(mWorldMatrix.m11()*mImgMatrix.m11()/tileScale() * 100))) + "%", DkStatusBar::status_zoom_info);
 }
 
 void DkViewPort::zoomTo(float zoomLevel, const QPoint&) {
 
 	mWorldMatrix.reset();
-	zoom(zoomLevel/(float)mImgMatrix.m11());
+	zoom(zoomLevel*(float)tileScale()/(float)mImgMatrix.m11());
 }
 
 void DkViewPort::resetView() {
@@ -506,7 +547,7 @@ void DkViewPort::fullView() {
 void DkViewPort::showZoom() {
 
 	QString zoomStr;
-	zoomStr.sprintf("%.1f%%", mImgMatrix.m11()*mWorldMatrix.m11()*100);
+	zoomStr.sprintf("%.1f%%", mImgMatrix.m11()*mWorldMatrix.m11()/tileScale()*100);
 	
 	if (!mController->getZoomWidget()->isVisible())
 		mController->setInfo(zoomStr, 3000, DkControlWidget::bottom_left_label);
@@ -689,14 +730,14 @@ void DkViewPort::saveFileAs(bool silent) {
 
 	if (mLoader) {
 		mController->closePlugin(false);
-		mLoader->saveUserFileAs(getImage(), silent);
+		mLoader->saveUserFileAs(getFullImage(), silent);
 	}
 }
 
 void DkViewPort::saveFileWeb() {
 	if (mLoader) {
 		mController->closePlugin(false);
-		mLoader->saveFileWeb(getImage());
+		mLoader->saveFileWeb(getFullImage());
 	}
 }
 
@@ -741,15 +782,14 @@ void DkViewPort::applyManipulator() {
 	if (mplExt && imageContainer()) {
 
 		auto l = imageContainer()->getLoader();
-		l->setMinHistorySize(3);	// increase the min history size to 3 for correctly popping back
 		if (l->lastEdit().editName() == mplExt->name()) {
 			imageContainer()->undo();
 		}
 		
-		img = imageContainer()->image();
+		img = imageContainer()->isTiled() ? getFullImage() : imageContainer()->image();
 	}
 	else
-		img = getImage();
+		img = getFullImage();
 
 	mManipulatorWatcher.setFuture(
 		QtConcurrent::run(
@@ -1352,7 +1392,7 @@ QMimeData * DkViewPort::createMime() const {
 	if (QFileInfo(mLoader->filePath()).exists() && !mLoader->isEdited())
 		mimeData->setUrls(urls);
 	else if (!getImage().isNull())
-		mimeData->setImageData(getImage());
+		mimeData->setImageData(getFullImage());
 
 	mimeData->setText(mLoader->filePath());
 	return mimeData;
@@ -1368,7 +1408,7 @@ void DkViewPort::copyImageBuffer() {
 	QMimeData* mimeData = new QMimeData;
 
 	if (!getImage().isNull())
-		mimeData->setImageData(getImage());
+		mimeData->setImageData(getFullImage());
 
 	QClipboard* clipboard = QApplication::clipboard();
 	clipboard->setMimeData(mimeData);
@@ -1411,7 +1451,7 @@ void DkViewPort::rotateCW() {
 		return;
 
 
-	if (mLoader != 0)
+	if (mLoader != 0 && loadFullImage())
 		mLoader->rotateImage(90);
 
 }
@@ -1421,7 +1461,7 @@ void DkViewPort::rotateCCW() {
 	if (!mController->applyPluginChanges(true))
 		return;
 
-	if (mLoader != 0)
+	if (mLoader != 0 && loadFullImage())
 		mLoader->rotateImage(-90);
 
 }
@@ -1431,7 +1471,7 @@ void DkViewPort::rotate180() {
 	if (!mController->applyPluginChanges(true))
 		return;
 
-	if (mLoader != 0)
+	if (mLoader != 0 && loadFullImage())
 		mLoader->rotateImage(180);
 
 }
@@ -1641,7 +1681,7 @@ void DkViewPort::loadFileFast(int skipIdx) {
 		int sIdx = skipIdx;
 		QSharedPointer<DkImageContainerT> lastImg;
 
-		for (int idx = 0; idx < mLoader->getImages().size(); idx++) {
+		for (int idx = 0; idx < mLoader->numFiles(); idx++) {
 
 			QSharedPointer<DkImageContainerT> imgC = mLoader->getSkippedImage(sIdx);
 
@@ -1763,6 +1803,76 @@ void DkViewPort::tcpLoadFile(qint16 idx, QString filename) {
 	//DkSettingsManager::param().sync().syncMode = oldMode;
 }
 
+/**
+ * Returns the image in full resolution.
+ * Gigapixel images and images that are still loading just display
+ * a preview - so the full image is decoded (or waited for) before
+ * it is edited, saved or copied.
+ * @return QImage the image
+ **/
+QImage DkViewPort::getFullImage() const {
+
+	QSharedPointer<DkImageContainerT> imgC = imageContainer();
+
+	if (imgC && imgC->isTiled())
+		return decodeFullImage(imgC);
+	else if (imgC && imgC->showsPreview())
+		return imgC->image();
+
+	return getImage();
+}
+
+/**
+ * Decodes a gigapixel image in full resolution.
+ * The image is decoded in a thread while a progress dialog is shown.
+ * @param imgC the tiled image
+ * @return QImage the image in full resolution or a null image if it could not be decoded
+ **/
+QImage DkViewPort::decodeFullImage(QSharedPointer<DkImageContainerT> imgC) const {
+
+	QProgressDialog progress(tr("Decoding %1 in full resolution...").arg(imgC->fileName()), QString(), 0, 0, window());
+	progress.setWindowModality(Qt::WindowModal);
+	progress.setMinimumDuration(0);
+	progress.show();
+
+	QFutureWatcher<QImage> watcher;
+	QEventLoop loop;
+	connect(&watcher, SIGNAL(finished()), &loop, SLOT(quit()));
+	watcher.setFuture(QtConcurrent::run(&nmc::DkImageContainer::loadFullImageIntern, imgC->filePath(), imgC->getFileBuffer()));
+
+	if (!watcher.isFinished())
+		loop.exec();
+
+	QImage img = watcher.result();
+
+	if (img.isNull())
+		mController->setInfo(tr("Sorry, I could not decode %1 in full resolution.").arg(imgC->fileName()));
+
+	return img;
+}
+
+/**
+ * Replaces the tiled preview of gigapixel images with the full resolution.
+ * This is needed before the image is edited.
+ * @return bool false if the image could not be decoded
+ **/
+bool DkViewPort::loadFullImage() {
+
+	QSharedPointer<DkImageContainerT> imgC = imageContainer();
+
+	if (!imgC || !imgC->isTiled())
+		return true;
+
+	QImage img = decodeFullImage(imgC);
+
+	if (img.isNull())
+		return false;
+
+	imgC->getLoader()->setFullImage(img);
+
+	return true;
+}
+
 QSharedPointer<DkImageContainerT> DkViewPort::imageContainer() const {
 
 	if (!mLoader)
@@ -1789,7 +1899,7 @@ void DkViewPort::connectLoader(QSharedPointer<DkImageLoader> loader, bool connec
 		//connect(mLoader.data(), SIGNAL(imageLoadedSignal(QSharedPointer<DkImageContainerT>, bool)), this, SLOT(updateImage(QSharedPointer<DkImageContainerT>, bool)), Qt::UniqueConnection);
 		connect(loader.data(), SIGNAL(imageUpdatedSignal(QSharedPointer<DkImageContainerT>)), this, SLOT(updateImage(QSharedPointer<DkImageContainerT>)), Qt::UniqueConnection);
 
-		connect(loader.data(), SIGNAL(updateDirSignal(QVector<QSharedPointer<DkImageContainerT> >)), mController->getFilePreview(), SLOT(updateThumbs(QVector<QSharedPointer<DkImageContainerT> >)), Qt::UniqueConnection);
+		connect(loader.data(), SIGNAL(updateDirSignal(QSharedPointer<DkFolderIndex>)), mController->getFilePreview(), SLOT(updateThumbs(QSharedPointer<DkFolderIndex>)), Qt::UniqueConnection);
 		connect(loader.data(), SIGNAL(imageUpdatedSignal(QSharedPointer<DkImageContainerT>)), mController->getFilePreview(), SLOT(setFileInfo(QSharedPointer<DkImageContainerT>)), Qt::UniqueConnection);
 		connect(loader.data(), SIGNAL(imageUpdatedSignal(QSharedPointer<DkImageContainerT>)), mController->getMetaDataWidget(), SLOT(updateMetaData(QSharedPointer<DkImageContainerT>)), Qt::UniqueConnection);
 		connect(loader.data(), SIGNAL(imageUpdatedSignal(QSharedPointer<DkImageContainerT>)), mController, SLOT(updateImage(QSharedPointer<DkImageContainerT>)), Qt::UniqueConnection);
@@ -1797,8 +1907,9 @@ void DkViewPort::connectLoader(QSharedPointer<DkImageLoader> loader, bool connec
 		connect(loader.data(), SIGNAL(showInfoSignal(const QString&, int, int)), mController, SLOT(setInfo(const QString&, int, int)), Qt::UniqueConnection);
 
 		connect(loader.data(), SIGNAL(setPlayer(bool)), mController->getPlayer(), SLOT(play(bool)), Qt::UniqueConnection);
+		connect(mController->getPlayer(), SIGNAL(playSignal(bool)), loader.data(), SLOT(setSlideshow(bool)), Qt::UniqueConnection);
 
-		connect(loader.data(), SIGNAL(updateDirSignal(QVector<QSharedPointer<DkImageContainerT> >)), mController->getScroller(), SLOT(updateDir(QVector<QSharedPointer<DkImageContainerT> >)), Qt::UniqueConnection);
+		connect(loader.data(), SIGNAL(updateDirSignal(QSharedPointer<DkFolderIndex>)), mController->getScroller(), SLOT(updateDir(QSharedPointer<DkFolderIndex>)), Qt::UniqueConnection);
 		connect(loader.data(), SIGNAL(imageUpdatedSignal(int)), mController->getScroller(), SLOT(updateFile(int)), Qt::UniqueConnection);
 		connect(mController->getScroller(), SIGNAL(valueChanged(int)), loader.data(), SLOT(loadFileAt(int)));
 
@@ -1808,7 +1919,7 @@ void DkViewPort::connectLoader(QSharedPointer<DkImageLoader> loader, bool connec
 		//connect(mLoader.data(), SIGNAL(imageLoadedSignal(QSharedPointer<DkImageContainerT>, bool)), this, SLOT(updateImage(QSharedPointer<DkImageContainerT>, bool)), Qt::UniqueConnection);
 		disconnect(loader.data(), SIGNAL(imageUpdatedSignal(QSharedPointer<DkImageContainerT>)), this, SLOT(updateImage(QSharedPointer<DkImageContainerT>)));
 
-		disconnect(loader.data(), SIGNAL(updateDirSignal(QVector<QSharedPointer<DkImageContainerT> >)), mController->getFilePreview(), SLOT(updateThumbs(QVector<QSharedPointer<DkImageContainerT> >)));
+		disconnect(loader.data(), SIGNAL(updateDirSignal(QSharedPointer<DkFolderIndex>)), mController->getFilePreview(), SLOT(updateThumbs(QSharedPointer<DkFolderIndex>)));
 		disconnect(loader.data(), SIGNAL(imageUpdatedSignal(QSharedPointer<DkImageContainerT>)), mController->getFilePreview(), SLOT(setFileInfo(QSharedPointer<DkImageContainerT>)));
 		disconnect(loader.data(), SIGNAL(imageUpdatedSignal(QSharedPointer<DkImageContainerT>)), mController->getMetaDataWidget(), SLOT(updateMetaData(QSharedPointer<DkImageContainerT>)));
 		disconnect(loader.data(), SIGNAL(imageUpdatedSignal(QSharedPointer<DkImageContainerT>)), mController, SLOT(setFileInfo(QSharedPointer<DkImageContainerT>)));
@@ -1817,8 +1928,9 @@ void DkViewPort::connectLoader(QSharedPointer<DkImageLoader> loader, bool connec
 		disconnect(loader.data(), SIGNAL(updateSpinnerSignalDelayed(bool, int)), mController, SLOT(setSpinnerDelayed(bool, int)));
 
 		disconnect(loader.data(), SIGNAL(setPlayer(bool)), mController->getPlayer(), SLOT(play(bool)));
+		disconnect(mController->getPlayer(), SIGNAL(playSignal(bool)), loader.data(), SLOT(setSlideshow(bool)));
 
-		disconnect(loader.data(), SIGNAL(updateDirSignal(QVector<QSharedPointer<DkImageContainerT> >)), mController->getScroller(), SLOT(updateDir(QVector<QSharedPointer<DkImageContainerT> >)));
+		disconnect(loader.data(), SIGNAL(updateDirSignal(QSharedPointer<DkFolderIndex>)), mController->getScroller(), SLOT(updateDir(QSharedPointer<DkFolderIndex>)));
 		disconnect(loader.data(), SIGNAL(imageUpdatedSignal(QSharedPointer<DkImageContainerT>)), mController->getScroller(), SLOT(updateFile(QSharedPointer<DkImageContainerT>)));
 		
 		// not sure if this is elegant?!
@@ -1841,7 +1953,17 @@ void DkViewPort::cropImage(const DkRotatingRect& rect, const QColor& bgCol, bool
 		return;
 	}
 	
-	imgC->cropImage(rect, bgCol, cropToMetaData);
+	// gigapixel images: the rect refers to the preview
+	DkRotatingRect r = rect;
+	if (mTiledImage) {
+		QPolygonF poly = QTransform::fromScale(tileScale(), tileScale()).map(rect.getPoly());
+		r.setPoly(poly);
+	}
+
+	if (!cropToMetaData && !loadFullImage())
+		return;
+
+	imgC->cropImage(r, bgCol, cropToMetaData);
 	setEditedImage(imgC);
 }
 
@@ -1903,7 +2025,7 @@ void DkViewPortFrameless::zoom(float factor, QPointF center) {
 	}
 
 	//limit zoom in ---
-	if (mWorldMatrix.m11()*mImgMatrix.m11() > mMaxZoom && factor > 1)
+	if (mWorldMatrix.m11()*mImgMatrix.m11() > mMaxZoom*tileScale() && factor > 1)
 		return;
 
 	QRectF viewRect = mWorldMatrix.mapRect(mImgViewRect);
@@ -1939,7 +2061,7 @@ void DkViewPortFrameless::zoom(float factor, QPointF center) {
 	update();
 
 	tcpSynchronize();
-	emit zoomSignal((float)(mWorldMatrix.m11()*mImgMatrix.m11()*100));
+	emit zoomSignal((float)(mWorldMatrix.m11()*mImgMatrix.m11()/tileScale()*100));
 }
 
 void DkViewPortFrameless::resetView() {
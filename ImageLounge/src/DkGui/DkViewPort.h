@@ -101,6 +101,7 @@ public:
 
 	// getter
 	QSharedPointer<DkImageContainerT> imageContainer() const;
+	QImage getFullImage() const;
 	void setImageLoader(QSharedPointer<DkImageLoader> newLoader);
 	DkControlWidget* getController();
 	bool isTestLoaded() { return mTestLoaded; };
@@ -187,6 +188,7 @@ public slots:
 	virtual void setEditedImage(QSharedPointer<DkImageContainerT> img);
 	virtual void setImage(QImage newImg);
 	virtual void setThumbImage(QImage newImg);
+	void pyramidUpdated();
 
 	void settingsChanged();
 	void pauseMovie(bool paused);
@@ -254,6 +256,8 @@ protected:
 	void showZoom();
 	void toggleLena(bool fullscreen);
 	void getPixelInfo(const QPoint& pos);
+	QImage decodeFullImage(QSharedPointer<DkImageContainerT> imgC) const;
+	bool loadFullImage();
 
 };
 
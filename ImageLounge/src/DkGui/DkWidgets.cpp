@@ -137,9 +137,9 @@ bool DkFolderScrollBar::getCurrentDisplaySetting() {
 	return mDisplaySettingsBits->testBit(DkSettingsManager::param().app().currentAppMode);
 }
 
-void DkFolderScrollBar::updateDir(QVector<QSharedPointer<DkImageContainerT> > images) {
+void DkFolderScrollBar::updateDir(QSharedPointer<DkFolderIndex> images) {
 
-	setMaximum(images.size()-1);
+	setMaximum(images ? images->size()-1 : -1);
 }
 
 void DkFolderScrollBar::updateFile(int idx) {
@@ -282,19 +282,19 @@ DkThumbsSaver::DkThumbsSaver(QWidget* parent) : DkWidget(parent) {
 	mNumSaved = 0;
 }
 
-void DkThumbsSaver::processDir(QVector<QSharedPointer<DkImageContainerT> > images, bool forceSave) {
+void DkThumbsSaver::processDir(QSharedPointer<DkFolderIndex> images, bool forceSave) {
 
-	if (images.empty())
+	if (!images || images->empty())
 		return;
 
 	mStop = false;
 	mCLoadIdx = 0;
 	mNumSaved = 0;
 
-	mPd = new QProgressDialog(tr("\nCreating thumbnails...\n") + images.first()->filePath(), 
+	mPd = new QProgressDialog(tr("\nCreating thumbnails...\n") + images->filePath(0), 
 		tr("Cancel"), 
 		0, 
-		(int)images.size(), 
+		images->size(), 
 		DkUtils::getMainWindow());
 	mPd->setWindowTitle(tr("Thumbnails"));
 
@@ -316,7 +316,7 @@ void DkThumbsSaver::thumbLoaded(bool) {
 	mNumSaved++;
 	emit numFilesSignal(mNumSaved);
 
-	if (mNumSaved == mImages.size() || mStop) {
+	if (mNumSaved == mImages->size() || mStop) {
 		if (mPd) {
 			mPd->close();
 			mPd->deleteLater();
@@ -340,10 +340,11 @@ void DkThumbsSaver::loadNext() {
 	qDebug() << "missing: " << missing << " num loading: " << numLoading;
 	qDebug() << "loading bounds: " << mCLoadIdx << " - " << numLoading;
 
-	for (int idx = mCLoadIdx; idx < mImages.size() && idx < numLoading; idx++) {
+	for (int idx = mCLoadIdx; idx < mImages->size() && idx < numLoading; idx++) {
 		mCLoadIdx++;
-		connect(mImages.at(idx)->getThumb().data(), SIGNAL(thumbLoadedSignal(bool)), this, SLOT(thumbLoaded(bool)));
-		mImages.at(idx)->getThumb()->fetchThumb(force);
+		QSharedPointer<DkThumbNailT> thumb = mImages->at(idx)->getThumb();
+		connect(thumb.data(), SIGNAL(thumbLoadedSignal(bool)), this, SLOT(thumbLoaded(bool)));
+		thumb->fetchThumb(force);
 	}
 }
 
@@ -745,7 +746,8 @@ void DkOverview::resizeImg() {
 	//	return;
 
 	// fast downscaling
-	imgT = mImg.scaled(maximumWidth()*2, maximumHeight()*2, Qt::KeepAspectRatio, Qt::FastTransformation);
+	const QImage& img = mPreview.isNull() ? mImg : mPreview;
+	imgT = img.scaled(maximumWidth()*2, maximumHeight()*2, Qt::KeepAspectRatio, Qt::FastTransformation);
 	imgT = imgT.scaled(maximumWidth(), maximumHeight(), Qt::KeepAspectRatio, Qt::SmoothTransformation);
 }
 
@@ -1345,6 +1347,8 @@ void DkPlayer::play(bool play) {
 	}
 	else
 		displayTimer->stop();
+
+	emit playSignal(play);
 }
 
 void DkPlayer::togglePlay() {
@@ -2436,7 +2440,7 @@ void DkImageLabel::thumbLoaded() {
 		return;
 	}
 	
-	QPixmap pm = QPixmap::fromImage(thumb->getImage());
+	QPixmap pm = QPixmap::fromImage(thumb->getImage(mThumbSize, Qt::KeepAspectRatioByExpanding));
 
 	QRect r(QPoint(), pm.size());
 
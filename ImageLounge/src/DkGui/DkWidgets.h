@@ -46,6 +46,7 @@
 #include "DkMath.h"
 #include "DkBaseWidgets.h"
 #include "DkImageContainer.h"
+#include "DkFolderIndex.h"
 
 // Qt defines
 class QColorDialog;
@@ -240,6 +241,7 @@ public:
 signals:
 	void nextSignal();
 	void previousSignal();
+	void playSignal(bool play) const;
 
 public slots:
 	void play(bool play);
@@ -284,7 +286,7 @@ public:
 	bool getCurrentDisplaySetting();
 
 public slots:
-	void updateDir(QVector<QSharedPointer<DkImageContainerT> > images);
+	void updateDir(QSharedPointer<DkFolderIndex> images);
 
 	virtual void show(bool saveSettings = true);
 	virtual void hide(bool saveSettings = true);
@@ -324,7 +326,7 @@ class DkThumbsSaver : public DkWidget {
 public:
 	DkThumbsSaver(QWidget* parent = 0);
 
-	void processDir(QVector<QSharedPointer<DkImageContainerT> > images, bool forceSave);
+	void processDir(QSharedPointer<DkFolderIndex> images, bool forceSave);
 
 signals:
 	void numFilesSignal(int currentFileIdx);
@@ -342,7 +344,7 @@ protected:
 	bool mStop = false;
 	bool mForceSave = false;
 	int mNumSaved = false;
-	QVector<QSharedPointer<DkImageContainerT> > mImages;
+	QSharedPointer<DkFolderIndex> mImages;
 };
 
 class DkFileSystemModel : public QFileSystemModel {
@@ -412,6 +414,19 @@ public:
 
 	void setImage(const QImage& img) {
 		mImg = img;
+		mPreview = QImage();
+
+		if (isVisible())
+			resizeImg();
+	};
+
+	/**
+	 * Sets a down-sampled version of the image (e.g. a pyramid level).
+	 * It is used instead of the image to create the overview.
+	 * @param preview the down-sampled image
+	 **/
+	void setPreview(const QImage& preview) {
+		mPreview = preview;
 
 		if (isVisible())
 			resizeImg();
@@ -440,6 +455,7 @@ signals:
 
 protected:
 	QImage mImg;
+	QImage mPreview;
 	QImage imgT;
 	QTransform* mScaledImgMatrix;
 	QTransform* mWorldMatrix;
@@ -666,6 +682,11 @@ class DkHistogram : public DkWidget {
 public:
 	DkHistogram(QWidget *parent);
 	~DkHistogram();
+
+	enum {
+		max_image_size = 1024,	// images are down-sampled to this size before counting
+	};
+
 	void drawHistogram(QImage img);
 	void clearHistogram();
 	void setMaxHistogramValue(int maxValue);